@@ -1,7 +1,13 @@
 #pragma once
+#include <chrono>
 #include <functional>
+#include <optional>
+#include <type_traits>
 #include "core.h"
+#include "EvalCache.h"
 #include "KillerMoves.h"
+#include "SearchExtensions.h"
+#include "TranspositionTable.h"
 
 // Uncomment to enable statistics
 //#define STATS
@@ -68,6 +74,8 @@ public:
 			return value <= other.value;
 	}
 
+	payload_t payload() const { return value; }
+
 	//EvalValue& operator=(const EvalValue&) = default;
 
 	EvalValue() {}
@@ -76,11 +84,25 @@ private:
 	payload_t value;
 };
 
-template <typename Pos, KillerOptions ko = KillerOptions::SingleUpdating, bool incremental=false>
+/// <summary>
+/// With copy_make the moves are taken back by restoring a copy of the position instead of -=,
+/// for the trivially copyable positions where a copy is cheaper than undoing the move.
+/// </summary>
+template <typename Pos, KillerOptions ko = KillerOptions::SingleUpdating, bool incremental=false, typename Extensions = NoExtensions, bool copy_make = false>
 requires BoardPosition<Pos>
 class MinMax
 {
 	using Move = typename Pos::Move;
+	static_assert(!copy_make || std::is_trivially_copyable_v<Pos>, "Copy-make needs a trivially copyable position");
+
+	// Plies the extensions may add to a path
+	static constexpr int max_extension = Extensions::budget / Extensions::one_ply;
+
+	// Games where a move may return to an earlier position, the moves tell whether they can be undone
+	static constexpr bool detects_repetitions = Pos::implements_hash() && requires(Move move) { move.is_reversible(); };
+
+	// Games where the endgame tables are probed by the number of pieces, counted once and updated by the captures
+	static constexpr bool probes_endgames = requires(const Pos& pos, Move move) { pos.count_pieces(); move.captured(); };
 #ifdef STATS
 	class Stats
 	{
@@ -95,31 +117,79 @@ class MinMax
 
 		int transposition_hits = 0;
 		int transposition_misses = 0;
+
+		int eval_cache_hits = 0;
+		int eval_cache_misses = 0;
+
+		int endgame_probes = 0;
+		int endgame_hits = 0;
 	};
 	inline static std::vector<Stats> stats;
 #endif
 
 public:
+	/// <summary>
+	/// The history are the keys (get_hash<true>) of the positions of the game before the position,
+	/// the oldest first, since the last irreversible move. Repeating one of them is a draw.
+	/// </summary>
 	static Move FindBestMove(
 		const Pos& position,
 		int depth,
 		std::function<EvalValue::payload_t(Pos& position)> eval_func = [](Pos& position) -> EvalValue::payload_t
 		{
 			return 0;
-		})
+		},
+		const std::vector<uint64_t>& history = {})
+	{
+		return *Search(position, depth, eval_func, history, std::nullopt);
+	}
+
+	/// <summary>
+	/// As FindBestMove, but the search stops at the deadline, checked every few nodes.
+	/// Returns nullopt if the search didn't finish, nothing of it is stored in the transposition tables.
+	/// </summary>
+	static std::optional<Move> FindBestMoveUntil(
+		const Pos& position,
+		int depth,
+		std::chrono::steady_clock::time_point deadline,
+		std::function<EvalValue::payload_t(Pos& position)> eval_func = [](Pos& position) -> EvalValue::payload_t
+		{
+			return 0;
+		},
+		const std::vector<uint64_t>& history = {})
+	{
+		return Search(position, depth, eval_func, history, deadline);
+	}
+
+private:
+	static std::optional<Move> Search(
+		const Pos& position,
+		int depth,
+		std::function<EvalValue::payload_t(Pos& position)> eval_func,
+		const std::vector<uint64_t>& history,
+		std::optional<std::chrono::steady_clock::time_point> deadline)
 	{
 		// depth is an even number greater than zero
 		DCHECK(depth % 2 == 0 && depth > 0);
 
 		MinMax minmax(position, depth);
 		minmax.eval_func = eval_func;
-		minmax.transposition_table.resize(depth + 1);
+		minmax.deadline = deadline;
+		if constexpr (detects_repetitions)
+		{
+			for (uint64_t key : history)
+				minmax.path.push_back({ key, int(minmax.path.size()) });
+			minmax.path.push_back({ minmax.persistent_key(), int(minmax.path.size()) });
+		}
+		minmax.transposition_table.resize(depth + max_extension + 1);
+		if constexpr (probes_endgames)
+			minmax.pieces = position.count_pieces();
 
 		if constexpr (incremental)
 		{
 			// Performing iterative deepening will help with better move ordering
 			// by having the best moves from previous iterations with lower depths.
-			for (int curr_depth = 2; curr_depth < depth; curr_depth += 2)
+			for (int curr_depth = 2; curr_depth < depth && !minmax.aborted; curr_depth += 2)
 			{
 				minmax.Find(curr_depth);
 
@@ -129,7 +199,7 @@ public:
 		}
 
 #ifdef STATS
-		stats.resize(depth + 1);
+		stats.resize(depth + max_extension + 1);
 #endif
 
 		Move move = minmax.Find(depth).move;
@@ -144,27 +214,68 @@ public:
 				<< "Killer misses: " << minmax.killer_manager.size(i) << "\n"
 				<< "Transposition hits: " << s.transposition_hits << "\n"
 				<< "Transposition misses: " << s.transposition_misses << "\n"
-				<< "Transposition size: " << minmax.transposition_table[i].size() << "\n";
+				<< "Transposition size: " << minmax.transposition_table[i].size() << "\n"
+				<< "Eval cache hits: " << s.eval_cache_hits << "\n"
+				<< "Eval cache misses: " << s.eval_cache_misses << "\n"
+				<< "Endgame probes: " << s.endgame_probes << "\n"
+				<< "Endgame hits: " << s.endgame_hits << "\n";
 		}
 		stats.resize(depth + 1);
 #endif
+		if (minmax.aborted)
+			return std::nullopt;
 		return move;
 	}
 
+public:
+
+	/// <summary>
+	/// Shares the table with all the following searches, e.g. a table mapped to a file
+	/// to start warm with the results of previous runs. Pass nullptr to detach.
+	/// The results are stored by the remaining depth, a deeper result is used for shallower searches too.
+	/// </summary>
+	static void attach_transposition_table(TranspositionTable<Pos>* table)
+	{
+		persistent_table = table;
+	}
+
+	/// <summary>
+	/// Caches the evaluations of the leaves of all the following searches, pass nullptr to detach.
+	/// The leaves repeat by the transpositions, inside a search and between the iterations.
+	/// Worth it for expensive evaluation functions, clear the cache when the function changes.
+	/// </summary>
+	static void attach_eval_cache(EvalCache* cache)
+	{
+		eval_cache = cache;
+	}
+
+	/// <summary>
+	/// Probes the endgame tables in all the following searches, e.g. EndTable<Conv>::probe, pass nullptr to detach.
+	/// The positions of at most max_pieces pieces with at least min_depth plies left to search take the exact
+	/// value of the table instead of their subtree, nullopt for the positions without a table.
+	/// At the leaves (min_depth 0) a probe only replaces the evaluation, rarely worth the lookup.
+	/// </summary>
+	static void attach_endgame_tables(std::function<std::optional<TableEntry>(const Pos& position)> probe, int max_pieces = 5, int min_depth = 1)
+	{
+		static_assert(probes_endgames, "The position counts the pieces and the moves tell the captures");
+		endgame_tables = { probe, max_pieces, min_depth };
+	}
+
 	Pos position;
 	std::vector<KillerMoveManager<ko, Move>> killer_manager;
 	
 	MinMax(const Pos& position, int depth) :
 		position(position),
-		killer_manager(depth + 1)
+		killer_manager(depth + max_extension + 1)
 	{
-		this->position.turn_off_all_trackings();
+		// The trackings turned on by the caller are kept, the evaluations read them
 	}
 
 	struct MoveVal
 	{
 		Move move;
 		EvalValue val;
+		bool repetition = false;	// the value depends on the path, a repetition was found below
 	};
 
 private:
@@ -211,6 +322,118 @@ private:
 	
 	std::vector<std::unordered_map<uint64_t, MoveVal>> transposition_table;
 
+	inline static TranspositionTable<Pos>* persistent_table = nullptr;
+
+	inline static EvalCache* eval_cache = nullptr;
+
+	struct EndgameTables
+	{
+		std::function<std::optional<TableEntry>(const Pos& position)> probe;
+		int max_pieces = 0;
+		int min_depth = 0;
+	};
+	inline static EndgameTables endgame_tables;
+
+	// On the board in the current position of the search
+	int pieces = 0;
+
+	std::optional<std::chrono::steady_clock::time_point> deadline;
+	int nodes_to_check = 0;
+
+	// Past the deadline, the values of the unfinished search are dropped
+	bool aborted = false;
+
+	// Reading the clock costs more than a node, it is read every few nodes
+	bool out_of_time()
+	{
+		if (!deadline || aborted)
+			return aborted;
+		if (++nodes_to_check < 1024)
+			return false;
+		nodes_to_check = 0;
+		aborted = std::chrono::steady_clock::now() >= *deadline;
+		return aborted;
+	}
+
+	struct PathEntry
+	{
+		uint64_t key;
+		int reversible;	// plies since the last irreversible move
+	};
+
+	// The game history and the positions of the current line of the search, the last one is the current position
+	std::vector<PathEntry> path;
+
+	bool is_repetition() const
+	{
+		const PathEntry& last = path.back();
+		int n = int(path.size()) - 1;
+		for (int i = n - 4; i >= n - last.reversible; i -= 2)
+		{
+			if (path[i].key == last.key)
+				return true;
+		}
+		return false;
+	}
+
+	// The key includes the player to move, as the persistent table isn't split by the depth
+	uint64_t persistent_key() const
+	{
+		if constexpr (requires(const Pos& pos) { pos.template get_hash<true>(); })
+			return position.template get_hash<true>();
+		else
+			return position.get_hash();
+	}
+
+	EvalValue::payload_t evaluate(int curr_depth)
+	{
+		if constexpr (Pos::implements_hash())
+		{
+			if (eval_cache != nullptr)
+			{
+				uint64_t key = persistent_key();
+				EvalValue::payload_t value;
+				if (eval_cache->probe(key, value))
+				{
+#ifdef STATS
+					stats[curr_depth].eval_cache_hits++;
+#endif
+					return value;
+				}
+#ifdef STATS
+				stats[curr_depth].eval_cache_misses++;
+#endif
+				value = eval_func(position);
+				eval_cache->store(key, value);
+				return value;
+			}
+		}
+		return eval_func(position);
+	}
+
+	/// <summary>
+	/// The value of the table mapped to the values of the search: the distance to the end of the game
+	/// weakens the win or the lose as for the mates found by the search, the draws are 0.
+	/// </summary>
+	template <Player player1>
+	std::optional<EvalValue> probe_endgame(int curr_depth)
+	{
+#ifdef STATS
+		stats[curr_depth].endgame_probes++;
+#endif
+		std::optional<TableEntry> entry = endgame_tables.probe(position);
+		if (!entry)
+			return std::nullopt;
+#ifdef STATS
+		stats[curr_depth].endgame_hits++;
+#endif
+		if (!entry->is_win() && !entry->is_lose())
+			return EvalValue(0);
+
+		EvalValue::payload_t value = EvalValue::max - std::min(entry->plies(), EvalValue::max_plys - 1);
+		return EvalValue(entry->is_win() == (player1 == Player::First) ? value : -value);
+	}
+
 	void clean_up_transposition_table()
 	{
 		for (auto& table : transposition_table)
@@ -225,20 +448,56 @@ private:
 			return Find<Player::Second>(0, max_depth);
 	}
 
+	/// <summary>
+	/// The search stops at max_depth, extended by the extensions of the moves on the path,
+	/// in fractions of a ply. The previous move is the one leading to the position.
+	/// </summary>
 	template <Player player1>
-	MoveVal Find(int curr_depth, int max_depth, EvalValue cut = EvalValue::Win<player1>())
+	MoveVal Find(int curr_depth, int max_depth, EvalValue cut = EvalValue::Win<player1>(), int extended = 0, Move previous = Move())
 	{
 		constexpr Player player2 = oponent(player1);
 		DCHECK(position.turn() == player1);
-		if (curr_depth == max_depth)
-			return { Move(), eval_func(position) };
+		if (out_of_time())
+			return { Move(), 0 };
+
+		// A repeated position is a draw, no need to search the cycle again
+		if constexpr (detects_repetitions)
+		{
+			if (curr_depth > 0 && is_repetition())
+				return { Move(), 0, true };
+		}
+
+		int horizon = max_depth + extended / Extensions::one_ply;
+		if (curr_depth >= horizon)
+			return { Move(), evaluate(curr_depth) };
+
+		// Not for the root, its move has to be found by this search
+		if constexpr (probes_endgames)
+		{
+			if (endgame_tables.probe && curr_depth > 0 && pieces <= endgame_tables.max_pieces && horizon - curr_depth >= endgame_tables.min_depth)
+			{
+				if (std::optional<EvalValue> value = probe_endgame<player1>(curr_depth))
+					return { Move(), *value };
+			}
+		}
 		
 		uint64_t hash;
+		uint64_t persistent_hash = 0;
 		if constexpr (Pos::implements_hash())
 		{
+			// Not for the root, its move has to be found by this search
+			if (persistent_table != nullptr && curr_depth > 0)
+			{
+				persistent_hash = persistent_key();
+				typename TranspositionTable<Pos>::Payload payload;
+				if (persistent_table->probe(persistent_hash, payload) && payload.depth >= horizon - curr_depth)
+					return { payload.move, EvalValue(payload.value) };
+			}
+
 			if (curr_depth >= 3)
 			{
-				hash = position.get_hash();
+				// The extended paths reach the same depth with different remaining depths
+				hash = position.get_hash() ^ (uint64_t(extended) * 0x9E3779B97F4A7C15ull);
 				auto it = transposition_table[curr_depth].find(hash);
 				if (it != transposition_table[curr_depth].end())
 				{
@@ -256,7 +515,26 @@ private:
 			}
 		}
 
+		struct NoCopy {};
+		auto saved = [this]()
+		{
+			if constexpr (copy_make)
+				return position;
+			else
+				return NoCopy();
+		}();
+
+		// Takes the move back
+		auto undo = [this, &saved](Move move)
+		{
+			if constexpr (copy_make)
+				position = saved;
+			else
+				position -= move;
+		};
+
 		MoveVal best { Move(), EvalValue::Lose<player1>() };
+		bool repetition = false;
 		for (auto move1 : all_legal_moves_played_and_killer(curr_depth))
 		{
 			DCHECK(position.turn() == player2);
@@ -270,15 +548,36 @@ private:
 			// If this is a winning move, return immediately
 			if (position.easycheck_winning_move(move1))
 			{
-				position -= move1;
+				undo(move1);
 				return { move1, EvalValue::Win<player1>() };
 			}
 
+			int extension = 0;
+			if constexpr (max_extension > 0)
+				extension = std::min(Extensions::extension(position, move1, previous), Extensions::budget - extended);
+
+			if constexpr (detects_repetitions)
+				path.push_back({ persistent_key(), move1.is_reversible() ? path.back().reversible + 1 : 0 });
+
+			int captured = 0;
+			if constexpr (probes_endgames)
+			{
+				captured = move1.captured() != decltype(move1.captured())() ? 1 : 0;
+				pieces -= captured;
+			}
+
 			// Perform recursive call and reverse the move
-			MoveVal best2 = Find<player2>(curr_depth + 1, max_depth, best.val);
+			MoveVal best2 = Find<player2>(curr_depth + 1, max_depth, best.val, extended + extension, move1);
+			repetition |= best2.repetition;
+			pieces += captured;
+
+			if constexpr (detects_repetitions)
+				path.pop_back();
 			// Help prefer quicker mates
   			best2.val.weaken_ending_position();
-			position -= move1;
+			undo(move1);
+			if (aborted)
+				return best;
 
 			// Update the best if the search returned better value for player1
 			if (best2.val.is_better<player1>(best.val))
@@ -286,7 +585,10 @@ private:
 
 			// Cut the search if better or same to the cut value
 			if (best.val.is_better_or_same<player1>(cut))
+			{
+				best.repetition = repetition;
 				return best;
+			}
 		}
 
 		// If no moves, value=0. For chess verify if checked, then lose.
@@ -299,9 +601,15 @@ private:
 
 		killer_manager[curr_depth].update(best.move);
 
+		// A draw by repetition holds only on this path, the value isn't stored for the other paths to the position
+		best.repetition = repetition;
 		if constexpr (Pos::implements_hash())
 		{
+			if (repetition)
+				return best;
 			transposition_table[curr_depth][hash] = best;
+			if (persistent_table != nullptr && curr_depth > 0)
+				persistent_table->store(persistent_hash, best.move, best.val.payload(), horizon - curr_depth);
 		}
 		return best;
 	}
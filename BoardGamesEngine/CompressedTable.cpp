@@ -0,0 +1,349 @@
+#include "CompressedTable.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace
+{
+	// Probabilities of a zero bit in 1/2048, adapted by 1/32 of the error after each bit
+	constexpr int probability_bits = 11;
+	constexpr int adapt_shift = 5;
+	constexpr uint16_t probability_half = 1 << (probability_bits - 1);
+	constexpr uint32_t range_top = 1u << 24;
+
+	constexpr int distance_bits = 7;	// the moves of a TableEntry are below 128
+	constexpr int distance_contexts = 32;	// the previous distances over it share the last context
+
+	std::atomic<uint64_t> next_id = 1;
+
+	class RangeEncoder
+	{
+	public:
+		explicit RangeEncoder(std::vector<uint8_t>& out) : out(out) {}
+
+		void encode(uint16_t& probability, int bit)
+		{
+			uint32_t bound = (range >> probability_bits) * probability;
+			if (bit == 0)
+			{
+				range = bound;
+				probability += ((1 << probability_bits) - probability) >> adapt_shift;
+			}
+			else
+			{
+				low += bound;
+				range -= bound;
+				probability -= probability >> adapt_shift;
+			}
+			while (range < range_top)
+			{
+				range <<= 8;
+				shift_low();
+			}
+		}
+
+		void flush()
+		{
+			for (int i = 0; i < 5; i++)
+				shift_low();
+		}
+
+	private:
+		// The top byte is written once no carry can change it, the run of 0xFF bytes waits for the carry
+		void shift_low()
+		{
+			if (uint32_t(low) < 0xFF000000u || (low >> 32) != 0)
+			{
+				uint8_t carry = uint8_t(low >> 32);
+				uint8_t byte = cache;
+				do
+				{
+					out.push_back(uint8_t(byte + carry));
+					byte = 0xFF;
+				} while (--pending != 0);
+				cache = uint8_t(low >> 24);
+			}
+			pending++;
+			low = (low & 0x00FFFFFFu) << 8;
+		}
+
+		std::vector<uint8_t>& out;
+		uint64_t low = 0;
+		uint32_t range = 0xFFFFFFFFu;
+		uint8_t cache = 0;
+		uint64_t pending = 1;
+	};
+
+	class RangeDecoder
+	{
+	public:
+		RangeDecoder(const uint8_t* begin, const uint8_t* end) : next(begin), end(end)
+		{
+			for (int i = 0; i < 5; i++)
+				code = (code << 8) | read();
+		}
+
+		int decode(uint16_t& probability)
+		{
+			uint32_t bound = (range >> probability_bits) * probability;
+			int bit;
+			if (code < bound)
+			{
+				range = bound;
+				probability += ((1 << probability_bits) - probability) >> adapt_shift;
+				bit = 0;
+			}
+			else
+			{
+				code -= bound;
+				range -= bound;
+				probability -= probability >> adapt_shift;
+				bit = 1;
+			}
+			while (range < range_top)
+			{
+				range <<= 8;
+				code = (code << 8) | read();
+			}
+			return bit;
+		}
+
+	private:
+		// Past the end of a corrupted block the values are wrong but the reads stay in the block
+		uint8_t read() { return next < end ? *next++ : 0; }
+
+		const uint8_t* next;
+		const uint8_t* end;
+		uint32_t range = 0xFFFFFFFFu;
+		uint32_t code = 0;
+	};
+
+	/// <summary>
+	/// The adaptive probabilities of one block, the symbols are coded as bit trees:
+	/// WDL by the previous WDL, the distance by the result and the previous distance of the same result.
+	/// </summary>
+	struct Model
+	{
+		uint16_t wdl[3][4];
+		uint16_t distance[2][distance_contexts][1 << distance_bits];
+		int previous_wdl = 0;
+		int previous_distance[2] = {};
+
+		Model()
+		{
+			std::fill(&wdl[0][0], &wdl[0][0] + sizeof(wdl) / sizeof(uint16_t), probability_half);
+			std::fill(&distance[0][0][0], &distance[0][0][0] + sizeof(distance) / sizeof(uint16_t), probability_half);
+		}
+
+		uint16_t* distance_probabilities(int result)
+		{
+			return distance[result][std::min(previous_distance[result], distance_contexts - 1)];
+		}
+	};
+
+	// 0 for open, 1 for a win, 2 for a lose
+	int wdl_symbol(TableEntry entry)
+	{
+		return entry.is_win() ? 1 : entry.is_lose() ? 2 : 0;
+	}
+
+	// The moves of TableEntry::Win or TableEntry::Lose
+	int distance_of(TableEntry entry)
+	{
+		return entry.is_win() ? (entry.plies() + 1) / 2 : entry.plies() / 2;
+	}
+
+	void encode_tree(RangeEncoder& encoder, uint16_t* probabilities, int bits, int symbol)
+	{
+		int node = 1;
+		for (int i = bits - 1; i >= 0; i--)
+		{
+			int bit = (symbol >> i) & 1;
+			encoder.encode(probabilities[node], bit);
+			node = node * 2 + bit;
+		}
+	}
+
+	int decode_tree(RangeDecoder& decoder, uint16_t* probabilities, int bits)
+	{
+		int node = 1;
+		for (int i = 0; i < bits; i++)
+			node = node * 2 + decoder.decode(probabilities[node]);
+		return node - (1 << bits);
+	}
+}
+
+struct CompressedTable::Block
+{
+	uint64_t table = 0;	// the id, 0 for none
+	SIZE index = 0;
+	bool distances = false;
+	std::vector<int8_t> wdl;
+	std::vector<TableEntry> entries;	// with the distances only
+};
+
+bool CompressedTable::write(const std::string& path, const TableEntry* entries, SIZE count, uint32_t block_size)
+{
+	if (block_size == 0)
+		return false;
+	SIZE blocks = (count + block_size - 1) / block_size;
+	std::vector<uint64_t> wdl_offsets(1, 0), distance_offsets(1, 0);
+	std::vector<uint8_t> wdl_stream, distance_stream;
+	for (SIZE block = 0; block < blocks; block++)
+	{
+		Model model;
+		RangeEncoder wdl_encoder(wdl_stream), distance_encoder(distance_stream);
+		SIZE end = std::min(count, (block + 1) * block_size);
+		for (SIZE index = block * block_size; index < end; index++)
+		{
+			int symbol = wdl_symbol(entries[index]);
+			encode_tree(wdl_encoder, model.wdl[model.previous_wdl], 2, symbol);
+			model.previous_wdl = symbol;
+			if (symbol == 0)
+				continue;
+			int result = symbol - 1, distance = distance_of(entries[index]);
+			encode_tree(distance_encoder, model.distance_probabilities(result), distance_bits, distance);
+			model.previous_distance[result] = distance;
+		}
+		wdl_encoder.flush();
+		distance_encoder.flush();
+		wdl_offsets.push_back(wdl_stream.size());
+		distance_offsets.push_back(distance_stream.size());
+	}
+
+	Header header;
+	std::memset(&header, 0, sizeof(Header));
+	header.magic = magic;
+	header.version = version;
+	header.block_size = block_size;
+	header.entries = count;
+	header.blocks = blocks;
+	header.wdl_size = wdl_stream.size();
+	header.distance_size = distance_stream.size();
+
+	std::string temporary = path + ".tmp";
+	{
+		size_t index_size = 2 * (blocks + 1) * sizeof(uint64_t);
+		MemoryMappedFile out;
+		if (!out.open_write(temporary, sizeof(Header) + index_size + wdl_stream.size() + distance_stream.size()))
+			return false;
+		uint8_t* next = out.data();
+		auto append = [&next](const void* data, size_t size)
+		{
+			if (size > 0)
+				std::memcpy(next, data, size);
+			next += size;
+		};
+		append(&header, sizeof(Header));
+		append(wdl_offsets.data(), wdl_offsets.size() * sizeof(uint64_t));
+		append(distance_offsets.data(), distance_offsets.size() * sizeof(uint64_t));
+		append(wdl_stream.data(), wdl_stream.size());
+		append(distance_stream.data(), distance_stream.size());
+		out.flush();
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	return !error;
+}
+
+bool CompressedTable::open(const std::string& path)
+{
+	close();
+	if (!file.open_read(path) || file.size() < sizeof(Header))
+	{
+		close();
+		return false;
+	}
+
+	const Header* candidate = reinterpret_cast<const Header*>(file.data());
+	SIZE index_size = 2 * (candidate->blocks + 1) * sizeof(uint64_t);
+	bool valid = candidate->magic == magic && candidate->version == version && candidate->block_size > 0 &&
+		candidate->blocks == (candidate->entries + candidate->block_size - 1) / candidate->block_size &&
+		file.size() == sizeof(Header) + index_size + candidate->wdl_size + candidate->distance_size;
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	header = candidate;
+	wdl_offsets = reinterpret_cast<const uint64_t*>(file.data() + sizeof(Header));
+	distance_offsets = wdl_offsets + header->blocks + 1;
+	for (SIZE block = 0; block < header->blocks; block++)
+		valid &= wdl_offsets[block] <= wdl_offsets[block + 1] && distance_offsets[block] <= distance_offsets[block + 1];
+	if (!valid || wdl_offsets[0] != 0 || distance_offsets[0] != 0 ||
+		wdl_offsets[header->blocks] != header->wdl_size || distance_offsets[header->blocks] != header->distance_size)
+	{
+		close();
+		return false;
+	}
+	wdl_stream = file.data() + sizeof(Header) + index_size;
+	distance_stream = wdl_stream + header->wdl_size;
+	id = next_id++;
+	return true;
+}
+
+void CompressedTable::close()
+{
+	file.close();
+	header = nullptr;
+	wdl_offsets = distance_offsets = nullptr;
+	wdl_stream = distance_stream = nullptr;
+	id = 0;
+}
+
+const CompressedTable::Block& CompressedTable::decode(SIZE block, bool distances) const
+{
+	// A few blocks per thread, the probes of a search stay mostly in the same blocks
+	constexpr int cache_slots = 16;
+	thread_local Block cache[cache_slots];
+	Block& cached = cache[(id * 0x9E3779B97F4A7C15ull + block) % cache_slots];
+	if (cached.table == id && cached.index == block && (cached.distances || !distances))
+		return cached;
+
+	decodes.fetch_add(1, std::memory_order_relaxed);
+	cached.table = id;
+	cached.index = block;
+	cached.distances = distances;
+	SIZE first = block * header->block_size;
+	size_t count = size_t(std::min<SIZE>(header->entries - first, header->block_size));
+	cached.wdl.resize(count);
+	cached.entries.resize(distances ? count : 0);
+
+	Model model;
+	RangeDecoder wdl_decoder(wdl_stream + wdl_offsets[block], wdl_stream + wdl_offsets[block + 1]);
+	RangeDecoder distance_decoder(distance_stream + distance_offsets[block], distance_stream + distance_offsets[block + 1]);
+	for (size_t i = 0; i < count; i++)
+	{
+		int symbol = decode_tree(wdl_decoder, model.wdl[model.previous_wdl], 2);
+		model.previous_wdl = symbol = std::min(symbol, 2);
+		cached.wdl[i] = int8_t(symbol == 0 ? 0 : symbol == 1 ? 1 : -1);
+		if (!distances)
+			continue;
+		if (symbol == 0)
+		{
+			cached.entries[i] = TableEntry();
+			continue;
+		}
+		int result = symbol - 1;
+		int distance = decode_tree(distance_decoder, model.distance_probabilities(result), distance_bits);
+		model.previous_distance[result] = distance;
+		cached.entries[i] = result == 0 ? TableEntry::Win(std::max(distance, 1)) : TableEntry::Lose(distance);
+	}
+	return cached;
+}
+
+int CompressedTable::wdl(SIZE index) const
+{
+	DCHECK(index < size());
+	const Block& block = decode(index / header->block_size, false);
+	return block.wdl[index % header->block_size];
+}
+
+TableEntry CompressedTable::operator[](SIZE index) const
+{
+	DCHECK(index < size());
+	const Block& block = decode(index / header->block_size, true);
+	return block.entries[index % header->block_size];
+}
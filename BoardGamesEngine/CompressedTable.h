@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "core.h"
+#include "MemoryMappedFile.h"
+
+/// <summary>
+/// Read-only compressed file of the entries of an endgame table with random access by the index.
+/// The entries are split into two streams, compressed block by block:
+/// - WDL: win, lose or open of every entry,
+/// - distance: the moves to the end of the game of the wins and the loses only.
+/// Each block of block_size entries is coded on its own by an adaptive binary range coder,
+/// the offsets of the blocks in both streams are indexed after the header.
+/// The WDL is context modelled by the previous entry, the distance by the previous distance of the same result,
+/// the neighbour indices of the tables mostly share both.
+/// Probing a block decodes it whole, the last decoded blocks are cached per thread so the probes never lock.
+/// wdl() decodes only the WDL stream, enough for the search to know the result.
+/// </summary>
+class CompressedTable
+{
+public:
+	static constexpr uint64_t magic = 0x3142544347524342ull;	// "BCRGCTB1"
+	static constexpr uint32_t version = 1;
+	// A miss decodes the block whole, the larger blocks compress better
+	static constexpr uint32_t default_block_size = 4096;
+
+	struct Header
+	{
+		uint64_t magic;
+		uint32_t version;
+		uint32_t block_size;
+		uint64_t entries;
+		uint64_t blocks;
+		uint64_t wdl_size;		// bytes of the WDL stream
+		uint64_t distance_size;	// bytes of the distance stream
+	};
+
+	/// <summary>
+	/// Compresses the entries to a temporary file renamed to the path when complete.
+	/// Returns false if it can't be written.
+	/// </summary>
+	static bool write(const std::string& path, const TableEntry* entries, SIZE count, uint32_t block_size = default_block_size);
+
+	/// <summary>
+	/// Maps the file for reading, returns false if it doesn't exist or isn't a valid compressed table.
+	/// </summary>
+	bool open(const std::string& path);
+	void close();
+
+	bool is_open() const { return file.is_open(); }
+	SIZE size() const { return header == nullptr ? 0 : header->entries; }
+	size_t compressed_size() const { return file.size(); }
+
+	// The size of the entries uncompressed by the size of the file
+	double ratio() const { return file.size() > 0 ? double(size() * sizeof(TableEntry)) / file.size() : 0; }
+
+	/// <summary>
+	/// 1 for a win, -1 for a lose and 0 for open, without the distance.
+	/// </summary>
+	int wdl(SIZE index) const;
+
+	TableEntry operator[](SIZE index) const;
+
+	// The blocks decoded by all the threads, the probes missing their caches
+	size_t decoded_blocks() const { return decodes.load(std::memory_order_relaxed); }
+
+private:
+	struct Block;
+
+	// The entries of the block from the cache of the thread, with the distances only if needed
+	const Block& decode(SIZE block, bool distances) const;
+
+	MemoryMappedFile file;
+	const Header* header = nullptr;
+	const uint64_t* wdl_offsets = nullptr;		// blocks + 1, in the WDL stream
+	const uint64_t* distance_offsets = nullptr;	// blocks + 1, in the distance stream
+	const uint8_t* wdl_stream = nullptr;
+	const uint8_t* distance_stream = nullptr;
+	uint64_t id = 0;	// of the cached blocks, unique for each open()
+	mutable std::atomic<size_t> decodes = 0;
+};
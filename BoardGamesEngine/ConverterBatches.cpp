@@ -1,3 +1,309 @@
-#include <iostream>
+#include <algorithm>
+#include <bit>
+#include "ConverterBatches.h"
 
-#include "ConverterBatches.h"
\ No newline at end of file
+using namespace chess;
+
+namespace
+{
+    // 0 when the batch doesn't fit
+    SIZE choose(int n, int k)
+    {
+        return n < k ? 0 : nk(n, k);
+    }
+
+    // The squares the pawns may take
+    constexpr uint64_t pawn_squares = 0x00FFFFFFFFFFFF00ull;
+
+    const int pawn_type = 5;
+
+    // The square of the n-th bit of the mask
+    int select_bit(uint64_t mask, int n)
+    {
+        for (; n > 0; n--)
+            mask &= mask - 1;
+        DCHECK(mask != 0);
+        return std::countr_zero(mask);
+    }
+
+    // The pieces of each side of the key by their place in piece_order
+    void key_counts(const std::string& key, int (&counts)[2][6])
+    {
+        int side = 0;
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            if (i > 0 && key[i] == 'K')
+                side = 1;
+            counts[side][ConverterSimple::piece_order.find(key[i])]++;
+        }
+    }
+
+    /// <summary>
+    /// A symmetry of the board, the columns mirrored first, then the rows and the diagonal.
+    /// </summary>
+    struct Symmetry
+    {
+        bool columns = false, rows = false, diagonal = false;
+        bool kings_on_diagonal = false;  // both ways are canonical for the kings
+
+        // The symmetry moving the kings to one of the canonical pairs
+        Symmetry(bool pawns, int king, int other_king)
+        {
+            columns = king % 8 > 3;
+            if (pawns)
+                return;
+            rows = king / 8 > 3;
+            int sq = (*this)(king), other = (*this)(other_king);
+            kings_on_diagonal = sq / 8 == sq % 8 && other / 8 == other % 8;
+            diagonal = sq / 8 > sq % 8 || (sq / 8 == sq % 8 && other / 8 > other % 8);
+        }
+
+        int operator()(int sq) const
+        {
+            int x = sq % 8, y = sq / 8;
+            if (columns) x = 7 - x;
+            if (rows) y = 7 - y;
+            if (diagonal) std::swap(x, y);
+            return y * 8 + x;
+        }
+    };
+
+    struct KingPairs
+    {
+        std::vector<std::pair<int, int>> pairs;
+        std::vector<int> index;  // by king * 64 + other_king
+
+        KingPairs(bool pawns) : index(64 * 64, -1)
+        {
+            for (int king = 0; king < 64; king++)
+            {
+                for (int other_king = 0; other_king < 64; other_king++)
+                {
+                    if (Square(king).king_distance(Square(other_king)) < 2)
+                        continue;
+                    int x = king % 8, y = king / 8;
+                    if (x > 3)
+                        continue;
+                    if (!pawns && (y > x || (x == y && other_king / 8 > other_king % 8)))
+                        continue;
+                    index[king * 64 + other_king] = int(pairs.size());
+                    pairs.push_back({ king, other_king });
+                }
+            }
+        }
+    };
+
+    const KingPairs& king_table(bool pawns)
+    {
+        static const KingPairs tables[2] = { KingPairs(false), KingPairs(true) };
+        return tables[pawns];
+    }
+}
+
+const std::vector<std::pair<int, int>>& ConverterBatches::king_pairs(bool pawns)
+{
+    return king_table(pawns).pairs;
+}
+
+int ConverterBatches::king_pair_index(bool pawns, int king, int other_king)
+{
+    return king_table(pawns).index[king * 64 + other_king];
+}
+
+int ConverterBatches::batches(const int (&counts)[2][6], Batch (&ret)[10])
+{
+    int n = 0;
+    for (int side = 0; side < 2; side++)
+    {
+        if (counts[side][pawn_type] > 0)
+            ret[n++] = { side, pawn_type, counts[side][pawn_type] };
+    }
+    for (int side = 0; side < 2; side++)
+    {
+        for (int type = 1; type < pawn_type; type++)
+        {
+            if (counts[side][type] > 0)
+                ret[n++] = { side, type, counts[side][type] };
+        }
+    }
+    return n;
+}
+
+SIZE ConverterBatches::KeyToSize(std::string key)
+{
+    int counts[2][6] = {};
+    key_counts(key, counts);
+    bool pawns = counts[0][pawn_type] + counts[1][pawn_type] > 0;
+    SIZE size = king_pairs(pawns).size();
+
+    Batch list[10];
+    int n = batches(counts, list);
+    int pawns_placed = 0, placed = 2;
+    for (int b = 0; b < n; b++)
+    {
+        if (list[b].type == pawn_type)
+        {
+            size *= choose(48 - pawns_placed, list[b].count);
+            pawns_placed += list[b].count;
+        }
+        else
+        {
+            size *= choose(64 - placed, list[b].count);
+        }
+        placed += list[b].count;
+    }
+    return size;
+}
+
+std::pair<std::string, SIZE> ConverterBatches::PositionToKeyIndex(const ChessPosition& position)
+{
+    // The squares from the side of the player to move
+    int squares[2][6][10];
+    int counts[2][6] = {};
+    int flip = position.turn() == Player::First ? 0 : 56;
+    for (int sq = 0; sq < 64; sq++)
+    {
+        Piece piece = position[Square(sq)];
+        if (piece == Piece::None)
+            continue;
+        int side = belongs_to(piece, position.turn()) ? 0 : 1;
+        int type = piece_index(piece);
+        squares[side][type][counts[side][type]++] = sq ^ flip;
+    }
+
+    std::pair<std::string, SIZE> ret;
+    for (int side = 0; side < 2; side++)
+    {
+        for (int type = 0; type < 6; type++)
+            ret.first.append(counts[side][type], piece_order[type]);
+    }
+
+    bool pawns = counts[0][pawn_type] + counts[1][pawn_type] > 0;
+    Batch list[10];
+    int n = batches(counts, list);
+
+    // The squares of the batches one after another, ascending in each batch
+    auto place = [&](const Symmetry& symmetry, int (&placed)[32])
+    {
+        int* next = placed;
+        for (int b = 0; b < n; b++)
+        {
+            for (int i = 0; i < list[b].count; i++)
+                next[i] = symmetry(squares[list[b].side][list[b].type][i]);
+            std::sort(next, next + list[b].count);
+            next += list[b].count;
+        }
+        return int(next - placed);
+    };
+
+    Symmetry symmetry(pawns, squares[0][0][0], squares[1][0][0]);
+    int placed[32];
+    int count = place(symmetry, placed);
+    if (symmetry.kings_on_diagonal)
+    {
+        // The other pieces decide, the mirrored position of the smaller squares is the canonical one
+        Symmetry mirrored = symmetry;
+        mirrored.diagonal = true;
+        int mirrored_placed[32];
+        place(mirrored, mirrored_placed);
+        if (std::lexicographical_compare(mirrored_placed, mirrored_placed + count, placed, placed + count))
+        {
+            symmetry = mirrored;
+            std::copy(mirrored_placed, mirrored_placed + count, placed);
+        }
+    }
+
+    int king = symmetry(squares[0][0][0]), other_king = symmetry(squares[1][0][0]);
+    int pair = king_pair_index(pawns, king, other_king);
+    DCHECK(pair >= 0);
+    ret.second = pair;
+    SIZE factor = king_pairs(pawns).size();
+
+    uint64_t occupied = (uint64_t(1) << king) | (uint64_t(1) << other_king);
+    uint64_t pawns_occupied = 0;
+    for (int b = 0, first = 0; b < n; first += list[b].count, b++)
+    {
+        const Batch& batch = list[b];
+        const int* batch_squares = placed + first;
+
+        // The rank of the places among the free squares, by the combinatorial number system
+        bool pawn = batch.type == pawn_type;
+        uint64_t free = pawn ? pawn_squares & ~pawns_occupied : ~occupied;
+        SIZE rank = 0;
+        for (int i = 0; i < batch.count; i++)
+        {
+            int place = std::popcount(free & ((uint64_t(1) << batch_squares[i]) - 1));
+            rank += choose(place, i + 1);
+        }
+        ret.second += rank * factor;
+        factor *= choose(std::popcount(free), batch.count);
+
+        for (int i = 0; i < batch.count; i++)
+        {
+            occupied |= uint64_t(1) << batch_squares[i];
+            if (pawn)
+                pawns_occupied |= uint64_t(1) << batch_squares[i];
+        }
+    }
+    return ret;
+}
+
+bool ConverterBatches::KeyIndexToPosition(std::string key, SIZE index, ChessPosition& pos)
+{
+    SIZE key_index = index;
+    int counts[2][6] = {};
+    key_counts(key, counts);
+    bool pawns = counts[0][pawn_type] + counts[1][pawn_type] > 0;
+    const auto& pairs = king_pairs(pawns);
+    auto [king, other_king] = pairs[index % pairs.size()];
+    index /= pairs.size();
+
+    FenFields fields;
+    std::fill(std::begin(fields.board), std::end(fields.board), Piece::None);
+    fields.board[king] = Piece::King;
+    fields.board[other_king] = Piece::OtherKing;
+    uint64_t occupied = (uint64_t(1) << king) | (uint64_t(1) << other_king);
+    uint64_t pawns_occupied = 0;
+
+    Batch list[10];
+    int n = batches(counts, list);
+    for (int b = 0; b < n; b++)
+    {
+        const Batch& batch = list[b];
+        bool pawn = batch.type == pawn_type;
+        uint64_t free = pawn ? pawn_squares & ~pawns_occupied : ~occupied;
+        SIZE size = choose(std::popcount(free), batch.count);
+        SIZE rank = index % size;
+        index /= size;
+
+        // The largest place first, the largest with (place / i) <= rank
+        Piece piece = Piece(batch.type + 1);
+        if (batch.side == 1)
+            piece = other(piece);
+        for (int i = batch.count; i > 0; i--)
+        {
+            int place = i - 1;
+            while (choose(place + 1, i) <= rank)
+                place++;
+            rank -= choose(place, i);
+
+            int sq = select_bit(free, place);
+            uint64_t bit = uint64_t(1) << sq;
+            if (occupied & bit)
+                return false;
+            occupied |= bit;
+            if (pawn)
+                pawns_occupied |= bit;
+            fields.board[sq] = piece;
+        }
+    }
+
+    fields.turn = Player::First;
+    pos.set_fen(fields);
+    if (pos.is_checked(Player::Second))
+        return false;
+
+    // With the kings on the diagonal only one of the mirrored positions is canonical
+    bool kings_on_diagonal = !pawns && king / 8 == king % 8 && other_king / 8 == other_king % 8;
+    return !kings_on_diagonal || PositionToIndex(pos) == key_index;
+}
@@ -1,38 +1,62 @@
 #pragma once
+#include <string>
+#include <utility>
+#include <vector>
 #include "Games\chess.h"
+#include "Games\chess_converters.h"
 #include "combinations.h"
-//#define SIZE long long
 
 namespace chess {
 
-    struct ConverterBatches
+    /// <summary>
+    /// The tables of ConverterSimple (the same keys, dependent and opponent tables) with a perfect index:
+    /// - The kings are a pair of squares not side by side. Without pawns the king of the player to move is in
+    ///   the triangle A1-D1-D4, and the other king below the diagonal when the first one is on it: 462 pairs.
+    ///   With pawns the king of the player to move is on the left half: 1806 pairs. The other positions
+    ///   are mirrored by the 8 symmetries of the board, only by the columns with pawns.
+    /// - The rest of pieces come in batches by type and color, the pawns of both players first. A batch of k pieces
+    ///   is a combination of k free squares: (48 - pawns placed / k) for the pawns and (64 - pieces placed / k)
+    ///   for the others (A/B is the number of combinations, ranked with nk).
+    /// For example "KQK" has 462 x 62 = 28644 indices instead of 64^3 = 262144 and "KRRK" 462 x (62 / 2) = 873642
+    /// instead of 64^4. With both kings on the diagonal the squares of the other pieces decide between the mirrored
+    /// positions, the index of the other one is no position as the indices of a pawn on a king or of a check.
+    /// </summary>
+    struct ConverterBatches : ConverterSimple
     {
         static std::string name() { return "ConverterBatches"; }
-        // Without pawns:
-        // Q1,R1,B1,N1,Q2,R2,B2,N2 - number of queens, rooks, bishops and knights for each player
-        // 10                   x (63 / Q1)             x (63-Q1 / R1)             x (63-Q1-R1 / B1)             x (63-Q1-R1-B1 / N1) x
-        // (63-Q1-R1-B1-N1 / 1) x (63-Q1-R1-B1-N1 / Q2) x (63-Q1-R1-B1-N1-Q2 / R2) x (63-Q1-R1-B1-N1-Q2-R2 / B2) x (63-Q1-R1-B1-N1-Q2-R2-B2 / N2)
-        // (Note that A/B is number of combinations not division)
-        // The king is at first quadrant (first 4 rows and first 4 columns) and below diagonal. That is 1+2+3+4=10 fields.
-        // The rest of pieces come in batches by type and color. For example, if there are 2 queens they can take 63x62/2 positions.
-        //static SIZE size(const EndTable& end_table)
-        //{
-        //    if (!end_table.has_pawns())
-        //    {
-        //        const std::string& type = end_table.get_type();
-        //        SIZE ret = 10;  // 10 = 1+2+3+4
-        //        for (int i = 1; i < end_table.get_type().length(); )
-        //        {
-        //            int j = i;
-        //            while (type[j] == type[i]) { j++; }
-        //            SIZE mul = nk(64 - i, j - i);
-        //            ret *= mul;
-        //            i = j;
-        //        }
-        //        return ret;
-        //    }
-        //    //int q1, r1, b1, n1, q2, r2, b2, n2;
-        //    DCHECK_FAIL;
-        //}
+
+        static SIZE KeyToSize(std::string key);
+
+        static SIZE PositionToIndex(const ChessPosition& position)
+        {
+            return PositionToKeyIndex(position).second;
+        }
+
+        static std::pair<std::string, SIZE> PositionToKeyIndex(const ChessPosition& position);
+
+        /// <summary>
+        /// The position of the canonical squares, the first player to move.
+        /// Returns false for a pawn on a king, the opponent in check or the position mirrored by the diagonal.
+        /// </summary>
+        static bool KeyIndexToPosition(std::string key, SIZE index, ChessPosition& pos);
+
+        /// <summary>
+        /// The squares of the kings by the index of the pair, the king of the player to move first.
+        /// </summary>
+        static const std::vector<std::pair<int, int>>& king_pairs(bool pawns);
+
+    private:
+        struct Batch
+        {
+            int side;   // 0 for the player to move
+            int type;   // the place in piece_order
+            int count;
+        };
+
+        // The batches of the key in the order of the index, the number of them
+        static int batches(const int (&counts)[2][6], Batch (&ret)[10]);
+
+        // The index of the pair by the squares of the kings, -1 for the pairs not canonical or side by side
+        static int king_pair_index(bool pawns, int king, int other_king);
     };
 }
@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include "core.h"
+
+/// <summary>
+/// Small lossy cache of the evaluations of the leaves, shared by the threads without locks.
+/// Each slot is a single 64-bit word: the upper half of the key checks the slot, the lower half is the value,
+/// so a slot is either read whole or not at all. A new value overwrites the slot of its key.
+/// The values are only valid for one evaluation function, clear the cache when it changes.
+/// </summary>
+class EvalCache
+{
+public:
+	/// <summary>
+	/// The number of entries is rounded down to a power of two, 8 bytes each.
+	/// </summary>
+	explicit EvalCache(size_t entries = size_t(1) << 16) :
+		mask(std::bit_floor(std::max<size_t>(entries, 1)) - 1),
+		slots(new std::atomic<uint64_t>[mask + 1])
+	{
+		clear();
+	}
+
+	bool probe(uint64_t key, int32_t& value) const
+	{
+		uint64_t slot = slots[key & mask].load(std::memory_order_relaxed);
+		if ((slot & 0xFFFFFFFF00000000ull) != check(key))
+			return false;
+		value = int32_t(uint32_t(slot));
+		return true;
+	}
+
+	void store(uint64_t key, int32_t value)
+	{
+		slots[key & mask].store(check(key) | uint32_t(value), std::memory_order_relaxed);
+	}
+
+	void clear()
+	{
+		for (size_t i = 0; i <= mask; i++)
+			slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	size_t size() const { return mask + 1; }
+
+private:
+	// The lowest bit is set, so an empty slot never matches
+	static uint64_t check(uint64_t key)
+	{
+		return (key | 0x100000000ull) & 0xFFFFFFFF00000000ull;
+	}
+
+	size_t mask;
+	std::unique_ptr<std::atomic<uint64_t>[]> slots;
+};
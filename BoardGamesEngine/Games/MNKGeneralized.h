@@ -181,7 +181,7 @@ public:
 	bool is_legal() const
 	{
 		bool XStreakFound = false, OStreakFound = false;
-		for (auto generator : all_directions())
+		for (auto& generator : all_directions())
 		{
 			// Count Xs and Os in a row and if they both count to R,
 			// the position is not legal.
@@ -291,11 +291,49 @@ public:
 		this->square(move.square) = Field::Empty;
 	}
 
-	bool is_lost() const
+	// R or more of the field in a row
+	bool has_row(Field field) const
 	{
-		// TODO: implement
+		for (auto& generator : all_directions())
+		{
+			int count = 0;
+			for (Field f : generator)
+			{
+				count = f == field ? count + 1 : 0;
+				if (count >= R)
+					return true;
+			}
+		}
 		return false;
 	}
+
+	// The player who moved last has the row
+	bool is_lost() const
+	{
+		return has_row(this->turn() == Player::First ? Field::O : Field::X);
+	}
+
+	/// <summary>
+	/// Zobrist-like hash of the fields. The keys are derived on the fly with splitmix64
+	/// so no tables have to be initialized. The turn is implied by the number of tokens.
+	/// </summary>
+	uint64_t get_hash() const
+	{
+		uint64_t ret = 0;
+		for (int i = 0; i < W * H; i++)
+		{
+			Field field = this->table[i];
+			if (field != Field::Empty)
+				ret ^= field_key(i, field);
+		}
+		return ret;
+	}
+
+private:
+	static constexpr uint64_t field_key(int square, Field field)
+	{
+		return splitmix64(uint64_t(2 * square + (field == Field::X ? 1 : 2)));
+	}
 };
 
 // Fields sorted by distance from the center of WxH board
@@ -508,9 +546,10 @@ namespace std {
 template <int W, int H, int R>
 struct MNKGGravityConverter
 {
-	typedef MNKGravity<W, H, R> Position;
-	typedef std::array<int8_t, W> Key;
-	typedef Move<W, H> Move;
+	using Position = MNKGravity<W, H, R>;
+	using Key = std::array<int8_t, W>;	// the number of tokens in each column
+	using Move = ::Move<W, H>;
+
 	static int KeyToLength(Key key)
 	{
 		int length = 0;
@@ -519,58 +558,84 @@ struct MNKGGravityConverter
 		return length;
 	}
 
-	template <int R>
-	static bool KeyIndexToPosition(Key key, int index, MNKGravity<W, H, R>& pos)
-	{
-		int length = KeyToLength(key);
-
-		pos = MNKGravity<W, H, R>();	// clear-out the content		
-
-		for (bool isX : combination::get_combination(length, length / 2, index))
-		{
-			//todo
-		}
-
-		return 0;
-	}
-
+	// X moves first, so it has the extra token of the odd lengths
 	static size_t KeyToSize(Key key)
 	{
-		int sum = 0;
-		for (int i = 0; i < W; i++)
-			sum += key[i];
-
-		//todo: calculate NK(sum, sum/2)
-		return 0;
+		int length = KeyToLength(key);
+		return nk(length, (length + 1) / 2);
 	}
 
-	static size_t PositionToIndex(const MNKGravity<W, H, R>& pos)
+	/// <summary>
+	/// The index is the combination of the Xs among the tokens, column by column from the bottom.
+	/// </summary>
+	static size_t PositionToIndex(const Position& pos)
 	{
-		//todo
-		return 0;
+		Key key = PositionToKey(pos);
+		int length = KeyToLength(key);
+		combination comb(length, (length + 1) / 2);
+		for (int x = 0; x < W; x++)
+		{
+			for (int y = 0; y < key[x]; y++)
+			{
+				if (pos(x, y) == Field::X)
+					comb.add_one();
+				else
+					comb.add_zero();
+			}
+		}
+		return comb.get_index();
 	}
 
-	static Key PositionToKey(const MNKGravity<W, H, R>& pos)
+	static Key PositionToKey(const Position& pos)
 	{
-		//todo
-		return Key();
+		Key key;
+		for (int x = 0; x < W; x++)
+		{
+			key[x] = 0;
+			while (key[x] < H && pos(x, key[x]) != Field::Empty)
+				key[x]++;
+		}
+		return key;
 	}
 
-	static bool KeyIndexToPosition(Key key, size_t index, MNKGravity<W, H, R>& pos)
+	/// <summary>
+	/// Returns false for the positions that can't be reached: both players have a row,
+	/// or the player to move has a row.
+	/// </summary>
+	static bool KeyIndexToPosition(Key key, size_t index, Position& pos)
 	{
-		//todo
-		return false;
+		int length = KeyToLength(key);
+		pos = Position();	// clear-out the content
+		int x = 0, y = 0;
+		for (bool isX : combination::get_combination(length, (length + 1) / 2, index))
+		{
+			while (y == key[x])
+			{
+				x++;
+				y = 0;
+			}
+			pos += Move{ SquareBase<W, H>(x, y++), isX ? Field::X : Field::O };
+		}
+		return pos.is_legal() && !pos.has_row(pos.turn() == Player::First ? Field::X : Field::O);
 	}
 
+	// A token more in any of the columns
 	static std::experimental::generator<Key> get_dependent_tables(Key key)
 	{
-		//todo
-		co_return;
+		for (int x = 0; x < W; x++)
+		{
+			if (key[x] == H)
+				continue;
+			Key next = key;
+			next[x]++;
+			co_yield next;
+		}
 	}
 
+	// The number of tokens tells the player to move
 	static Key get_opponent_table(Key key) { return key; }
 
-	static void flip_if_needed(MNKGravity<W, H, R>& pos)
+	static void flip_if_needed(Position& pos)
 	{
 		// Do nothing as no flip is needed.
 		// Flip is needed only for games like chess.
@@ -1,17 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <coroutine>
 #include <experimental/generator>
 #include <map>
+#include <memory>
 #include <ostream>
 #include <set>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include <iostream>
 #include <sstream>
 
 #include "..\core.h"
+#include "chess_nnue.h"
 
 namespace chess {
 
@@ -260,6 +267,15 @@ namespace chess {
             return ret;
         }
 
+        /// <summary>
+        /// The move may be undone later in the game: not a capture nor a pawn move.
+        /// The positions before it can't repeat after an irreversible one.
+        /// </summary>
+        bool is_reversible() const
+        {
+            return _captured == Piece::None && abs(_piece) != Piece::Pawn;
+        }
+
         int material_change()
         {
             int ret = 0;
@@ -292,6 +308,78 @@ namespace chess {
         Piece _promotion;
     };
 
+    /// <summary>
+    /// Pawn structure terms of a position, they depend only on the placement of the pawns.
+    /// </summary>
+    struct PawnEntry
+    {
+        uint64_t key = 0;               // pawn key, 0 for no pawns
+        int score = 0;                  // passed, isolated and doubled pawns in centipawns from the white side
+        uint64_t passed[2] = { 0, 0 };  // squares (bit y*8+x) of the passed pawns of white and black
+    };
+
+    /// <summary>
+    /// Cache of the pawn structures by the pawn key, the slot of a key is overwritten by a new one.
+    /// The pawns move rarely, so nearly all the lookups of a search hit.
+    /// </summary>
+    class PawnHashTable
+    {
+    public:
+        PawnHashTable() : PawnHashTable(size_t(1) << 14) {}
+
+        explicit PawnHashTable(size_t entries) :
+            entries(std::bit_floor(std::max<size_t>(entries, 1))),
+            mask(this->entries.size() - 1)
+        {
+        }
+
+        PawnEntry& slot(uint64_t key) { return entries[key & mask]; }
+
+        void clear()
+        {
+            std::fill(entries.begin(), entries.end(), PawnEntry());
+            hits = misses = 0;
+        }
+
+        size_t size() const { return entries.size(); }
+
+        size_t hits = 0;
+        size_t misses = 0;
+
+    private:
+        std::vector<PawnEntry> entries;
+        size_t mask;
+    };
+
+    /// <summary>
+    /// The six fields of a FEN, parsed and written without allocations.
+    /// </summary>
+    struct FenFields
+    {
+        static constexpr uint8_t white_short = 1, white_long = 2, black_short = 4, black_long = 8;
+
+        Piece board[64];                // by the squares, A1 first
+        Player turn = Player::First;
+        uint8_t castling = 0;           // the bits above
+        int en_passant = -1;            // the square behind the pawn, -1 for none
+        int halfmove = 0;
+        int fullmove = 1;
+
+        /// <summary>
+        /// Parses "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", the fields after the placement are optional.
+        /// Returns false if it isn't valid or a side hasn't exactly one king.
+        /// </summary>
+        bool parse(std::string_view fen);
+
+        /// <summary>
+        /// Writes the six fields and a terminating zero, at most fen_max_length chars.
+        /// Returns the length without the zero.
+        /// </summary>
+        size_t write(char* buffer) const;
+
+        static constexpr size_t fen_max_length = 112;
+    };
+
     class ChessPosition;
 
     class ConverterSimple;
@@ -299,11 +387,8 @@ namespace chess {
     class ChessPosition : public BoardBase<8, 8, Piece>
     {
         friend class ConverterSimple;
-        bool _track_pgn = false;
-        
-        bool construct_from_pgn(std::string pgn);
 
-        bool construct_from_fen(std::string fen);
+        bool construct_from_pgn(std::string pgn);
     public:
 		using Move = chess::Move;
         ChessPosition(bool only_kings = false)
@@ -353,10 +438,29 @@ namespace chess {
         {
             // If it is a FEN it has exactly 7 slashes
             if (std::count(pgn_or_fen.begin(), pgn_or_fen.end(), '/') == 7)
-                construct_from_fen(pgn_or_fen);
+                set_fen(pgn_or_fen);
             else
                 construct_from_pgn(pgn_or_fen);
         }
+
+        /// <summary>
+        /// Sets the position from a FEN, the position isn't changed if it isn't valid.
+        /// The castling rights and the en passant square are parsed but not kept, the position
+        /// allows castling while the king and the rook are on their initial squares.
+        /// </summary>
+        bool set_fen(std::string_view fen);
+        void set_fen(const FenFields& fields);
+
+        /// <summary>
+        /// The castling rights are given by the placement, the halfmove clock isn't tracked and is 0.
+        /// </summary>
+        FenFields fen_fields() const;
+
+        /// <summary>
+        /// Writes the FEN to a buffer of FenFields::fen_max_length chars, returns its length.
+        /// </summary>
+        size_t write_fen(char* buffer) const { return fen_fields().write(buffer); }
+
         std::string fen() const;
 
 #pragma endregion
@@ -369,23 +473,282 @@ namespace chess {
 
         int get_material() const;
 
-        bool track_material_on = false;
-		
 		void turn_on_material_tracking()
 		{
-			if (track_material_on)
-				return;
-
-            track_material_on = true;
-			tracked_material = get_material_full();
+            turn_on_tracking(material_tracking);
         }
 
         void turn_off_material_tracking()
         {
-			track_material_on = false;
+            trackings &= ~material_tracking;
         }
+#pragma endregion
 
-        int tracked_material = 0;
+#pragma region Piece-square tables
+        // Middlegame and endgame values of the white pieces in centipawns, including the material.
+        // Indexed by abs(piece) and the square, black uses the square flipped vertically. Index 0 is unused.
+        inline static int16_t pst_mg[7][64], pst_eg[7][64];
+
+        // Contribution of the pieces to the game phase, pst_max_phase in the initial position
+        inline static int pst_phase[7];
+        static constexpr int pst_max_phase = 24;
+
+        /// <summary>
+        /// Sets the default weights, once for all the threads.
+        /// With force they are set again, as load_pst not while other threads evaluate.
+        /// </summary>
+        static void initialize_pst(bool force = false);
+
+        /// <summary>
+        /// Loads the weights from a text file in the format written by save_pst.
+        /// Positions with the tracking turned on have to turn it off and on again.
+        /// </summary>
+        static bool load_pst(const std::string& path);
+
+        static bool save_pst(const std::string& path);
+
+        struct PstScore
+        {
+            int mg = 0;
+            int eg = 0;
+            int phase = 0;
+        };
+
+        void turn_on_pst_tracking()
+        {
+            initialize_pst();
+            turn_on_tracking(pst_tracking);
+        }
+
+        void turn_off_pst_tracking()
+        {
+            trackings &= ~pst_tracking;
+        }
+
+        PstScore get_pst_full() const;
+
+        PstScore get_pst() const
+        {
+            if (trackings & pst_tracking)
+                return tracked().pst;
+
+            return get_pst_full();
+        }
+
+        /// <summary>
+        /// Evaluation interpolated between the middlegame and the endgame by the game phase,
+        /// in centipawns from the white side.
+        /// </summary>
+        int pst_eval() const
+        {
+            PstScore score = get_pst();
+            int phase = std::min(score.phase, pst_max_phase);
+            return (score.mg * phase + score.eg * (pst_max_phase - phase)) / pst_max_phase;
+        }
+
+    private:
+        static void pst_add(PstScore& score, Piece piece, Square sq, int sign)
+        {
+            if (piece == Piece::None)
+                return;
+            int index = int8_t(abs(piece));
+            int i = belongs_to(piece, Player::First) ? int(sq) : (int(sq) ^ 56);
+            int color = belongs_to(piece, Player::First) ? sign : -sign;
+            score.mg += color * pst_mg[index][i];
+            score.eg += color * pst_eg[index][i];
+            score.phase += sign * pst_phase[index];
+        }
+
+        // The squares of the move, without the rook of castling
+        static void pst_update(PstScore& score, Move move)
+        {
+            pst_add(score, move.piece(), move.from(), -1);
+            pst_add(score, move.captured(), move.to(), -1);
+            pst_add(score, move.promotion() == Piece::None ? move.piece() : move.promotion(), move.to(), 1);
+        }
+
+    public:
+#pragma endregion
+
+#pragma region NNUE
+        // The network evaluating all the positions
+        inline static std::unique_ptr<nnue::Network> nnue_network;
+
+        /// <summary>
+        /// Loads the network from a file written by nnue::Network::save, keeps the previous one on failure.
+        /// Positions with the tracking turned on have to turn it off and on again.
+        /// </summary>
+        static bool load_nnue(const std::string& path);
+
+        static void set_nnue(std::unique_ptr<nnue::Network> network) { nnue_network = std::move(network); }
+
+        void turn_on_nnue_tracking()
+        {
+            DCHECK(nnue_network != nullptr);
+            turn_on_tracking(nnue_tracking);
+        }
+
+        void turn_off_nnue_tracking()
+        {
+            trackings &= ~nnue_tracking;
+        }
+
+        /// <summary>
+        /// Evaluation by the network in centipawns from the white side.
+        /// With the tracking on, the accumulators follow the moves and are refreshed only after the king moves,
+        /// otherwise they are computed from the whole board.
+        /// </summary>
+        int nnue_eval() const;
+
+    private:
+        int nnue_features(int perspective, int* features) const;
+
+        // The squares of the move, without the rook of castling, before the move is played
+        void nnue_update(const nnue::Accumulator& from, nnue::Accumulator& to, Move move) const;
+
+        void nnue_move_rook(nnue::Accumulator& accumulator, Piece rook, Square from, Square to) const;
+
+    public:
+#pragma endregion
+
+#pragma region Tracked values
+        /// <summary>
+        /// The values tracked along the moves, kept apart from the position so it stays small and cheap to copy.
+        /// Each thread keeps them in a ring by the ply: a move writes the entry of the next ply from the entry
+        /// of its ply and taking it back writes nothing, the entry of the previous ply is still there.
+        /// Each entry written gets a new stamp kept by its position, the copies playing other moves from the same
+        /// position write other stamps and never read the values of each other.
+        /// </summary>
+        struct TrackedState
+        {
+            uint64_t stamp = ~0ull; // of the position the values are for, none before the entry is written
+            uint64_t parent = 0;    // stamp of the entry the move was played from, 0 after a refresh
+            uint8_t trackings = 0;  // the values set
+            int material = 0;
+            PstScore pst;
+            nnue::Accumulator accumulator;
+        };
+
+        static constexpr uint8_t material_tracking = 1, pst_tracking = 2, nnue_tracking = 4;
+
+        // The trackings turned on
+        uint8_t trackings = 0;
+
+        // More than the plies of a search, the entries overwritten since are refreshed from the board
+        static constexpr int tracked_plies = 256;
+
+    private:
+        // The stamp of the entry of the position, 0 for none
+        mutable uint64_t tracked_stamp = 0;
+
+        // Each thread takes the stamps from blocks of its own, so they are unique in all the threads
+        static constexpr uint64_t stamp_block = 1 << 20;
+        inline static std::atomic<uint64_t> next_stamp_block = stamp_block;
+        inline static thread_local uint64_t next_stamp = 0;
+
+        static uint64_t new_stamp()
+        {
+            if ((next_stamp & (stamp_block - 1)) == 0)
+                next_stamp = next_stamp_block.fetch_add(stamp_block, std::memory_order_relaxed);
+            return next_stamp++;
+        }
+
+        // Each thread has its own ring, a position copied to another thread refreshes its values there
+        static thread_local std::vector<TrackedState> tracked_states;
+
+        void turn_on_tracking(uint8_t tracking)
+        {
+            if (trackings & tracking)
+                return;
+
+            trackings |= tracking;
+            refresh_tracked(tracked_states[_ply & (tracked_plies - 1)]);
+        }
+
+        // The values of the position, refreshed if the entry of its ply was written by another position
+        TrackedState& tracked() const
+        {
+            TrackedState& state = tracked_states[_ply & (tracked_plies - 1)];
+            if (state.stamp != tracked_stamp || (state.trackings & trackings) != trackings)
+                refresh_tracked(state);
+            return state;
+        }
+
+        void refresh_tracked(TrackedState& state) const;
+
+        // Writes the entry of the next ply before the move is played
+        TrackedState& track_move(Move move) const;
+
+    public:
+#pragma endregion
+
+#pragma region Pawn structure
+        /// <summary>
+        /// Zobrist key of the pawns only, made of the keys of the pawns in hash_white and hash_black.
+        /// </summary>
+        uint64_t get_pawn_key_full() const;
+
+        uint64_t get_pawn_key() const
+        {
+            if (track_pawns_on)
+                return tracked_pawn_key;
+
+            return get_pawn_key_full();
+        }
+
+        uint64_t tracked_pawn_key = 0;
+
+        bool track_pawns_on = false;
+
+        void turn_on_pawn_tracking()
+        {
+            if (track_pawns_on)
+                return;
+
+            track_pawns_on = true;
+            tracked_pawn_key = get_pawn_key_full();
+        }
+
+        void turn_off_pawn_tracking()
+        {
+            track_pawns_on = false;
+        }
+
+        // Each thread has its own table
+        inline static thread_local PawnHashTable pawn_table;
+
+        /// <summary>
+        /// Evaluates the pawn structure, without the table.
+        /// </summary>
+        PawnEntry pawn_structure_full() const;
+
+        /// <summary>
+        /// The pawn structure from the table of the thread, evaluated on a miss.
+        /// </summary>
+        PawnEntry pawn_structure() const;
+
+        int pawn_eval() const { return pawn_structure().score; }
+
+        uint64_t passed_pawns(Player player) const { return pawn_structure().passed[player == Player::First ? 0 : 1]; }
+
+    private:
+        void pawn_key_toggle(Piece piece, Square sq)
+        {
+            if (piece == Piece::Pawn)
+                tracked_pawn_key ^= hash_white[sq][int8_t(Piece::Pawn)];
+            else if (piece == Piece::OtherPawn)
+                tracked_pawn_key ^= hash_black[sq][int8_t(Piece::Pawn)];
+        }
+
+        // Its own inverse, for both += and -=
+        void pawn_key_update(Move move)
+        {
+            pawn_key_toggle(move.piece(), move.from());
+            pawn_key_toggle(move.captured(), move.to());
+            pawn_key_toggle(move.promotion() == Piece::None ? move.piece() : move.promotion(), move.to());
+        }
+
+    public:
 #pragma endregion
 
         // Increments for each white piece and
@@ -406,7 +769,10 @@ namespace chess {
             int king_protection = 0, // count pieces around the king
             //int coverage = 0, // count squares controlled by white - black
             int legal_moves = 0, // number of legal moves
-            int control_center = 0 // number of pieces in the center
+            int control_center = 0, // number of pieces in the center
+            int pst = 0, // tapered piece-square tables in centipawns, use with material = 100
+            int neural = 0, // NNUE in centipawns, use with material = 100 or alone
+            int pawns = 0 // pawn structure in centipawns, use with material = 100
         >
         int evaluate() const
         {
@@ -417,6 +783,9 @@ namespace chess {
             //if const (coverage)ret += coverage * coverage_evaluate();
             if constexpr (legal_moves > 0) ret += legal_moves * count_all_legal_moves() * int(turn());
             if constexpr (control_center > 0) ret += control_center * count_center_pieces();
+            if constexpr (pst > 0) ret += pst * pst_eval();
+            if constexpr (neural > 0) ret += neural * nnue_eval();
+            if constexpr (pawns > 0) ret += pawns * pawn_eval();
             return ret;
         }
         #pragma endregion
@@ -436,27 +805,24 @@ namespace chess {
         }
 
 #pragma region PGN
-        void track_pgn() { _track_pgn = true;  }
-
         bool rook_move(Square sq1, Square sq2) const;
         bool bishop_move(Square sq1, Square sq2) const;
         bool queen_move(Square sq1, Square sq2) const;
 
-        std::string pgn() const;
-
-        std::vector<std::string> pgns;
-
+        // The values are computed from the board, for the searches not evaluating by them
         void turn_off_all_trackings()
 		{
-			_track_pgn = false;
+            trackings = 0;
+            track_pawns_on = false;
 		}
 
         std::string move_to_pgn(Move move) const;
 
-        template <Piece abs_piece>
-        Move _pgn_to_move(Square sq_to, SquareRequirements req = SquareRequirements("")) const;
-
-        Move pgn_to_move(std::string str) const;
+        /// <summary>
+        /// Parses a move in the standard algebraic notation, e.g. "e4", "Nbd7", "exd5", "R1xe5+", "e8=Q#" or "O-O".
+        /// Returns invalid move if it isn't a single legal move.
+        /// </summary>
+        Move pgn_to_move(std::string_view str) const;
 #pragma endregion
         
         void invert()
@@ -498,12 +864,28 @@ namespace chess {
             return true;
         }
 
-        bool is_reverse_legal(Move move) const { return square(move.from()) == Piece::None && square(move.to()) != Piece::None; }
+        /// <summary>
+        /// The move of the player not to move leads to this position from a legal one: the piece (or the promotion)
+        /// stands on the target, the origin and the squares in between are empty, the player who moved isn't in check
+        /// and the player to move wasn't in check before the move. The captured piece, if any, is put back.
+        /// A castling is undone if it was legal before it, as the castling rights aren't tracked.
+        /// </summary>
+        bool is_reverse_legal(Move move) const;
+
+        /// <summary>
+        /// The moves of the player not to move leading to this position, undo them by -= to get the predecessors.
+        /// Without uncapture the moves capture nothing, otherwise they all put back a piece of that kind
+        /// (of the player to move). The promotions are undone only with unpromotions, the predecessors then
+        /// have another material as with the captures. Castling is undone without a capture, en passant is not generated.
+        /// </summary>
+        std::experimental::generator<Move> all_reverse_moves(Piece uncapture = Piece::None, bool unpromotions = false) const;
+
 
         Piece operator[](Square square) const { return table[square]; }
 
 #pragma region Move handling
-        bool castle_rook(Piece king_piece, chess::Square king, Piece rook_piece, chess::Square rook1, chess::Square rook2)
+        // The tracked values of the move are updated in next, nullptr when the move is taken back
+        bool castle_rook(Piece king_piece, chess::Square king, Piece rook_piece, chess::Square rook1, chess::Square rook2, TrackedState* next)
         {
             if (square(king) == king_piece)
             {
@@ -511,6 +893,13 @@ namespace chess {
                 DCHECK(square(rook2) == chess::Piece::None);
                 square(rook1) = chess::Piece::None;
                 square(rook2) = rook_piece;
+                if (next != nullptr && (trackings & pst_tracking))
+                {
+                    pst_add(next->pst, rook_piece, rook1, -1);
+                    pst_add(next->pst, rook_piece, rook2, 1);
+                }
+                if (next != nullptr && (trackings & nnue_tracking))
+                    nnue_move_rook(next->accumulator, rook_piece, rook1, rook2);
                 return true;
             }
             return false;
@@ -630,6 +1019,19 @@ namespace chess {
 
         bool is_controlled_by(Square start, Player player) const;
 
+        /// <summary>
+        /// Static exchange evaluation: the material (piece_to_value) the moving side wins by the capture,
+        /// when both sides keep recapturing on the target square with their least valuable piece
+        /// and may stop at any time. Sliders behind the capturing pieces (x-rays) join the exchange.
+        /// Pins are ignored. Cheap enough for move ordering and pruning, no move is played.
+        /// </summary>
+        int see(Move move) const;
+
+        /// <summary>
+        /// The capture doesn't lose material by the static exchange evaluation.
+        /// </summary>
+        bool good_capture(Move move) const { return see(move) >= 0; }
+
         constexpr bool easycheck_winning_move(Move move) const
         {
             return false;
@@ -732,7 +1134,11 @@ namespace chess {
 
 
 #pragma region Transpositional tables
-        inline static uint64_t hash_white[64][6], hash_black[64][6], hash_turn;
+        // Indexed by the square and abs(piece), index 0 is unused
+        inline static uint64_t hash_white[64][7], hash_black[64][7], hash_turn;
+
+        // Seed of the keys, persisted transposition tables are valid only for the same seed
+        static constexpr uint64_t zobrist_seed = 0;
 
         inline static bool transposition_tables_initialized = false;
 
@@ -767,6 +1173,69 @@ namespace chess {
     private:
         Square King1, King2;
     };
+
+    // Copied by memcpy, e.g. for copy-make search and for cloning per thread
+    static_assert(std::is_trivially_copyable_v<ChessPosition>);
+    static_assert(sizeof(ChessPosition) <= 104);
+
+    inline thread_local std::vector<ChessPosition::TrackedState> ChessPosition::tracked_states(ChessPosition::tracked_plies);
+
+    /// <summary>
+    /// A game from a start position: its moves in order and their standard algebraic notation.
+    /// Kept apart from ChessPosition, so the position stays trivially copyable.
+    /// </summary>
+    class GameRecord
+    {
+    public:
+        GameRecord(const ChessPosition& start = ChessPosition()) : current(start) {}
+
+        const ChessPosition& position() const { return current; }
+
+        // For turning the trackings on, the moves have to be played by play
+        ChessPosition& position() { return current; }
+
+        void play(Move move)
+        {
+            sans.push_back(current.move_to_pgn(move));
+            keys.push_back(current.get_hash<true>());
+            _moves.push_back(move);
+            current += move;
+        }
+
+        void undo()
+        {
+            DCHECK(!_moves.empty());
+            current -= _moves.back();
+            _moves.pop_back();
+            keys.pop_back();
+            sans.pop_back();
+        }
+
+        const std::vector<Move>& moves() const { return _moves; }
+
+        /// <summary>
+        /// The moves in the PGN format, e.g. "1. e4 e5 2. Nf3 ".
+        /// </summary>
+        std::string pgn() const;
+
+        /// <summary>
+        /// The keys of the positions before the current one which may repeat, the oldest first,
+        /// as the history of MinMax::FindBestMove.
+        /// </summary>
+        std::vector<uint64_t> history() const
+        {
+            size_t first = _moves.size();
+            while (first > 0 && _moves[first - 1].is_reversible())
+                first--;
+            return std::vector<uint64_t>(keys.begin() + first, keys.end());
+        }
+
+    private:
+        ChessPosition current;
+        std::vector<Move> _moves;
+        std::vector<uint64_t> keys;    // of the positions before the moves
+        std::vector<std::string> sans;
+    };
 }
 
 static std::ostream& operator<<(std::ostream& os, const chess::ChessPosition& position)
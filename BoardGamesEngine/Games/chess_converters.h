@@ -1,9 +1,15 @@
+#pragma once
+#include <algorithm>
+#include <string_view>
+#include <utility>
 #include "chess.h"
 
 namespace chess
 {
     /// <summary>
-    /// 64^n
+    /// 64^n, a square per piece of the key. The pieces of the player to move come first in the order KQRBNP,
+    /// e.g. "KQK" is the king and the queen to move against the king. The positions with the second player
+    /// to move are seen flipped, with the colors swapped and the rows mirrored, so a table serves both colors.
     /// </summary>
     class ConverterSimple
     {
@@ -12,19 +18,28 @@ namespace chess
         using Move = chess::Move;
         using Key = std::string;
         static std::string name() { return "ConverterSimple"; }
+        static constexpr std::string_view piece_order = "KQRBNP";
+
         static SIZE KeyToSize(std::string key)
         {
             return (SIZE)(1) << (6 * key.length());
         }
 
+        /// <summary>
+        /// The tables after a capture or a promotion, the kings stay.
+        /// </summary>
         static std::experimental::generator<std::string> get_dependent_tables(std::string key)
         {
-            if (key == "KK")
-                co_return;
-
-            for (int i = 0; i < key.size(); i++)
+            for (size_t i = 0; i < key.size(); i++)
             {
+                if (key[i] == 'K')
+                    continue;
                 co_yield key.substr(0, i) + key.substr(i + 1);
+                if (key[i] == 'P')
+                {
+                    for (char piece : piece_order.substr(1, 4))
+                        co_yield sort_key(key.substr(0, i) + piece + key.substr(i + 1));
+                }
             }
         }
 
@@ -39,44 +54,119 @@ namespace chess
 
         static SIZE PositionToIndex(const ChessPosition& position)
         {
+            return PositionToKeyIndex(position).second;
+        }
+
+        /// <summary>
+        /// The key and the index by a single pass over the board, the lookups of the retrograde solver need both.
+        /// The same pieces are indexed by their ascending squares, from the side of the player to move.
+        /// </summary>
+        static std::pair<std::string, SIZE> PositionToKeyIndex(const ChessPosition& position)
+        {
+            int squares[2][6][10];
+            int counts[2][6] = {};
+            int flip = position.turn() == Player::First ? 0 : 56;
+            for (int sq = 0; sq < 64; sq++)
+            {
+                Piece piece = position[Square(sq ^ flip)];
+                if (piece == Piece::None)
+                    continue;
+                int side = belongs_to(piece, position.turn()) ? 0 : 1;
+                int type = piece_index(piece);
+                squares[side][type][counts[side][type]++] = sq;
+            }
+
+            std::pair<std::string, SIZE> ret;
             SIZE factor = 1;
-            SIZE ret = 0;
-            for (auto pair : position.get_piece_squares())
+            for (int side = 0; side < 2; side++)
             {
-                ret += pair.second * factor;
-                factor *= 64;
+                for (int type = 0; type < 6; type++)
+                {
+                    ret.first.append(counts[side][type], piece_order[type]);
+                    for (int i = 0; i < counts[side][type]; i++)
+                    {
+                        ret.second += squares[side][type][i] * factor;
+                        factor *= 64;
+                    }
+                }
             }
             return ret;
         }
 
+        /// <summary>
+        /// Returns false for the indices of no position: two pieces on a square, the same pieces
+        /// not in the ascending order of their squares, pawns on the first or last row, the kings side by side
+        /// or the opponent in check.
+        /// </summary>
         static bool KeyIndexToPosition(std::string key, SIZE index, ChessPosition& pos)
         {
-            //TODO: finish implementation
-            SIZE factor = 1;
-            for (int i = 0; i < key.size(); i++)
+            FenFields fields;
+            std::fill(std::begin(fields.board), std::end(fields.board), Piece::None);
+            uint64_t occupied = 0;
+            bool second = false;
+            int previous = -1, kings[2] = {};
+            for (size_t i = 0; i < key.size(); i++)
             {
-                //pos.table[index % 64] = char_to_piece(key[i]);
-                //index /= 64;
+                second |= i > 0 && key[i] == 'K';
+                int sq = int(index % 64);
+                index /= 64;
+                if (occupied & (uint64_t(1) << sq))
+                    return false;
+                if (i > 0 && key[i] != 'K' && key[i] == key[i - 1] && sq < previous)
+                    return false;
+                if (key[i] == 'P' && (sq < 8 || sq >= 56))
+                    return false;
+                occupied |= uint64_t(1) << sq;
+                previous = sq;
+                if (key[i] == 'K')
+                    kings[second] = sq;
+                Piece piece = char_to_piece(key[i]);
+                fields.board[sq] = second ? other(piece) : piece;
             }
-            return false;
-            //return pos.is_legal();
+            if (Square(kings[0]).king_distance(Square(kings[1])) < 2)
+                return false;
+            fields.turn = Player::First;
+            pos.set_fen(fields);
+            return !pos.is_checked(Player::Second);
         }
 
         static std::string PositionToKey(const ChessPosition& position)
         {
-            std::string key;
-            for (auto pair : position.get_piece_squares())
-            {
-                key += pair.first;
-            }
-            return key;
+            return PositionToKeyIndex(position).first;
         }
 
+        /// <summary>
+        /// The first player to move, the colors swapped and the rows mirrored if needed.
+        /// The key and the index don't change.
+        /// </summary>
         static void flip_if_needed(ChessPosition& pos)
         {
-            //todo: implement
+            if (pos.turn() == Player::First)
+                return;
+            FenFields fields = pos.fen_fields();
+            FenFields flipped;
+            for (int sq = 0; sq < 64; sq++)
+                flipped.board[sq] = fields.board[sq ^ 56] == Piece::None ? Piece::None : other(fields.board[sq ^ 56]);
+            flipped.turn = Player::First;
+            pos.set_fen(flipped);
+        }
+
+        // The place of the piece in piece_order, of either color
+        static int piece_index(Piece piece)
+        {
+            return int(abs(piece)) - 1;
         }
 
+        // The pieces of each side in the order KQRBNP
+        static std::string sort_key(std::string key)
+        {
+            size_t second_king = key.find('K', 1);
+            DCHECK(second_king != std::string::npos);
+            auto by_order = [](char a, char b) { return piece_order.find(a) < piece_order.find(b); };
+            std::sort(key.begin(), key.begin() + second_king, by_order);
+            std::sort(key.begin() + second_king, key.end(), by_order);
+            return key;
+        }
     };
 
     /// <summary>
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "chess_epd.h"
+#include "..\MemoryMappedFile.h"
+
+using namespace chess;
+
+namespace
+{
+    std::string_view trim(std::string_view text)
+    {
+        size_t begin = text.find_first_not_of(" \t\r\n");
+        if (begin == std::string_view::npos)
+            return std::string_view();
+        size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(begin, end + 1 - begin);
+    }
+
+    // Splits at the spaces, the quoted operands are kept whole
+    std::vector<std::string_view> split_operands(std::string_view text)
+    {
+        std::vector<std::string_view> ret;
+        size_t i = 0;
+        while (i < text.size())
+        {
+            if (text[i] == ' ' || text[i] == '\t')
+            {
+                i++;
+                continue;
+            }
+            size_t begin = i;
+            if (text[i] == '"')
+            {
+                size_t end = text.find('"', i + 1);
+                i = end == std::string_view::npos ? text.size() : end + 1;
+                ret.push_back(text.substr(begin + 1, i - begin - 2));
+                continue;
+            }
+            while (i < text.size() && text[i] != ' ' && text[i] != '\t')
+                i++;
+            ret.push_back(text.substr(begin, i - begin));
+        }
+        return ret;
+    }
+}
+
+bool EpdEntry::parse(std::string_view line)
+{
+    // The first four fields of a FEN, then the operations
+    size_t end = 0;
+    for (int field = 0; field < 4; field++)
+    {
+        end = line.find_first_not_of(" \t", end);
+        if (end == std::string_view::npos)
+            return false;
+        end = line.find_first_of(" \t", end);
+        if (end == std::string_view::npos)
+            end = line.size();
+    }
+    if (!position.set_fen(line.substr(0, end)))
+        return false;
+
+    best.clear();
+    avoid.clear();
+    id.clear();
+    std::string_view operations = line.substr(end);
+    while (!operations.empty())
+    {
+        // The semicolons inside the quotes don't end the operation
+        size_t semicolon = 0;
+        bool quoted = false;
+        while (semicolon < operations.size() && (quoted || operations[semicolon] != ';'))
+        {
+            if (operations[semicolon] == '"')
+                quoted = !quoted;
+            semicolon++;
+        }
+        std::vector<std::string_view> operands = split_operands(trim(operations.substr(0, semicolon)));
+        operations.remove_prefix(std::min(semicolon + 1, operations.size()));
+        if (operands.empty())
+            continue;
+
+        std::string_view opcode = operands[0];
+        if (opcode == "bm" || opcode == "am")
+        {
+            for (size_t i = 1; i < operands.size(); i++)
+            {
+                Move move = position.pgn_to_move(operands[i]);
+                if (!move.is_valid())
+                    return false;
+                (opcode == "bm" ? best : avoid).push_back(move);
+            }
+        }
+        else if (opcode == "id" && operands.size() > 1)
+        {
+            id = std::string(operands[1]);
+        }
+    }
+    return !best.empty() || !avoid.empty();
+}
+
+bool EpdEntry::solved_by(Move move) const
+{
+    if (!best.empty() && std::find(best.begin(), best.end(), move) == best.end())
+        return false;
+    return std::find(avoid.begin(), avoid.end(), move) == avoid.end();
+}
+
+double EpdReport::percentile(double percent) const
+{
+    std::vector<double> times;
+    for (const EpdResult& result : results)
+    {
+        if (result.solved)
+            times.push_back(result.time_to_solution);
+    }
+    if (times.empty())
+        return -1;
+
+    // The nearest rank
+    std::sort(times.begin(), times.end());
+    size_t rank = size_t(std::ceil(percent / 100 * times.size()));
+    return times[std::clamp<size_t>(rank, 1, times.size()) - 1];
+}
+
+std::vector<EpdEntry> EpdRunner::parse(std::string_view text, size_t& invalid)
+{
+    std::vector<EpdEntry> ret;
+    invalid = 0;
+    while (!text.empty())
+    {
+        size_t end = text.find('\n');
+        std::string_view line = trim(text.substr(0, end));
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        EpdEntry entry;
+        if (entry.parse(line))
+            ret.push_back(std::move(entry));
+        else
+            invalid++;
+    }
+    return ret;
+}
+
+std::vector<EpdEntry> EpdRunner::load(const std::string& path, size_t& invalid)
+{
+    invalid = 0;
+    MemoryMappedFile file;
+    if (!file.open_read(path))
+        return {};
+    return parse(std::string_view(reinterpret_cast<const char*>(file.data()), file.size()), invalid);
+}
+
+EpdResult EpdRunner::search(const EpdEntry& entry, const EpdOptions& options, const EvalFunction& eval)
+{
+    DCHECK(options.depth % 2 == 0 && options.depth >= 0);
+    DCHECK(options.depth > 0 || options.seconds > 0);
+    EpdResult result;
+    ChessPosition position = entry.position;
+    position.turn_on_material_tracking();
+    position.turn_on_pst_tracking();
+    auto counting_eval = [&](ChessPosition& pos) -> EvalValue::payload_t
+    {
+        result.nodes++;
+        return eval(pos);
+    };
+
+    // The time limit stops the search inside an iteration, the first one is always finished
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.seconds));
+    int last_depth = options.depth == 0 ? EvalValue::max_plys : options.depth;
+    for (int depth = 2; depth <= last_depth; depth += 2)
+    {
+        if (options.seconds > 0 && depth > 2)
+        {
+            std::optional<Move> move = MinMax<ChessPosition>::FindBestMoveUntil(position, depth, deadline, counting_eval);
+            if (!move)
+            {
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                break;
+            }
+            result.move = *move;
+        }
+        else
+        {
+            result.move = MinMax<ChessPosition>::FindBestMove(position, depth, counting_eval);
+        }
+        result.depth = depth;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        bool solved = entry.solved_by(result.move);
+        if (solved && !result.solved)
+            result.time_to_solution = result.seconds;
+        result.solved = solved;
+        if (!solved)
+            result.time_to_solution = -1;
+
+        if (options.seconds > 0 && result.seconds >= options.seconds)
+            break;
+    }
+    return result;
+}
+
+EpdReport EpdRunner::run(const std::vector<EpdEntry>& suite, const EpdOptions& options, EvalFunction eval)
+{
+    EpdReport report;
+    report.results.resize(suite.size());
+    auto start = std::chrono::steady_clock::now();
+
+    std::atomic<size_t> next = 0;
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < suite.size(); i = next++)
+            report.results[i] = search(suite[i], options, eval);
+    };
+    int threads = std::max(1, std::min(options.threads, int(suite.size())));
+    if (threads == 1)
+    {
+        worker();
+    }
+    else
+    {
+        std::vector<std::thread> pool;
+        for (int i = 0; i < threads; i++)
+            pool.emplace_back(worker);
+        for (auto& thread : pool)
+            thread.join();
+    }
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const EpdResult& result : report.results)
+    {
+        report.nodes += result.nodes;
+        if (result.solved)
+            report.solved++;
+    }
+    if (report.seconds > 0)
+        report.nodes_per_second = report.nodes / report.seconds;
+    return report;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "chess.h"
+#include "..\Algorithms.h"
+
+namespace chess
+{
+    /// <summary>
+    /// A position of a test suite with its operations, e.g. "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - bm Qg6; id \"WAC.001\";".
+    /// </summary>
+    struct EpdEntry
+    {
+        ChessPosition position;
+        std::vector<Move> best;     // bm, any of them solves the position
+        std::vector<Move> avoid;    // am, none of them may be played
+        std::string id;
+
+        /// <summary>
+        /// Returns false if the position or a move isn't valid, or there is neither bm nor am.
+        /// The other operations are skipped.
+        /// </summary>
+        bool parse(std::string_view line);
+
+        bool solved_by(Move move) const;
+    };
+
+    struct EpdOptions
+    {
+        int depth = 4;          // the last depth of the iterative deepening, even, 0 for none with a time limit
+        double seconds = 0;     // the search stops at this time, 0 for the fixed depth
+        int threads = 1;
+    };
+
+    struct EpdResult
+    {
+        Move move;
+        bool solved = false;
+        double time_to_solution = -1;   // since the iteration that found the solution and kept it, -1 if unsolved
+        int depth = 0;                  // of the last finished iteration
+        size_t nodes = 0;               // the evaluated leaves
+        double seconds = 0;
+    };
+
+    struct EpdReport
+    {
+        std::vector<EpdResult> results;     // in the order of the suite
+        size_t solved = 0;
+        size_t nodes = 0;
+        double seconds = 0;                 // wall clock of the whole run
+        double nodes_per_second = 0;
+
+        /// <summary>
+        /// The time to solution at the percentile (0-100) of the solved positions, -1 if none is solved.
+        /// </summary>
+        double percentile(double percent) const;
+    };
+
+    /// <summary>
+    /// Runs the EPD test suites: each position is searched by MinMax with iterative deepening,
+    /// the positions are distributed to the threads.
+    /// </summary>
+    class EpdRunner
+    {
+    public:
+        using EvalFunction = std::function<EvalValue::payload_t(ChessPosition&)>;
+
+        /// <summary>
+        /// An entry per valid line, the empty lines and the comments starting by '#' are skipped.
+        /// </summary>
+        static std::vector<EpdEntry> parse(std::string_view text, size_t& invalid);
+        static std::vector<EpdEntry> load(const std::string& path, size_t& invalid);
+
+        static EpdReport run(const std::vector<EpdEntry>& suite, const EpdOptions& options, EvalFunction eval = default_eval);
+
+        static EpdResult search(const EpdEntry& entry, const EpdOptions& options, const EvalFunction& eval);
+
+        // Material and piece-square tables in centipawns
+        static EvalValue::payload_t default_eval(ChessPosition& position)
+        {
+            return position.evaluate<100, 0, 0, 0, 1>();
+        }
+    };
+}
@@ -15,8 +15,8 @@ int ChessPosition::get_material_full() const
 
 int ChessPosition::get_material() const
 {
-    if (track_material_on)
-        return tracked_material;
+    if (trackings & material_tracking)
+        return tracked().material;
 
     return get_material_full();
 }
@@ -1,67 +1,232 @@
+#include <charconv>
 #include "chess.h"
 
 using namespace chess;
 
-std::string ChessPosition::fen() const
+namespace
 {
-    auto nonConstThis = const_cast<ChessPosition*>(this);
-
-    nonConstThis->flip_rows();
-    Square sq(0);
-    std::string fen;
-    do
+    // The piece of a FEN letter, None for the other chars
+    Piece fen_piece(char c)
     {
-        if (table[sq] != Piece::None)
+        switch (c)
         {
-            fen += Piece_to_char(table[sq]);
+        case 'K': case 'Q': case 'R': case 'B': case 'N': case 'P':
+        case 'k': case 'q': case 'r': case 'b': case 'n': case 'p':
+            return char_to_piece(c);
+        default:
+            return Piece::None;
         }
-        else
+    }
+
+    // The next field separated by spaces, empty at the end
+    std::string_view next_field(std::string_view& fen)
+    {
+        size_t begin = fen.find_first_not_of(" \t\r\n");
+        if (begin == std::string_view::npos)
         {
-            if (fen.length() > 0 && '1' <= fen.back() && fen.back() <= '7')
-                fen.back()++;
-            else
-                fen += '1';
+            fen = std::string_view();
+            return fen;
         }
+        size_t end = fen.find_first_of(" \t\r\n", begin);
+        if (end == std::string_view::npos)
+            end = fen.size();
+        std::string_view field = fen.substr(begin, end - begin);
+        fen.remove_prefix(end);
+        return field;
+    }
 
-        if (sq.x() == 7)
-            fen += '/';
-    } while (++sq);
-    nonConstThis->flip_rows();
-    //TODO: implement ends, for example " b "
-    std::string extra = this->turn() == Player::First ? " w" : " b";
-
-    return fen.substr(0, fen.length() - 1) /* + extra*/;
+    bool parse_number(std::string_view field, int& value)
+    {
+        auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+        return error == std::errc() && end == field.data() + field.size() && value >= 0;
+    }
 }
 
-bool ChessPosition::construct_from_fen(std::string fen)
+bool FenFields::parse(std::string_view fen)
 {
-    Square sq(0);
-    for (char c : fen)
+    // The placement from the 8th rank
+    std::string_view placement = next_field(fen);
+    int x = 0, y = 7, kings[2] = { 0, 0 };
+    for (char c : placement)
     {
         if (c == '/')
+        {
+            if (x != 8 || y == 0)
+                return false;
+            x = 0;
+            y--;
             continue;
-
+        }
         if (c >= '1' && c <= '8')
         {
-            int count = c - '0';
-            for (int i = 0; i < count; i++)
+            if (x + (c - '0') > 8)
+                return false;
+            for (int i = 0; i < c - '0'; i++)
+                board[y * 8 + x++] = Piece::None;
+            continue;
+        }
+        Piece piece = fen_piece(c);
+        if (piece == Piece::None || x == 8)
+            return false;
+        if (abs(piece) == Piece::King)
+            kings[piece == Piece::King ? 0 : 1]++;
+        board[y * 8 + x++] = piece;
+    }
+    if (x != 8 || y != 0 || kings[0] != 1 || kings[1] != 1)
+        return false;
+
+    std::string_view field = next_field(fen);
+    turn = Player::First;
+    if (!field.empty())
+    {
+        if (field != "w" && field != "b")
+            return false;
+        turn = field == "w" ? Player::First : Player::Second;
+    }
+
+    field = next_field(fen);
+    castling = 0;
+    if (!field.empty() && field != "-")
+    {
+        for (char c : field)
+        {
+            switch (c)
             {
-                table[sq] = Piece::None;
-                ++sq;
+            case 'K': castling |= white_short; break;
+            case 'Q': castling |= white_long; break;
+            case 'k': castling |= black_short; break;
+            case 'q': castling |= black_long; break;
+            default: return false;
             }
-            continue;
         }
-        char upper_c = toupper(c);
-        Piece piece = char_to_piece(upper_c);
-        if (upper_c != c)
-            piece = other(piece);
+    }
 
-        if (c == 'K') King1 = sq;
-        if (c == 'k') King2 = sq;
+    field = next_field(fen);
+    en_passant = -1;
+    if (!field.empty() && field != "-")
+    {
+        if (field.size() != 2 || field[0] < 'a' || field[0] > 'h' || (field[1] != '3' && field[1] != '6'))
+            return false;
+        en_passant = (field[1] - '1') * 8 + (field[0] - 'a');
+    }
+
+    field = next_field(fen);
+    halfmove = 0;
+    if (!field.empty() && !parse_number(field, halfmove))
+        return false;
 
-        table[sq] = piece;
-        ++sq;
+    field = next_field(fen);
+    fullmove = 1;
+    if (!field.empty() && (!parse_number(field, fullmove) || fullmove == 0))
+        return false;
+
+    return next_field(fen).empty();
+}
+
+size_t FenFields::write(char* buffer) const
+{
+    char* out = buffer;
+    for (int y = 7; y >= 0; y--)
+    {
+        int empty = 0;
+        for (int x = 0; x < 8; x++)
+        {
+            Piece piece = board[y * 8 + x];
+            if (piece == Piece::None)
+            {
+                empty++;
+                continue;
+            }
+            if (empty > 0)
+                *out++ = char('0' + empty);
+            empty = 0;
+            *out++ = Piece_to_char(piece);
+        }
+        if (empty > 0)
+            *out++ = char('0' + empty);
+        if (y > 0)
+            *out++ = '/';
     }
-    this->flip_rows();
+
+    *out++ = ' ';
+    *out++ = turn == Player::First ? 'w' : 'b';
+    *out++ = ' ';
+    if (castling == 0)
+        *out++ = '-';
+    if (castling & white_short) *out++ = 'K';
+    if (castling & white_long) *out++ = 'Q';
+    if (castling & black_short) *out++ = 'k';
+    if (castling & black_long) *out++ = 'q';
+    *out++ = ' ';
+    if (en_passant < 0)
+    {
+        *out++ = '-';
+    }
+    else
+    {
+        *out++ = char('a' + en_passant % 8);
+        *out++ = char('1' + en_passant / 8);
+    }
+    *out++ = ' ';
+    out = std::to_chars(out, buffer + fen_max_length, halfmove).ptr;
+    *out++ = ' ';
+    out = std::to_chars(out, buffer + fen_max_length, fullmove).ptr;
+    *out = 0;
+    return size_t(out - buffer);
+}
+
+bool ChessPosition::set_fen(std::string_view fen)
+{
+    FenFields fields;
+    if (!fields.parse(fen))
+        return false;
+    set_fen(fields);
     return true;
 }
+
+void ChessPosition::set_fen(const FenFields& fields)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        table[i] = fields.board[i];
+        if (table[i] == Piece::King) King1 = Square(i);
+        if (table[i] == Piece::OtherKing) King2 = Square(i);
+    }
+    _ply = 2 * (fields.fullmove - 1) + (fields.turn == Player::Second ? 1 : 0);
+    if (turn() != fields.turn)
+        BoardBase::invert();
+
+    // The tracked values follow the new board
+    if (trackings != 0)
+        refresh_tracked(tracked_states[_ply & (tracked_plies - 1)]);
+    if (track_pawns_on)
+        tracked_pawn_key = get_pawn_key_full();
+}
+
+FenFields ChessPosition::fen_fields() const
+{
+    FenFields fields;
+    for (int i = 0; i < 64; i++)
+        fields.board[i] = table[i];
+    fields.turn = turn();
+    fields.fullmove = ply() / 2 + 1;
+
+    if (table[S("E1")] == Piece::King)
+    {
+        if (table[S("H1")] == Piece::Rook) fields.castling |= FenFields::white_short;
+        if (table[S("A1")] == Piece::Rook) fields.castling |= FenFields::white_long;
+    }
+    if (table[S("E8")] == Piece::OtherKing)
+    {
+        if (table[S("H8")] == Piece::OtherRook) fields.castling |= FenFields::black_short;
+        if (table[S("A8")] == Piece::OtherRook) fields.castling |= FenFields::black_long;
+    }
+    return fields;
+}
+
+std::string ChessPosition::fen() const
+{
+    char buffer[FenFields::fen_max_length];
+    size_t length = write_fen(buffer);
+    return std::string(buffer, length);
+}
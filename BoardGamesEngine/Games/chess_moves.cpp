@@ -2,26 +2,53 @@
 
 using namespace chess;
 
-void ChessPosition::operator+=(Move move)
+void ChessPosition::refresh_tracked(TrackedState& state) const
 {
-    if (_track_pgn)
-    {
-        if (_ply == pgns.size())
-            pgns.push_back(move_to_pgn(move));
-        else
-            pgns[_ply] = move_to_pgn(move);
-    }
+    state.stamp = tracked_stamp = new_stamp();
+    state.parent = 0;
+    state.trackings = trackings;
+    if (trackings & material_tracking)
+        state.material = get_material_full();
+    if (trackings & pst_tracking)
+        state.pst = get_pst_full();
+    state.accumulator.dirty[0] = state.accumulator.dirty[1] = true;
+}
+
+ChessPosition::TrackedState& ChessPosition::track_move(Move move) const
+{
+    const TrackedState& current = tracked();
+    TrackedState& next = tracked_states[(_ply + 1) & (tracked_plies - 1)];
+    next.stamp = new_stamp();
+    next.parent = tracked_stamp;
+    tracked_stamp = next.stamp;
+    next.trackings = trackings;
+    if (trackings & material_tracking)
+        next.material = current.material + move.material_change();
+    if (trackings & pst_tracking)
+    {
+        next.pst = current.pst;
+        pst_update(next.pst, move);
+    }
+    if (trackings & nnue_tracking)
+        nnue_update(current.accumulator, next.accumulator, move);
+    return next;
+}
 
+void ChessPosition::operator+=(Move move)
+{
     DCHECK(square(move.from()) == move.piece());
     DCHECK(square(move.to()) == move.captured());
+    TrackedState* next = trackings != 0 ? &track_move(move) : nullptr;
+    if (track_pawns_on)
+        pawn_key_update(move);
     square(move.to()) = move.promotion() == Piece::None ? square(move.from()) : move.promotion();
     square(move.from()) = Piece::None;
     if (move.from() == King1)
     {
         if (move.from() == S("E1"))
         {
-            castle_rook(chess::Piece::King, S("G1"), chess::Piece::Rook, S("H1"), S("F1"));
-            castle_rook(chess::Piece::King, S("C1"), chess::Piece::Rook, S("A1"), S("D1"));
+            castle_rook(chess::Piece::King, S("G1"), chess::Piece::Rook, S("H1"), S("F1"), next);
+            castle_rook(chess::Piece::King, S("C1"), chess::Piece::Rook, S("A1"), S("D1"), next);
         }
         King1 = move.to();
     }
@@ -29,26 +56,32 @@ void ChessPosition::operator+=(Move move)
     {
         if (move.from() == S("E8"))
         {
-            castle_rook(chess::Piece::OtherKing, S("G8"), chess::Piece::OtherRook, S("H8"), S("F8"));
-            castle_rook(chess::Piece::OtherKing, S("C8"), chess::Piece::OtherRook, S("A8"), S("D8"));
+            castle_rook(chess::Piece::OtherKing, S("G8"), chess::Piece::OtherRook, S("H8"), S("F8"), next);
+            castle_rook(chess::Piece::OtherKing, S("C8"), chess::Piece::OtherRook, S("A8"), S("D8"), next);
         }
         King2 = move.to();
     }
     BoardBase::move();
-    if (track_material_on)
-        tracked_material += move.material_change();
 }
 
+// The tracked values of the previous ply are still in its entry, unless another position wrote it since
 void ChessPosition::operator-=(Move move)
 {
     DCHECK(square(move.to()) == move.piece() || square(move.to()) == move.promotion());
     DCHECK(square(move.from()) == Piece::None);
+    if (trackings != 0)
+    {
+        const TrackedState& state = tracked_states[_ply & (tracked_plies - 1)];
+        tracked_stamp = state.stamp == tracked_stamp ? state.parent : 0;
+    }
+    if (track_pawns_on)
+        pawn_key_update(move);
     if (move.to() == King1)
     {
         if (move.from() == S("E1"))
         {
-            castle_rook(chess::Piece::King, S("G1"), chess::Piece::Rook, S("F1"), S("H1"));
-            castle_rook(chess::Piece::King, S("C1"), chess::Piece::Rook, S("D1"), S("A1"));
+            castle_rook(chess::Piece::King, S("G1"), chess::Piece::Rook, S("F1"), S("H1"), nullptr);
+            castle_rook(chess::Piece::King, S("C1"), chess::Piece::Rook, S("D1"), S("A1"), nullptr);
         }
         King1 = move.from();
     }
@@ -56,8 +89,8 @@ void ChessPosition::operator-=(Move move)
     {
         if (move.from() == S("E8"))
         {
-            castle_rook(chess::Piece::OtherKing, S("G8"), chess::Piece::OtherRook, S("F8"), S("H8"));
-            castle_rook(chess::Piece::OtherKing, S("C8"), chess::Piece::OtherRook, S("D8"), S("A8"));
+            castle_rook(chess::Piece::OtherKing, S("G8"), chess::Piece::OtherRook, S("F8"), S("H8"), nullptr);
+            castle_rook(chess::Piece::OtherKing, S("C8"), chess::Piece::OtherRook, S("D8"), S("A8"), nullptr);
         }
         King2 = move.from();
     }
@@ -67,8 +100,6 @@ void ChessPosition::operator-=(Move move)
         : (belongs_to(move.promotion(), Player::First) ? Piece::Pawn : Piece::OtherPawn);
     square(move.to()) = move.captured();
     BoardBase::reverse_move();
-    if (track_material_on)
-        tracked_material -= move.material_change();
 }
 
 std::experimental::generator<Move> ChessPosition::all_legal_moves_played()
@@ -208,10 +239,6 @@ if (sq2.MOVE() && !belongs_to(square(sq2), player) && sq2.king_distance(other_ki
 #define MOVE_ONCE(MOVE) MOVE_ONCE_WITH_COND(MOVE, true)
 #define MOVE_PAWN(MOVE) MOVE_ONCE_WITH_COND(MOVE, true)
 
-    // Store pgn flag
-    bool stored_pgn = _track_pgn;
-    _track_pgn = false;
-
     DCHECK(number_of_checks <= 2);
     Square sq(0);
     do
@@ -317,26 +344,20 @@ if (sq2.MOVE() && !belongs_to(square(sq2), player) && sq2.king_distance(other_ki
         Square right_rook(7, y);
         if (right_castle(king, right_rook, player))
         {
-            std::swap(square(king), square(king + 2));
-            std::swap(square(right_rook), square(right_rook - 2));
-            (player == Player::First ? King1 : King2) = king + 2;
-            BoardBase::move();
-            co_yield Move(king, king + 2, square(king + 2));
+            // Moves the rook too, and keeps the trackings
+            Move castle(king, king + 2, square(king));
+            *this += castle;
+            co_yield castle;
         }
 
         Square left_rook(0, y);
         if (left_castle(king, left_rook, player))
         {
-            std::swap(square(king), square(king - 2));
-            std::swap(square(left_rook), square(left_rook + 3));
-            (player == Player::First ? King1 : King2) = king - 2;
-            BoardBase::move();
-            co_yield Move(king, king - 2, square(king - 2));
+            Move castle(king, king - 2, square(king));
+            *this += castle;
+            co_yield castle;
         }
     }
-
-    // Restore pgn flag
-    _track_pgn = stored_pgn;
 }
 
 bool ChessPosition::play_if_legal(Move move)
@@ -453,7 +474,7 @@ bool ChessPosition::bishop_move(Square sq1, Square sq2) const
     }
     if (dy == sq1.x() - sq2.x())
     {
-        VERIFY_DIRECTION(move_upright);
+        VERIFY_DIRECTION(move_upleft);
     }
     return false;
 }
@@ -526,6 +547,222 @@ std::experimental::generator<Move> ChessPosition::all_legal_moves() const
     }
 }
 
+bool ChessPosition::is_reverse_legal(Move move) const
+{
+    Player mover = oponent(turn());
+    Piece moved = move.promotion() == Piece::None ? move.piece() : move.promotion();
+    if (square(move.from()) != Piece::None || square(move.to()) != moved || !belongs_to(moved, mover))
+        return false;
+    if (move.captured() != Piece::None && !belongs_to(move.captured(), turn()))
+        return false;
+    if (is_checked(mover))
+        return false;
+
+    // The king castled from its square, the rook stands next to it and its own square is empty
+    if (abs(move.piece()) == Piece::King && move.from().king_distance(move.to()) == 2)
+    {
+        int y = mover == Player::First ? 0 : 7;
+        bool right = move.to().x() > move.from().x();
+        Square rook_from(right ? 7 : 0, y), rook_to(right ? 5 : 3, y);
+        Piece rook = mover == Player::First ? Piece::Rook : Piece::OtherRook;
+        if (move.from() != Square(4, y) || move.to().y() != y || move.captured() != Piece::None ||
+            square(rook_to) != rook || square(rook_from) != Piece::None)
+            return false;
+
+        auto nonConstThis = const_cast<ChessPosition*>(this);
+        (*nonConstThis) -= move;
+        bool legal = King1.king_distance(King2) >= 2 && !is_checked(oponent(turn())) &&
+            (right ? right_castle(move.from(), rook_from, mover) : left_castle(move.from(), rook_from, mover));
+        (*nonConstThis) += move;
+        return legal;
+    }
+
+    // For all non-knight pieces there are no pieces on the way
+    if (abs(move.piece()) != Piece::Knight)
+    {
+        Direction dir = move.from().get_direction_to<false>(move.to());
+        if (dir == Direction::none)
+            return false;
+        Square sq = move.from();
+        while (sq.move(dir) && sq != move.to())
+        {
+            if (square(sq) != Piece::None)
+                return false;
+        }
+    }
+
+    auto nonConstThis = const_cast<ChessPosition*>(this);
+    (*nonConstThis) -= move;
+    bool legal = King1.king_distance(King2) >= 2 && !is_checked(oponent(turn()));
+    (*nonConstThis) += move;
+    return legal;
+}
+
+// The piece on sq came from sq2, sq2 is empty
+#define UNMOVE_IN_DIRECTION(MOVE)                               \
+sq2 = sq;                                                       \
+while (sq2.MOVE() && square(sq2) == Piece::None)                \
+{                                                               \
+    Move move(sq2, sq, square(sq), captured);                   \
+    if (is_reverse_legal(move))                                 \
+        co_yield move;                                          \
+}
+
+#define UNMOVE_ONCE_WITH_COND(MOVE, CONDITION)                  \
+sq2 = sq;                                                       \
+if (sq2.MOVE() && square(sq2) == Piece::None && (CONDITION))    \
+{                                                               \
+    Move move(sq2, sq, square(sq), captured);                   \
+    if (is_reverse_legal(move))                                 \
+        co_yield move;                                          \
+}
+
+#define UNMOVE_ONCE(MOVE) UNMOVE_ONCE_WITH_COND(MOVE, true)
+
+// A pawn of the mover from sq2 moved or promoted on sq
+#define UNMOVE_PAWN(MOVE, PROMOTION)                                                            \
+sq2 = sq;                                                                                       \
+if (sq2.MOVE() && square(sq2) == Piece::None && sq2.y() != 0 && sq2.y() != 7)                   \
+{                                                                                               \
+    Move move(sq2, sq, pawn, captured, PROMOTION);                                              \
+    if (is_reverse_legal(move))                                                                 \
+        co_yield move;                                                                          \
+}
+
+std::experimental::generator<Move> ChessPosition::all_reverse_moves(Piece uncapture, bool unpromotions) const
+{
+    Player player = turn();
+    Player mover = oponent(player);
+
+    // The player who moved can't be in check
+    if (is_checked(mover))
+        co_return;
+
+    Piece captured = Piece::None;
+    if (uncapture != Piece::None)
+    {
+        DCHECK(abs(uncapture) != Piece::King);
+        captured = player == Player::First ? abs(uncapture) : other(abs(uncapture));
+    }
+    Piece pawn = mover == Player::First ? Piece::Pawn : Piece::OtherPawn;
+    int last_row = mover == Player::First ? 7 : 0;
+
+    Square sq(0);
+    do
+    {
+        Piece piece = square(sq);
+        if (!belongs_to(piece, mover))
+            continue;
+
+        // The piece put back is on the target square, no pawns on the first and the last rows
+        if (captured != Piece::None)
+        {
+            if (abs(captured) == Piece::Pawn && (sq.y() == 0 || sq.y() == 7))
+                continue;
+        }
+
+        Square sq2;
+        piece = abs(piece);
+        if (piece == Piece::Queen || piece == Piece::Rook)
+        {
+            UNMOVE_IN_DIRECTION(move_left);
+            UNMOVE_IN_DIRECTION(move_right);
+            UNMOVE_IN_DIRECTION(move_up);
+            UNMOVE_IN_DIRECTION(move_down);
+        }
+        if (piece == Piece::Queen || piece == Piece::Bishop)
+        {
+            UNMOVE_IN_DIRECTION(move_upleft);
+            UNMOVE_IN_DIRECTION(move_upright);
+            UNMOVE_IN_DIRECTION(move_downleft);
+            UNMOVE_IN_DIRECTION(move_downright);
+        }
+        if (piece == Piece::Knight)
+        {
+            UNMOVE_ONCE(move_knight1);
+            UNMOVE_ONCE(move_knight2);
+            UNMOVE_ONCE(move_knight3);
+            UNMOVE_ONCE(move_knight4);
+            UNMOVE_ONCE(move_knight5);
+            UNMOVE_ONCE(move_knight6);
+            UNMOVE_ONCE(move_knight7);
+            UNMOVE_ONCE(move_knight8);
+        }
+        if (piece == Piece::King)
+        {
+            Square other_king = mover == Player::First ? King2 : King1;
+
+            UNMOVE_ONCE_WITH_COND(move_up, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_down, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_left, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_right, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_upleft, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_upright, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_downleft, sq2.king_distance(other_king) >= 2);
+            UNMOVE_ONCE_WITH_COND(move_downright, sq2.king_distance(other_king) >= 2);
+
+            Square king_from(4, mover == Player::First ? 0 : 7);
+            if (captured == Piece::None && sq.y() == king_from.y() && (sq.x() == 6 || sq.x() == 2))
+            {
+                Move move(king_from, sq, square(sq));
+                if (is_reverse_legal(move))
+                    co_yield move;
+            }
+        }
+
+        // The pawns move straight and capture diagonally, backwards it's down for the first player
+        bool promoted = piece != Piece::Pawn && piece != Piece::King && sq.y() == last_row;
+        if (piece == Piece::Pawn || (promoted && unpromotions))
+        {
+            Piece promotion = promoted ? square(sq) : Piece::None;
+            if (mover == Player::First)
+            {
+                if (captured == Piece::None)
+                {
+                    UNMOVE_PAWN(move_down, promotion);
+                    if (sq.y() == 3 && square(Square(sq.x(), 2)) == Piece::None)
+                    {
+                        sq2 = Square(sq.x(), 1);
+                        if (square(sq2) == Piece::None)
+                        {
+                            Move move(sq2, sq, pawn);
+                            if (is_reverse_legal(move))
+                                co_yield move;
+                        }
+                    }
+                }
+                else
+                {
+                    UNMOVE_PAWN(move_downleft, promotion);
+                    UNMOVE_PAWN(move_downright, promotion);
+                }
+            }
+            else
+            {
+                if (captured == Piece::None)
+                {
+                    UNMOVE_PAWN(move_up, promotion);
+                    if (sq.y() == 4 && square(Square(sq.x(), 5)) == Piece::None)
+                    {
+                        sq2 = Square(sq.x(), 6);
+                        if (square(sq2) == Piece::None)
+                        {
+                            Move move(sq2, sq, pawn);
+                            if (is_reverse_legal(move))
+                                co_yield move;
+                        }
+                    }
+                }
+                else
+                {
+                    UNMOVE_PAWN(move_upleft, promotion);
+                    UNMOVE_PAWN(move_upright, promotion);
+                }
+            }
+        }
+    } while (++sq);
+}
+
 // Square start may or may not be occupied
 // If it is occupied by a piece, this effectively checks if Player player
 // can capture or protects this piece.
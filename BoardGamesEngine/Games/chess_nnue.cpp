@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "chess.h"
+#if defined(NNUE_AVX2) || defined(NNUE_SSE4)
+#include <immintrin.h>
+#endif
+
+using namespace chess;
+using namespace chess::nnue;
+
+namespace
+{
+    struct NetworkHeader
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t feature_count;
+        uint32_t hidden;
+        uint32_t layer2;
+        uint32_t layer3;
+        uint32_t reserved;
+    };
+
+    constexpr uint64_t network_magic = 0x45554E4E53534843ull;  // "CHSSNNUE"
+    constexpr uint32_t network_version = 1;
+
+#if defined(NNUE_AVX2)
+    typedef __m256i vec_t;
+    inline vec_t vec_load(const void* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline void vec_store(void* p, vec_t v) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+    inline vec_t vec_zero() { return _mm256_setzero_si256(); }
+    inline vec_t vec_add16(vec_t a, vec_t b) { return _mm256_add_epi16(a, b); }
+    inline vec_t vec_sub16(vec_t a, vec_t b) { return _mm256_sub_epi16(a, b); }
+
+    // Adds the products of the unsigned bytes x and the signed bytes w to the int32 lanes of sum
+    inline vec_t vec_dot(vec_t sum, vec_t x, vec_t w)
+    {
+        vec_t products = _mm256_maddubs_epi16(x, w);
+        return _mm256_add_epi32(sum, _mm256_madd_epi16(products, _mm256_set1_epi16(1)));
+    }
+
+    inline int vec_sum32(vec_t v)
+    {
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        sum = _mm_hadd_epi32(sum, sum);
+        sum = _mm_hadd_epi32(sum, sum);
+        return _mm_cvtsi128_si32(sum);
+    }
+
+    // Two vectors of int16 clipped to [0, 127] as bytes, in the original order
+    inline vec_t vec_clip_pack(vec_t a, vec_t b)
+    {
+        vec_t packed = _mm256_max_epi8(_mm256_packs_epi16(a, b), _mm256_setzero_si256());
+        return _mm256_permute4x64_epi64(packed, 0b11011000);
+    }
+#elif defined(NNUE_SSE4)
+    typedef __m128i vec_t;
+    inline vec_t vec_load(const void* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void vec_store(void* p, vec_t v) { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline vec_t vec_zero() { return _mm_setzero_si128(); }
+    inline vec_t vec_add16(vec_t a, vec_t b) { return _mm_add_epi16(a, b); }
+    inline vec_t vec_sub16(vec_t a, vec_t b) { return _mm_sub_epi16(a, b); }
+
+    inline vec_t vec_dot(vec_t sum, vec_t x, vec_t w)
+    {
+        vec_t products = _mm_maddubs_epi16(x, w);
+        return _mm_add_epi32(sum, _mm_madd_epi16(products, _mm_set1_epi16(1)));
+    }
+
+    inline int vec_sum32(vec_t v)
+    {
+        v = _mm_hadd_epi32(v, v);
+        v = _mm_hadd_epi32(v, v);
+        return _mm_cvtsi128_si32(v);
+    }
+
+    inline vec_t vec_clip_pack(vec_t a, vec_t b)
+    {
+        return _mm_max_epi8(_mm_packs_epi16(a, b), _mm_setzero_si128());
+    }
+#endif
+
+#if defined(NNUE_AVX2) || defined(NNUE_SSE4)
+    constexpr int vec_bytes = sizeof(vec_t);
+    constexpr int vec_int16 = vec_bytes / 2;
+#endif
+
+    // The accumulator of a perspective clipped to [0, 127]
+    void clip(const int16_t* accumulator, uint8_t* out)
+    {
+#if defined(NNUE_AVX2) || defined(NNUE_SSE4)
+        for (int i = 0; i < hidden; i += 2 * vec_int16)
+            vec_store(out + i, vec_clip_pack(vec_load(accumulator + i), vec_load(accumulator + i + vec_int16)));
+#else
+        for (int i = 0; i < hidden; i++)
+            out[i] = uint8_t(std::clamp<int>(accumulator[i], 0, 127));
+#endif
+    }
+
+    // out = bias + weights * in, the weights of an output are consecutive.
+    // The products of the pairs of inputs fit in int16, as the inputs are at most 127.
+    void affine(const uint8_t* in, int in_size, const int8_t* weights, const int32_t* bias, int32_t* out, int out_size)
+    {
+        for (int j = 0; j < out_size; j++)
+        {
+            const int8_t* row = weights + j * in_size;
+#if defined(NNUE_AVX2) || defined(NNUE_SSE4)
+            vec_t sum = vec_zero();
+            for (int i = 0; i < in_size; i += vec_bytes)
+                sum = vec_dot(sum, vec_load(in + i), vec_load(row + i));
+            out[j] = bias[j] + vec_sum32(sum);
+#else
+            int32_t sum = bias[j];
+            for (int i = 0; i < in_size; i++)
+                sum += int32_t(in[i]) * row[i];
+            out[j] = sum;
+#endif
+        }
+    }
+
+    void activate(const int32_t* in, uint8_t* out, int size)
+    {
+        for (int i = 0; i < size; i++)
+            out[i] = uint8_t(std::clamp(in[i] >> weight_shift, 0, 127));
+    }
+
+    int random_between(Xoshiro256& rng, int min, int max)
+    {
+        return min + int(rng.below(uint32_t(max - min + 1)));
+    }
+
+    template <typename T, size_t N>
+    void randomize(T (&values)[N], Xoshiro256& rng, int min, int max)
+    {
+        for (auto& value : values)
+            value = T(random_between(rng, min, max));
+    }
+
+    template <typename T, size_t N, size_t M>
+    void randomize(T (&values)[N][M], Xoshiro256& rng, int min, int max)
+    {
+        for (auto& row : values)
+            randomize(row, rng, min, max);
+    }
+
+    // The feature of a piece other than a king, from the perspective of white (0) or black (1)
+    int feature(int perspective, Square king, Piece piece, Square square)
+    {
+        int k = int(king), sq = int(square);
+        if (perspective == 1)
+        {
+            k ^= 56;
+            sq ^= 56;
+        }
+        bool own = belongs_to(piece, perspective == 0 ? Player::First : Player::Second);
+        int index = (own ? 0 : 5) + int8_t(abs(piece)) - int8_t(Piece::Queen);
+        return (k * 10 + index) * 64 + sq;
+    }
+}
+
+#pragma region Network
+std::unique_ptr<Network> Network::load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return nullptr;
+
+    NetworkHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return nullptr;
+    if (header.magic != network_magic || header.version != network_version ||
+        header.feature_count != feature_count || header.hidden != hidden ||
+        header.layer2 != layer2 || header.layer3 != layer3)
+        return nullptr;
+
+    std::unique_ptr<Network> ret(new Network);
+    in.read(reinterpret_cast<char*>(ret->ft_bias), sizeof(ft_bias));
+    in.read(reinterpret_cast<char*>(ret->ft_weights), sizeof(ft_weights));
+    in.read(reinterpret_cast<char*>(ret->l1_bias), sizeof(l1_bias));
+    in.read(reinterpret_cast<char*>(ret->l1_weights), sizeof(l1_weights));
+    in.read(reinterpret_cast<char*>(ret->l2_bias), sizeof(l2_bias));
+    in.read(reinterpret_cast<char*>(ret->l2_weights), sizeof(l2_weights));
+    in.read(reinterpret_cast<char*>(&ret->out_bias), sizeof(out_bias));
+    in.read(reinterpret_cast<char*>(ret->out_weights), sizeof(out_weights));
+    if (!in)
+        return nullptr;
+    return ret;
+}
+
+bool Network::save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+
+    NetworkHeader header{ network_magic, network_version, feature_count, hidden, layer2, layer3, 0 };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(ft_bias), sizeof(ft_bias));
+    out.write(reinterpret_cast<const char*>(ft_weights), sizeof(ft_weights));
+    out.write(reinterpret_cast<const char*>(l1_bias), sizeof(l1_bias));
+    out.write(reinterpret_cast<const char*>(l1_weights), sizeof(l1_weights));
+    out.write(reinterpret_cast<const char*>(l2_bias), sizeof(l2_bias));
+    out.write(reinterpret_cast<const char*>(l2_weights), sizeof(l2_weights));
+    out.write(reinterpret_cast<const char*>(&out_bias), sizeof(out_bias));
+    out.write(reinterpret_cast<const char*>(out_weights), sizeof(out_weights));
+    return bool(out);
+}
+
+std::unique_ptr<Network> Network::random(uint64_t seed)
+{
+    // Ranges keeping the activations mostly inside [0, 127]
+    Xoshiro256 rng(seed);
+    std::unique_ptr<Network> ret(new Network);
+    randomize(ret->ft_bias, rng, 0, 64);
+    randomize(ret->ft_weights, rng, -24, 24);
+    randomize(ret->l1_bias, rng, -2048, 2048);
+    randomize(ret->l1_weights, rng, -8, 8);
+    randomize(ret->l2_bias, rng, -2048, 2048);
+    randomize(ret->l2_weights, rng, -32, 32);
+    ret->out_bias = 0;
+    randomize(ret->out_weights, rng, -64, 64);
+    return ret;
+}
+
+void Network::refresh(int16_t* accumulator, const int* features, int count) const
+{
+#if defined(NNUE_AVX2) || defined(NNUE_SSE4)
+    for (int i = 0; i < hidden; i += vec_int16)
+    {
+        vec_t sum = vec_load(ft_bias + i);
+        for (int f = 0; f < count; f++)
+            sum = vec_add16(sum, vec_load(ft_weights[features[f]] + i));
+        vec_store(accumulator + i, sum);
+    }
+#else
+    std::memcpy(accumulator, ft_bias, sizeof(ft_bias));
+    for (int f = 0; f < count; f++)
+    {
+        const int16_t* weights = ft_weights[features[f]];
+        for (int i = 0; i < hidden; i++)
+            accumulator[i] += weights[i];
+    }
+#endif
+}
+
+void Network::update(const int16_t* from, int16_t* to, const int* added, int added_count, const int* removed, int removed_count) const
+{
+#if defined(NNUE_AVX2) || defined(NNUE_SSE4)
+    for (int i = 0; i < hidden; i += vec_int16)
+    {
+        vec_t sum = vec_load(from + i);
+        for (int f = 0; f < added_count; f++)
+            sum = vec_add16(sum, vec_load(ft_weights[added[f]] + i));
+        for (int f = 0; f < removed_count; f++)
+            sum = vec_sub16(sum, vec_load(ft_weights[removed[f]] + i));
+        vec_store(to + i, sum);
+    }
+#else
+    if (to != from)
+        std::memcpy(to, from, sizeof(int16_t) * hidden);
+    for (int f = 0; f < added_count; f++)
+    {
+        const int16_t* weights = ft_weights[added[f]];
+        for (int i = 0; i < hidden; i++)
+            to[i] += weights[i];
+    }
+    for (int f = 0; f < removed_count; f++)
+    {
+        const int16_t* weights = ft_weights[removed[f]];
+        for (int i = 0; i < hidden; i++)
+            to[i] -= weights[i];
+    }
+#endif
+}
+
+int Network::evaluate(const Accumulator& accumulator, int side_to_move) const
+{
+    DCHECK(!accumulator.dirty[0] && !accumulator.dirty[1]);
+
+    alignas(64) uint8_t input[2 * hidden];
+    clip(accumulator.values[side_to_move], input);
+    clip(accumulator.values[1 - side_to_move], input + hidden);
+
+    int32_t sums2[layer2];
+    alignas(64) uint8_t hidden2[layer2];
+    affine(input, 2 * hidden, &l1_weights[0][0], l1_bias, sums2, layer2);
+    activate(sums2, hidden2, layer2);
+
+    int32_t sums3[layer3];
+    alignas(64) uint8_t hidden3[layer3];
+    affine(hidden2, layer2, &l2_weights[0][0], l2_bias, sums3, layer3);
+    activate(sums3, hidden3, layer3);
+
+    int32_t output;
+    affine(hidden3, layer3, out_weights, &out_bias, &output, 1);
+    return output / output_scale;
+}
+#pragma endregion
+
+#pragma region ChessPosition
+bool ChessPosition::load_nnue(const std::string& path)
+{
+    auto network = Network::load(path);
+    if (network == nullptr)
+        return false;
+    nnue_network = std::move(network);
+    return true;
+}
+
+int ChessPosition::nnue_features(int perspective, int* features) const
+{
+    Square king = perspective == 0 ? King1 : King2;
+    int count = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        Piece piece = table[i];
+        if (piece == Piece::None || abs(piece) == Piece::King)
+            continue;
+        DCHECK(count < max_features);
+        features[count++] = feature(perspective, king, piece, Square(i));
+    }
+    return count;
+}
+
+void ChessPosition::nnue_update(const Accumulator& from, Accumulator& to, Move move) const
+{
+    Piece piece = move.piece();
+    Piece result = move.promotion() == Piece::None ? piece : move.promotion();
+    for (int perspective = 0; perspective < 2; perspective++)
+    {
+        to.dirty[perspective] = from.dirty[perspective];
+        if (from.dirty[perspective])
+            continue;
+
+        // All the features of the perspective depend on its king
+        Player player = perspective == 0 ? Player::First : Player::Second;
+        if (abs(piece) == Piece::King && belongs_to(piece, player))
+        {
+            to.dirty[perspective] = true;
+            continue;
+        }
+
+        Square king = perspective == 0 ? King1 : King2;
+        int before[2], after[1];
+        int before_count = 0, after_count = 0;
+        if (abs(piece) != Piece::King)
+        {
+            before[before_count++] = feature(perspective, king, piece, move.from());
+            after[after_count++] = feature(perspective, king, result, move.to());
+        }
+        if (move.captured() != Piece::None)
+            before[before_count++] = feature(perspective, king, move.captured(), move.to());
+
+        nnue_network->update(from.values[perspective], to.values[perspective], after, after_count, before, before_count);
+    }
+}
+
+void ChessPosition::nnue_move_rook(Accumulator& accumulator, Piece rook, Square from, Square to) const
+{
+    for (int perspective = 0; perspective < 2; perspective++)
+    {
+        if (accumulator.dirty[perspective])
+            continue;
+
+        Square king = perspective == 0 ? King1 : King2;
+        int added = feature(perspective, king, rook, to);
+        int removed = feature(perspective, king, rook, from);
+        nnue_network->update(accumulator.values[perspective], accumulator.values[perspective], &added, 1, &removed, 1);
+    }
+}
+
+int ChessPosition::nnue_eval() const
+{
+    DCHECK(nnue_network != nullptr);
+
+    Accumulator local;
+    Accumulator& accumulator = (trackings & nnue_tracking) ? tracked().accumulator : local;
+    for (int perspective = 0; perspective < 2; perspective++)
+    {
+        if (!accumulator.dirty[perspective])
+            continue;
+        int features[max_features];
+        int count = nnue_features(perspective, features);
+        nnue_network->refresh(accumulator.values[perspective], features, count);
+        accumulator.dirty[perspective] = false;
+    }
+
+    int side_to_move = turn() == Player::First ? 0 : 1;
+    int value = nnue_network->evaluate(accumulator, side_to_move);
+    return side_to_move == 0 ? value : -value;
+}
+#pragma endregion
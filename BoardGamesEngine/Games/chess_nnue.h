@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// The inference uses the widest instruction set enabled for the compilation (e.g. /arch:AVX2 or -mavx2),
+// otherwise the portable scalar code. The results are the same on all the paths.
+#if defined(__AVX2__)
+#define NNUE_AVX2
+#elif defined(__SSE4_1__)
+#define NNUE_SSE4
+#endif
+
+namespace chess::nnue
+{
+    // Features of a perspective: its king square x piece (own/opponent queen, rook, bishop, knight, pawn) x square.
+    // The kings aren't features, the own king square selects the weights of the other pieces.
+    constexpr int feature_count = 64 * 10 * 64;
+
+    // Accumulator size of a perspective, the first layer takes both perspectives, the side to move first
+    constexpr int hidden = 128;
+    constexpr int layer2 = 32;
+    constexpr int layer3 = 32;
+
+    // The activations are clipped to [0, 127], the outputs of the int8 layers are shifted down by weight_shift
+    constexpr int weight_shift = 6;
+
+    // Network output per centipawn
+    constexpr int output_scale = 16;
+
+    // The most features active at once: all the pieces but the kings
+    constexpr int max_features = 30;
+
+    /// <summary>
+    /// Accumulators of the feature transformer of both perspectives, white (0) and black (1).
+    /// A dirty perspective is refreshed from the whole board before the next evaluation,
+    /// that is after a move of its king, which changes all its features.
+    /// </summary>
+    struct alignas(32) Accumulator
+    {
+        int16_t values[2][hidden];
+        bool dirty[2] = { true, true };
+    };
+
+    /// <summary>
+    /// Weights of the network, about 10MB, so it's always allocated on the heap.
+    /// The layers are quantized: int16 feature transformer, int8 hidden layers with int32 biases.
+    /// </summary>
+    class Network
+    {
+    public:
+        /// <summary>
+        /// Loads the binary file written by save, returns nullptr if it can't be read or the sizes don't match.
+        /// </summary>
+        static std::unique_ptr<Network> load(const std::string& path);
+
+        bool save(const std::string& path) const;
+
+        /// <summary>
+        /// Small random weights, for tests and as the start of a training.
+        /// </summary>
+        static std::unique_ptr<Network> random(uint64_t seed);
+
+        /// <summary>
+        /// Sets the accumulator of a perspective to the sum of the active features.
+        /// </summary>
+        void refresh(int16_t* accumulator, const int* features, int count) const;
+
+        /// <summary>
+        /// Adds and removes up to two features in one pass, from the accumulator of the previous position
+        /// to the accumulator of the next one, they may be the same.
+        /// </summary>
+        void update(const int16_t* from, int16_t* to, const int* added, int added_count, const int* removed, int removed_count) const;
+
+        /// <summary>
+        /// Evaluation in centipawns from the side to move, 0 for white and 1 for black.
+        /// The accumulator must not be dirty.
+        /// </summary>
+        int evaluate(const Accumulator& accumulator, int side_to_move) const;
+
+    private:
+        Network() = default;
+
+        alignas(64) int16_t ft_bias[hidden];
+        alignas(64) int16_t ft_weights[feature_count][hidden];
+        alignas(64) int32_t l1_bias[layer2];
+        alignas(64) int8_t l1_weights[layer2][2 * hidden];
+        alignas(64) int32_t l2_bias[layer3];
+        alignas(64) int8_t l2_weights[layer3][layer2];
+        int32_t out_bias;
+        alignas(64) int8_t out_weights[layer3];
+    };
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "chess_opening_book.h"
+
+using namespace chess;
+
+static uint32_t encode_move(Move move)
+{
+    return uint32_t(int(move.from())) | (uint32_t(int(move.to())) << 8) | (uint32_t(uint8_t(move.promotion())) << 16);
+}
+
+void OpeningBookBuilder::add_moves(const std::vector<Move>& moves, GameResult result, StatsMap& to) const
+{
+    ChessPosition pos;
+    int plies = std::min(int(moves.size()), max_plies);
+    for (int i = 0; i < plies; i++)
+    {
+        Stats& s = to[Key{ pos.get_hash<true>(), encode_move(moves[i]) }];
+        s.games++;
+        if (result == GameResult::Draw)
+            s.draws++;
+        else if ((result == GameResult::WhiteWins && pos.turn() == Player::First)
+            || (result == GameResult::BlackWins && pos.turn() == Player::Second))
+            s.wins++;
+
+        pos += moves[i];
+    }
+}
+
+bool OpeningBookBuilder::add_game(const std::vector<std::string>& moves, GameResult result)
+{
+    ChessPosition pos;
+    std::vector<Move> parsed;
+    bool valid = true;
+    for (size_t i = 0; i < moves.size() && int(i) < max_plies; i++)
+    {
+        Move move = pos.pgn_to_move(moves[i]);
+        if (!move.is_valid())
+        {
+            valid = false;
+            break;
+        }
+        parsed.push_back(move);
+        pos += move;
+    }
+
+    _games++;
+    add_moves(parsed, result, stats);
+    return valid;
+}
+
+size_t OpeningBookBuilder::add_games(const PgnReader& reader, const std::function<size_t(const PgnReader::Callback&)>& read)
+{
+    // A map per thread, merged at the end
+    std::vector<StatsMap> partial(reader.thread_count());
+    size_t added = read([this, &partial](const PgnGame& game, int thread)
+        {
+            add_moves(game.moves, game.result, partial[thread]);
+        });
+
+    for (const StatsMap& map : partial)
+    {
+        for (const auto& [key, s] : map)
+        {
+            Stats& total = stats[key];
+            total.games += s.games;
+            total.wins += s.wins;
+            total.draws += s.draws;
+        }
+    }
+    _games += added;
+    return added;
+}
+
+size_t OpeningBookBuilder::add_pgn(std::string_view text, int threads)
+{
+    PgnReader reader(threads, max_plies);
+    return add_games(reader, [&](const PgnReader::Callback& on_game) { return reader.read(text, on_game); });
+}
+
+size_t OpeningBookBuilder::add_pgn(std::istream& in)
+{
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return add_pgn(std::string_view(text));
+}
+
+size_t OpeningBookBuilder::add_pgn_file(const std::string& path, int threads)
+{
+    PgnReader reader(threads, max_plies);
+    return add_games(reader, [&](const PgnReader::Callback& on_game) { return reader.read_file(path, on_game); });
+}
+
+bool OpeningBookBuilder::write(const std::string& path, uint32_t min_games) const
+{
+    std::vector<BookEntry> entries;
+    entries.reserve(stats.size());
+    for (const auto& [key, s] : stats)
+    {
+        if (s.games < min_games)
+            continue;
+        BookEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.key = key.key;
+        entry.from = uint8_t(key.move & 0xFF);
+        entry.to = uint8_t((key.move >> 8) & 0xFF);
+        entry.promotion = int8_t((key.move >> 16) & 0xFF);
+        entry.games = s.games;
+        entry.wins = s.wins;
+        entry.draws = s.draws;
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b)
+        {
+            if (a.key != b.key)
+                return a.key < b.key;
+            return a.games > b.games;
+        });
+
+    BookHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = OpeningBook::magic;
+    header.version = OpeningBook::version;
+    header.entry_size = sizeof(BookEntry);
+    header.zobrist_seed = ChessPosition::zobrist_seed;
+    header.entries = entries.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(BookEntry)));
+    return bool(out);
+}
+
+bool OpeningBook::open(const std::string& path)
+{
+    close();
+    if (!file.open_read(path) || file.size() < sizeof(BookHeader))
+        return false;
+
+    const BookHeader* header = reinterpret_cast<const BookHeader*>(file.data());
+    if (header->magic != magic
+        || header->version != version
+        || header->entry_size != sizeof(BookEntry)
+        || header->zobrist_seed != ChessPosition::zobrist_seed
+        || file.size() != sizeof(BookHeader) + header->entries * sizeof(BookEntry))
+    {
+        close();
+        return false;
+    }
+
+    entries = reinterpret_cast<const BookEntry*>(file.data() + sizeof(BookHeader));
+    count = size_t(header->entries);
+    return true;
+}
+
+void OpeningBook::close()
+{
+    file.close();
+    entries = nullptr;
+    count = 0;
+}
+
+std::pair<const BookEntry*, const BookEntry*> OpeningBook::find(const ChessPosition& pos) const
+{
+    uint64_t key = pos.get_hash<true>();
+    const BookEntry* begin = std::lower_bound(entries, entries + count, key,
+        [](const BookEntry& entry, uint64_t key) { return entry.key < key; });
+    const BookEntry* end = begin;
+    while (end != entries + count && end->key == key)
+        end++;
+    return { begin, end };
+}
+
+Move OpeningBook::to_move(const ChessPosition& pos, const BookEntry& entry)
+{
+    for (Move move : pos.all_legal_moves())
+    {
+        if (int(move.from()) == entry.from && int(move.to()) == entry.to && int8_t(move.promotion()) == entry.promotion)
+            return move;
+    }
+    return Move();
+}
+
+Move OpeningBook::probe(const ChessPosition& pos, uint32_t min_games) const
+{
+    auto [begin, end] = find(pos);
+    for (const BookEntry* entry = begin; entry != end; entry++)
+    {
+        if (entry->games < min_games)
+            break;
+
+        // Checked for legality, a different position may share the key
+        Move move = to_move(pos, *entry);
+        if (move.is_valid())
+            return move;
+    }
+    return Move();
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "chess.h"
+#include "chess_pgn_reader.h"
+#include "..\MemoryMappedFile.h"
+
+namespace chess
+{
+#pragma pack(push, 1)
+    /// <summary>
+    /// Statistics of a move played in a position, as stored in the book file.
+    /// </summary>
+    struct BookEntry
+    {
+        uint64_t key;       // get_hash<true>() of the position before the move
+        uint8_t from;
+        uint8_t to;
+        int8_t promotion;   // Piece, None if not a promotion
+        uint8_t reserved;
+        uint32_t games;
+        uint32_t wins;      // won by the player making the move
+        uint32_t draws;
+    };
+#pragma pack(pop)
+    static_assert(sizeof(BookEntry) == 24);
+
+    struct BookHeader
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t entry_size;
+        uint64_t zobrist_seed;
+        uint64_t entries;
+    };
+
+    /// <summary>
+    /// Aggregates the moves of the opening phase of PGN games by the Zobrist key of the position,
+    /// and writes them sorted to a book file for OpeningBook.
+    /// </summary>
+    class OpeningBookBuilder
+    {
+    public:
+        OpeningBookBuilder(int max_plies = 30) : max_plies(max_plies) {}
+
+        /// <summary>
+        /// Adds the first max_plies moves of a game given in the standard algebraic notation.
+        /// Stops at the first move that can't be parsed, returns false in that case.
+        /// </summary>
+        bool add_game(const std::vector<std::string>& moves, GameResult result);
+
+        /// <summary>
+        /// Reads the PGN games by PgnReader, skipping tags, comments, variations and NAGs.
+        /// Returns the number of games added.
+        /// </summary>
+        size_t add_pgn(std::string_view text, int threads = 1);
+        size_t add_pgn(std::istream& in);
+        size_t add_pgn_file(const std::string& path, int threads = 1);
+
+        /// <summary>
+        /// Writes the moves played in at least min_games games.
+        /// </summary>
+        bool write(const std::string& path, uint32_t min_games = 1) const;
+
+        size_t games() const { return _games; }
+        size_t entries() const { return stats.size(); }
+
+    private:
+        struct Key
+        {
+            uint64_t key;
+            uint32_t move;
+            bool operator==(const Key&) const = default;
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const { return size_t(key.key ^ (uint64_t(key.move) * 0x9E3779B97F4A7C15ull)); }
+        };
+
+        struct Stats
+        {
+            uint32_t games = 0;
+            uint32_t wins = 0;
+            uint32_t draws = 0;
+        };
+
+        using StatsMap = std::unordered_map<Key, Stats, KeyHash>;
+
+        // Adds the moves of a game from the initial position
+        void add_moves(const std::vector<Move>& moves, GameResult result, StatsMap& to) const;
+        size_t add_games(const PgnReader& reader, const std::function<size_t(const PgnReader::Callback&)>& read);
+
+        int max_plies;
+        size_t _games = 0;
+        StatsMap stats;
+    };
+
+    /// <summary>
+    /// Read-only opening book mapped to the memory, positions are found by a binary search.
+    /// </summary>
+    class OpeningBook
+    {
+    public:
+        static constexpr uint64_t magic = 0x314B4F4F42435242ull;   // "BRCBOOK1"
+        static constexpr uint32_t version = 1;
+
+        bool open(const std::string& path);
+        void close();
+
+        size_t size() const { return count; }
+
+        /// <summary>
+        /// All the moves stored for the position, the most played first.
+        /// </summary>
+        std::pair<const BookEntry*, const BookEntry*> find(const ChessPosition& pos) const;
+
+        /// <summary>
+        /// The most played legal move in the position, or invalid move if the position isn't in the book.
+        /// Meant to be consulted before MinMax::FindBestMove.
+        /// </summary>
+        Move probe(const ChessPosition& pos, uint32_t min_games = 1) const;
+
+        /// <summary>
+        /// The legal move described by the entry, or invalid move if it isn't legal in the position.
+        /// </summary>
+        static Move to_move(const ChessPosition& pos, const BookEntry& entry);
+
+    private:
+        MemoryMappedFile file;
+        const BookEntry* entries = nullptr;
+        size_t count = 0;
+    };
+}
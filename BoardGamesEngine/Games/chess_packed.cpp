@@ -0,0 +1,129 @@
+#include <cstring>
+#include <thread>
+#include "chess_packed.h"
+#include "..\MemoryMappedFile.h"
+
+using namespace chess;
+
+bool PackedPosition::pack(const FenFields& fields, PackedPosition& packed)
+{
+    std::memset(&packed, 0, sizeof(packed));
+    int count = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if (fields.board[i] == Piece::None)
+            continue;
+        if (count == 32)
+            return false;
+        packed.occupied |= uint64_t(1) << i;
+        packed.pieces[count / 2] |= uint8_t((int8_t(fields.board[i]) + 8) << (4 * (count % 2)));
+        count++;
+    }
+
+    if (fields.fullmove > 0xFFFF || fields.halfmove > 0xFFFF)
+        return false;
+    packed.fullmove = uint16_t(fields.fullmove);
+    packed.halfmove = uint16_t(fields.halfmove);
+    packed.flags = uint8_t((fields.turn == Player::Second ? 1 : 0) | (fields.castling << 1));
+    packed.en_passant = int8_t(fields.en_passant);
+    return true;
+}
+
+FenFields PackedPosition::unpack() const
+{
+    FenFields fields;
+    int count = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if ((occupied >> i & 1) == 0)
+        {
+            fields.board[i] = Piece::None;
+            continue;
+        }
+        fields.board[i] = Piece(int8_t((pieces[count / 2] >> (4 * (count % 2))) & 0xF) - 8);
+        count++;
+    }
+    fields.turn = (flags & 1) ? Player::Second : Player::First;
+    fields.castling = uint8_t(flags >> 1);
+    fields.en_passant = en_passant;
+    fields.halfmove = halfmove;
+    fields.fullmove = fullmove;
+    return fields;
+}
+
+void FenBatch::read_chunk(std::string_view chunk, std::vector<PackedPosition>& packed, size_t& invalid)
+{
+    FenFields fields;
+    PackedPosition position;
+    while (!chunk.empty())
+    {
+        size_t end = chunk.find('\n');
+        std::string_view line = chunk.substr(0, end);
+        chunk.remove_prefix(end == std::string_view::npos ? chunk.size() : end + 1);
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+            continue;
+
+        if (fields.parse(line) && PackedPosition::pack(fields, position))
+            packed.push_back(position);
+        else
+            invalid++;
+    }
+}
+
+std::vector<PackedPosition> FenBatch::read(std::string_view text, size_t& invalid, int threads)
+{
+    // The chunks end at the ends of the lines
+    std::vector<std::string_view> chunks;
+    size_t begin = 0;
+    for (int k = 1; k < threads && begin < text.size(); k++)
+    {
+        size_t end = text.find('\n', std::max(begin, text.size() / threads * k));
+        if (end == std::string_view::npos)
+            break;
+        chunks.push_back(text.substr(begin, end + 1 - begin));
+        begin = end + 1;
+    }
+    chunks.push_back(text.substr(begin));
+
+    std::vector<std::vector<PackedPosition>> packed(chunks.size());
+    std::vector<size_t> invalids(chunks.size());
+    for (size_t t = 0; t < chunks.size(); t++)
+        packed[t].reserve(chunks[t].size() / 40);
+
+    if (chunks.size() == 1)
+    {
+        read_chunk(chunks[0], packed[0], invalids[0]);
+    }
+    else
+    {
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < chunks.size(); t++)
+            pool.emplace_back([&, t]() { read_chunk(chunks[t], packed[t], invalids[t]); });
+        for (auto& thread : pool)
+            thread.join();
+    }
+
+    invalid = 0;
+    for (size_t count : invalids)
+        invalid += count;
+    if (packed.size() == 1)
+        return std::move(packed[0]);
+
+    std::vector<PackedPosition> ret;
+    size_t total = 0;
+    for (const auto& part : packed)
+        total += part.size();
+    ret.reserve(total);
+    for (size_t t = 0; t < packed.size(); t++)
+        ret.insert(ret.end(), packed[t].begin(), packed[t].end());
+    return ret;
+}
+
+std::vector<PackedPosition> FenBatch::read_file(const std::string& path, size_t& invalid, int threads)
+{
+    invalid = 0;
+    MemoryMappedFile file;
+    if (!file.open_read(path))
+        return {};
+    return read(std::string_view(reinterpret_cast<const char*>(file.data()), file.size()), invalid, threads);
+}
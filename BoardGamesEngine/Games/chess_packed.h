@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "chess.h"
+
+namespace chess
+{
+    /// <summary>
+    /// A position in 32 bytes for the datasets: the occupied squares and 4 bits for each of their pieces.
+    /// </summary>
+    struct PackedPosition
+    {
+        uint64_t occupied;      // bit of each square with a piece, A1 first
+        uint8_t pieces[16];     // Piece + 8 of the occupied squares in their order, two in a byte
+        uint16_t fullmove;
+        uint16_t halfmove;
+        uint8_t flags;          // bit 0 black to move, the FenFields castling bits from bit 1
+        int8_t en_passant;      // -1 for none
+        uint8_t reserved[2];
+
+        /// <summary>
+        /// Returns false if there are more than 32 pieces or the move counters don't fit.
+        /// </summary>
+        static bool pack(const FenFields& fields, PackedPosition& packed);
+
+        FenFields unpack() const;
+
+        bool operator==(const PackedPosition& other) const = default;
+    };
+    static_assert(sizeof(PackedPosition) == 32);
+
+    /// <summary>
+    /// Converts the FEN lines of the datasets into packed positions, the text is split into a chunk per thread.
+    /// </summary>
+    class FenBatch
+    {
+    public:
+        /// <summary>
+        /// Packs a FEN per line in the order of the text. The empty lines are skipped,
+        /// the invalid ones are counted in invalid and skipped as well.
+        /// </summary>
+        static std::vector<PackedPosition> read(std::string_view text, size_t& invalid, int threads = 1);
+
+        /// <summary>
+        /// The file is mapped to the memory, no positions if it can't be mapped.
+        /// </summary>
+        static std::vector<PackedPosition> read_file(const std::string& path, size_t& invalid, int threads = 1);
+
+    private:
+        static void read_chunk(std::string_view chunk, std::vector<PackedPosition>& packed, size_t& invalid);
+    };
+}
@@ -0,0 +1,100 @@
+#include <bit>
+#include "chess.h"
+
+using namespace chess;
+
+namespace
+{
+    // By the rank from the side of the pawn, 1 for the initial rank
+    const int passed_bonus[8] = { 0, 5, 10, 20, 35, 60, 100, 0 };
+    const int isolated_penalty = 15;
+    const int doubled_penalty = 10;
+
+    constexpr uint64_t file_a = 0x0101010101010101ull;
+
+    uint64_t file_mask(int x)
+    {
+        return file_a << x;
+    }
+
+    uint64_t adjacent_files(int x)
+    {
+        return (x > 0 ? file_mask(x - 1) : 0) | (x < 7 ? file_mask(x + 1) : 0);
+    }
+
+    // The ranks in front of the rank y, for white (0) upwards and for black (1) downwards
+    uint64_t front_ranks(int color, int y)
+    {
+        if (color == 0)
+            return y == 7 ? 0 : ~uint64_t(0) << (8 * (y + 1));
+        return (uint64_t(1) << (8 * y)) - 1;
+    }
+}
+
+uint64_t ChessPosition::get_pawn_key_full() const
+{
+    uint64_t ret = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if (table[i] == Piece::Pawn)
+            ret ^= hash_white[i][int8_t(Piece::Pawn)];
+        else if (table[i] == Piece::OtherPawn)
+            ret ^= hash_black[i][int8_t(Piece::Pawn)];
+    }
+    return ret;
+}
+
+PawnEntry ChessPosition::pawn_structure_full() const
+{
+    uint64_t pawns[2] = { 0, 0 };
+    for (int i = 0; i < 64; i++)
+    {
+        if (table[i] == Piece::Pawn)
+            pawns[0] |= uint64_t(1) << i;
+        else if (table[i] == Piece::OtherPawn)
+            pawns[1] |= uint64_t(1) << i;
+    }
+
+    PawnEntry ret;
+    ret.key = get_pawn_key_full();
+    for (int color = 0; color < 2; color++)
+    {
+        int sign = color == 0 ? 1 : -1;
+        for (uint64_t set = pawns[color]; set != 0; set &= set - 1)
+        {
+            int sq = std::countr_zero(set);
+            int x = sq % 8, y = sq / 8;
+            uint64_t front = front_ranks(color, y);
+
+            if ((pawns[color] & adjacent_files(x)) == 0)
+                ret.score -= sign * isolated_penalty;
+
+            // The rear pawn of the doubled ones
+            if ((pawns[color] & front & file_mask(x)) != 0)
+                ret.score -= sign * doubled_penalty;
+
+            // No pawn in front on its file and no opponent pawn on the adjacent files
+            if ((pawns[1 - color] & front & adjacent_files(x)) == 0 && ((pawns[0] | pawns[1]) & front & file_mask(x)) == 0)
+            {
+                ret.passed[color] |= uint64_t(1) << sq;
+                ret.score += sign * passed_bonus[color == 0 ? y : 7 - y];
+            }
+        }
+    }
+    return ret;
+}
+
+PawnEntry ChessPosition::pawn_structure() const
+{
+    uint64_t key = get_pawn_key();
+    PawnEntry& entry = pawn_table.slot(key);
+    if (entry.key == key)
+    {
+        pawn_table.hits++;
+        return entry;
+    }
+
+    pawn_table.misses++;
+    entry = pawn_structure_full();
+    return entry;
+}
@@ -2,18 +2,18 @@
 
 using namespace chess;
 
-std::string ChessPosition::pgn() const
+std::string GameRecord::pgn() const
 {
     std::string ret = "";
-    for (int i = 0; i < _ply; i++)
+    for (size_t i = 0; i < sans.size(); i++)
     {
         if (i % 2 == 0)
         {
-            int turn = i / 2 + 1;
+            int turn = int(i) / 2 + 1;
             ret += std::to_string(turn);
             ret += ". ";
         }
-        ret += pgns[i] + " ";
+        ret += sans[i] + " ";
     }
     return ret;
 }
@@ -42,6 +42,8 @@ bool ChessPosition::construct_from_pgn(std::string pgn)
         std::string wmove;
         ss >> wmove;
         chess::Move move = this->pgn_to_move(wmove);
+        if (!move.is_valid())
+            return false;
         (*this) += move;
         if (ss.eof())
             return false;
@@ -52,9 +54,11 @@ bool ChessPosition::construct_from_pgn(std::string pgn)
         if (bmove == "")
             break;
         move = this->pgn_to_move(bmove);
+        if (!move.is_valid())
+            return false;
         (*this) += move;
     } while (!ss.eof());
-    return false;
+    return true;
 }
 
 std::string ChessPosition::move_to_pgn(Move move) const
@@ -123,7 +127,31 @@ std::string ChessPosition::move_to_pgn(Move move) const
         }
         return "R" + extra + move.to().chess_notation(true);
     }
-    case Piece::Bishop: return "B" + move.to().chess_notation(true);
+    case Piece::Bishop:
+    {
+        // Only promoted bishops can share the color of the squares
+        bool x_diff = true, y_diff = true;
+        bool another = false;
+        for (Square sq : get_squares(piece))
+        {
+            if (move.from() != sq && bishop_move(sq, move.to()))
+            {
+                another = true;
+                if (sq.x() == move.from().x())
+                    x_diff = false;
+                if (sq.y() == move.from().y())
+                    y_diff = false;
+            }
+        }
+        std::string extra = "";
+        if (another)
+        {
+            if (x_diff) extra = 'a' + move.from().x();
+            else if (y_diff) extra = '1' + move.from().y();
+            else extra = move.from().chess_notation(true);
+        }
+        return "B" + extra + move.to().chess_notation(true);
+    }
     case Piece::Knight:
     {
         bool x_diff = true, y_diff = true;
@@ -170,142 +198,141 @@ std::string ChessPosition::move_to_pgn(Move move) const
     };
 }
 
-template <Piece abs_piece>
-Move ChessPosition::_pgn_to_move(Square sq_to, SquareRequirements req) const
+Move ChessPosition::pgn_to_move(std::string_view str) const
 {
-    Piece piece = this->turn() == Player::First ? abs_piece : other(abs_piece);
-    Square sq;
-    Move move;
-    int results = 0;
-    if constexpr (abs_piece == Piece::Queen || abs_piece == Piece::Bishop)
-    {
-        sq = sq_to; if (go_until_piece<Direction::upleft>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (go_until_piece<Direction::upright>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (go_until_piece<Direction::downleft>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (go_until_piece<Direction::downright>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-    }
-    if constexpr (abs_piece == Piece::Queen || abs_piece == Piece::Rook)
-    {
-        sq = sq_to; if (go_until_piece<Direction::up>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (go_until_piece<Direction::down>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (go_until_piece<Direction::left>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (go_until_piece<Direction::right>(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-    }
-    if constexpr (abs_piece == Piece::Knight)
-    {
-        sq = sq_to; if (sq.move_knight1() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight2() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight3() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight4() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight5() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight6() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight7() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-        sq = sq_to; if (sq.move_knight8() && square(sq) == piece && req.satisfies(sq)) { move = Move(sq, sq_to, square(sq), square(sq_to)); results++; }
-    }
-    DCHECK(results == 1);
-    return move;
-}
+    // Check marks and annotations don't identify the move
+    while (!str.empty() && (str.back() == '+' || str.back() == '#' || str.back() == '!' || str.back() == '?'))
+        str.remove_suffix(1);
+    if (str.length() < 2)
+        return Move();
 
-Move ChessPosition::pgn_to_move(std::string str) const
-{
-    if (str == "O-O" && turn() == Player::First)
-    {
-        return Move(King1, S("G1"), Piece::King);
-    }
-    if (str == "O-O-O" && turn() == Player::First)
-    {
-        return Move(King1, S("C1"), Piece::King);
-    }
-    if (str == "O-O" && turn() == Player::Second)
-    {
-        return Move(King2, S("G8"), Piece::OtherKing);
-    }
-    if (str == "O-O-O" && turn() == Player::Second)
+    Piece abs_piece = Piece::Pawn;
+    Piece promotion = Piece::None;
+    int from_x = -1, from_y = -1;
+    Square sq_to;
+    bool castling = str == "O-O" || str == "0-0" || str == "O-O-O" || str == "0-0-0";
+
+    if (castling)
     {
-        return Move(King2, S("C8"), Piece::OtherKing);
+        abs_piece = Piece::King;
+        from_x = 4;
+        sq_to = Square(str.length() == 3 ? 6 : 2, turn() == Player::First ? 0 : 7);
     }
-    if (str.length() == 2)
+    else
     {
-        Square sq(str), sq_from = sq;
-        if (turn() == Player::First)
+        size_t begin = 0;
+        if (std::string_view("KQRBN").find(str[0]) != std::string_view::npos)
         {
-            sq_from.move_down();
-            if (square(sq_from) != Piece::Pawn)
-                sq_from.move_down();
-            DCHECK(square(sq_from) == Piece::Pawn);
-        }
-        else
-        {
-            sq_from.move_up();
-            if (this->operator[](sq_from) != Piece::OtherPawn)
-                sq_from.move_up();
-            DCHECK(this->operator[](sq_from) == Piece::OtherPawn);
+            abs_piece = char_to_piece(str[0]);
+            begin = 1;
         }
 
-        return Move(sq_from, sq, square(sq_from));
-    }
-    if (str.length() == 3)
-    {
-        Square sq_to(str.substr(1));
-        switch (str[0])
+        // Promotion, "e8=Q" or "e8Q"
+        size_t end = str.length();
+        if (std::string_view("QRBN").find(str[end - 1]) != std::string_view::npos && abs_piece == Piece::Pawn)
         {
-        case 'Q': return _pgn_to_move<Piece::Queen>(sq_to);
-        case 'R': return _pgn_to_move<Piece::Rook>(sq_to);
-        case 'B': return _pgn_to_move<Piece::Bishop>(sq_to);
-        case 'N': return _pgn_to_move<Piece::Knight>(sq_to);
-        case 'K':
-        {
-            Piece piece = turn() == Player::First ? Piece::Knight : Piece::OtherKnight;
+            promotion = char_to_piece(str[end - 1]);
+            end--;
+            if (end > 0 && str[end - 1] == '=')
+                end--;
+        }
 
-            Square king_sq = turn() == Player::First ? King1 : King2;
-            Square sq;
-            DCHECK(king_sq.king_distance(sq_to) == 1);
+        if (end < begin + 2)
+            return Move();
+        char file = str[end - 2], rank = str[end - 1];
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8')
+            return Move();
+        sq_to = Square(file - 'a', rank - '1');
 
-            return Move(king_sq, sq_to, square(king_sq), square(sq_to));
-        }
+        // Disambiguation by the file, the rank or both, the capture mark is optional
+        for (size_t i = begin; i < end - 2; i++)
+        {
+            char c = str[i];
+            if (c >= 'a' && c <= 'h')
+                from_x = c - 'a';
+            else if (c >= '1' && c <= '8')
+                from_y = c - '1';
+            else if (c != 'x' && c != ':' && c != '-')
+                return Move();
         }
-
-        DCHECK_FAIL;
     }
 
-    // Promotion
-    if (str[str.length() - 2] == '=')
-    {
-        Square sq_to(str.substr(str.length() - 4, 2));
-        Square sq_from = sq_to; if (turn() == Player::First) sq_from.move_down(); else sq_from.move_up();
+    Move ret;
+    int results = 0;
+    Player player = turn();
+    Piece piece = player == Player::First ? abs_piece : other(abs_piece);
+    Piece captured = square(sq_to);
+    if (captured != Piece::None && (belongs_to(captured, player) || abs(captured) == Piece::King))
+        return Move();
 
-        // Capture
-        if (str[1] == 'x')
+    // The pieces are found from the target square, only their candidates are played
+    if (abs_piece != Piece::Pawn && !castling)
+    {
+        for (int i = 0; i < 64; i++)
         {
-            sq_from = Square(str[0] - 'a', sq_from.y());
-        }
+            if (table[i] != piece)
+                continue;
+            Square from(i);
+            if (from == sq_to || (from_x != -1 && from.x() != from_x) || (from_y != -1 && from.y() != from_y))
+                continue;
 
-        Piece promotion = char_to_piece(str.back()); if (turn() == Player::Second) promotion = other(promotion);
-        return Move(sq_from, sq_to, square(sq_from), square(sq_to), promotion);
+            bool reaches;
+            switch (abs_piece)
+            {
+            case Piece::Knight: reaches = std::abs(from.x() - sq_to.x()) * std::abs(from.y() - sq_to.y()) == 2; break;
+            case Piece::Bishop: reaches = bishop_move(from, sq_to); break;
+            case Piece::Rook: reaches = rook_move(from, sq_to); break;
+            case Piece::Queen: reaches = queen_move(from, sq_to); break;
+            default: reaches = from.king_distance(sq_to) == 1; break;
+            }
+
+            Move move(from, sq_to, piece, captured);
+            if (reaches && is_legal(move))
+            {
+                ret = move;
+                results++;
+            }
+        }
+        return results == 1 ? ret : Move();
     }
 
-    if (str.length() == 4)
+    // Also the pawn pushes and the captures, except the en passant and the promotions
+    int forward = player == Player::First ? 1 : -1;
+    int rank = sq_to.y() - forward;
+    if (promotion == Piece::None && rank >= 0 && rank < 8 && from_y == -1)
     {
-
-        Square sq_to(str.substr(2));
-
-        // Pawn capture
-        if (str[1] == 'x')
+        if (captured == Piece::None && (from_x == -1 || from_x == sq_to.x()))
         {
-            Square sq_from(str[0] - 'a', sq_to.y() - (turn() == Player::First ? 1 : -1));
-            return Move(sq_from, sq_to, square(sq_from), square(sq_to));
+            Square from(sq_to.x(), rank);
+            int start = player == Player::First ? 1 : 6;
+            if (square(from) == Piece::None && rank - forward == start)
+                from = Square(sq_to.x(), start);
+            if (square(from) != piece)
+                return Move();
+            Move move(from, sq_to, piece);
+            return is_legal(move) ? move : Move();
         }
-
-        SquareRequirements req(str.substr(1, 1));
-        switch (str[0])
+        if (captured != Piece::None && from_x != -1 && std::abs(from_x - sq_to.x()) == 1)
         {
-        case 'Q': return _pgn_to_move<Piece::Queen>(sq_to, req);
-        case 'R': return _pgn_to_move<Piece::Rook>(sq_to, req);
-        case 'B': return _pgn_to_move<Piece::Bishop>(sq_to, req);
-        case 'N': return _pgn_to_move<Piece::Knight>(sq_to, req);
-        default: DCHECK_FAIL;
+            Square from(from_x, rank);
+            if (square(from) != piece)
+                return Move();
+            Move move(from, sq_to, piece, captured);
+            return is_legal(move) ? move : Move();
         }
     }
-    DCHECK_FAIL;
-    return Move();
+
+    // The legal moves resolve the rest
+    for (Move move : all_legal_moves())
+    {
+        if (move.to() != sq_to || abs(move.piece()) != abs_piece)
+            continue;
+        if ((from_x != -1 && move.from().x() != from_x) || (from_y != -1 && move.from().y() != from_y))
+            continue;
+        if (abs(move.promotion()) != promotion)
+            continue;
+        ret = move;
+        results++;
+    }
+    return results == 1 ? ret : Move();
 }
@@ -0,0 +1,234 @@
+#include <thread>
+#include "chess_pgn_reader.h"
+#include "..\MemoryMappedFile.h"
+
+using namespace chess;
+
+namespace
+{
+    bool is_space(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    // The characters ending a token besides the spaces
+    bool is_delimiter(char c)
+    {
+        return is_space(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';';
+    }
+
+    size_t end_of_line(std::string_view text, size_t i)
+    {
+        size_t end = text.find('\n', i);
+        return end == std::string_view::npos ? text.size() : end;
+    }
+
+    // Skips the move number of "12.", "12..." or "12.e4"
+    std::string_view skip_move_number(std::string_view token)
+    {
+        size_t digits = 0;
+        while (digits < token.size() && token[digits] >= '0' && token[digits] <= '9')
+            digits++;
+        if (digits == 0 || digits == token.size())
+            return digits == 0 ? token : std::string_view();
+        if (token[digits] != '.')
+            return token;
+        while (digits < token.size() && token[digits] == '.')
+            digits++;
+        return token.substr(digits);
+    }
+
+    // A tag section starts at the line after the move text of the previous game
+    bool is_game_start(std::string_view text, size_t line)
+    {
+        if (text[line] != '[')
+            return false;
+        size_t i = line;
+        while (i > 0 && is_space(text[i - 1]))
+            i--;
+        if (i == 0)
+            return true;
+        size_t previous = text.rfind('\n', i - 1);
+        previous = previous == std::string_view::npos ? 0 : previous + 1;
+        return text[previous] != '[';
+    }
+}
+
+std::string_view PgnGame::tag(std::string_view name) const
+{
+    for (size_t i = tags.find('['); i != std::string_view::npos; i = tags.find('[', i + 1))
+    {
+        if (tags.substr(i + 1, name.size()) != name || i + 1 + name.size() >= tags.size() || !is_space(tags[i + 1 + name.size()]))
+            continue;
+        size_t begin = tags.find('"', i);
+        if (begin == std::string_view::npos)
+            break;
+        size_t end = tags.find('"', begin + 1);
+        if (end == std::string_view::npos)
+            break;
+        return tags.substr(begin + 1, end - begin - 1);
+    }
+    return std::string_view();
+}
+
+GameResult PgnReader::to_game_result(std::string_view token)
+{
+    if (token == "1-0") return GameResult::WhiteWins;
+    if (token == "0-1") return GameResult::BlackWins;
+    if (token == "1/2-1/2") return GameResult::Draw;
+    return GameResult::Unknown;
+}
+
+std::vector<std::string_view> PgnReader::split(std::string_view text, int count)
+{
+    std::vector<std::string_view> chunks;
+    size_t begin = 0;
+    for (int k = 1; k < count; k++)
+    {
+        size_t target = std::max(begin + 1, text.size() / count * k);
+        size_t boundary = std::string_view::npos;
+        for (size_t i = text.find("\n[", target - 1); i != std::string_view::npos; i = text.find("\n[", i + 1))
+        {
+            if (is_game_start(text, i + 1))
+            {
+                boundary = i + 1;
+                break;
+            }
+        }
+        if (boundary == std::string_view::npos)
+            break;
+        chunks.push_back(text.substr(begin, boundary - begin));
+        begin = boundary;
+    }
+    chunks.push_back(text.substr(begin));
+    return chunks;
+}
+
+size_t PgnReader::read_chunk(std::string_view text, const Callback& on_game, int thread) const
+{
+    const ChessPosition start;
+    PgnGame game;
+    size_t count = 0;
+    size_t tags_begin = 0;
+    bool movetext = false;      // a move of the current game was seen
+    int variation_depth = 0;    // inside (...)
+
+    auto finish_game = [&]()
+    {
+        if (movetext)
+        {
+            if (game.result == GameResult::Unknown)
+                game.result = to_game_result(game.tag("Result"));
+            on_game(game, thread);
+            count++;
+        }
+        game.tags = std::string_view();
+        game.result = GameResult::Unknown;
+        game.moves.clear();
+        game.position = start;
+        game.valid = true;
+        movetext = false;
+        variation_depth = 0;
+    };
+
+    game.position = start;
+    size_t i = 0;
+    while (i < text.size())
+    {
+        char c = text[i];
+        bool line_start = i == 0 || text[i - 1] == '\n';
+        if (line_start && c == '[' && variation_depth == 0)
+        {
+            // A tag of the next game, the previous one may not have ended with a termination marker
+            if (movetext)
+                finish_game();
+            if (game.tags.empty())
+                tags_begin = i;
+            i = end_of_line(text, i);
+            game.tags = text.substr(tags_begin, i - tags_begin);
+            continue;
+        }
+        if ((line_start && c == '%') || c == ';')
+        {
+            i = end_of_line(text, i);
+            continue;
+        }
+        if (c == '{')
+        {
+            size_t end = text.find('}', i);
+            i = end == std::string_view::npos ? text.size() : end + 1;
+            continue;
+        }
+        if (c == '(' || c == ')')
+        {
+            variation_depth = c == '(' ? variation_depth + 1 : std::max(variation_depth - 1, 0);
+            i++;
+            continue;
+        }
+        if (is_delimiter(c))
+        {
+            i++;
+            continue;
+        }
+
+        size_t begin = i;
+        while (i < text.size() && !is_delimiter(text[i]))
+            i++;
+        if (variation_depth > 0)
+            continue;
+
+        std::string_view token = skip_move_number(text.substr(begin, i - begin));
+        if (token.empty() || token[0] == '$' || token[0] == '!' || token[0] == '?')
+            continue;
+        if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*")
+        {
+            game.result = to_game_result(token);
+            finish_game();
+            continue;
+        }
+
+        movetext = true;
+        if (!game.valid || int(game.moves.size()) >= max_plies)
+            continue;
+        Move move = game.position.pgn_to_move(token);
+        if (!move.is_valid())
+        {
+            game.valid = false;
+            continue;
+        }
+        game.moves.push_back(move);
+        game.position += move;
+    }
+    finish_game();
+    return count;
+}
+
+size_t PgnReader::read(std::string_view text, const Callback& on_game) const
+{
+    // Before the threads, the first position initializes the Zobrist keys
+    ChessPosition::initialize_transposition_tables();
+
+    std::vector<std::string_view> chunks = split(text, threads);
+    if (chunks.size() == 1)
+        return read_chunk(chunks[0], on_game, 0);
+
+    std::vector<size_t> counts(chunks.size());
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < chunks.size(); t++)
+        pool.emplace_back([&, t]() { counts[t] = read_chunk(chunks[t], on_game, int(t)); });
+    for (auto& thread : pool)
+        thread.join();
+
+    size_t total = 0;
+    for (size_t count : counts)
+        total += count;
+    return total;
+}
+
+size_t PgnReader::read_file(const std::string& path, const Callback& on_game) const
+{
+    MemoryMappedFile file;
+    if (!file.open_read(path))
+        return 0;
+    return read(std::string_view(reinterpret_cast<const char*>(file.data()), file.size()), on_game);
+}
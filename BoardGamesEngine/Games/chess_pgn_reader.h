@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "chess.h"
+
+namespace chess
+{
+    enum class GameResult
+    {
+        Unknown = 0,
+        WhiteWins,
+        BlackWins,
+        Draw
+    };
+
+    /// <summary>
+    /// A game of a PGN database. The views point into the text being read and are valid only during the callback.
+    /// </summary>
+    struct PgnGame
+    {
+        std::string_view tags;          // the tag pairs section, e.g. "[Event \"x\"]\n[Result \"1-0\"]"
+        GameResult result = GameResult::Unknown;
+        std::vector<Move> moves;        // from the initial position, up to max_plies
+        ChessPosition position;         // after the moves
+        bool valid = true;              // false if a move couldn't be parsed, the moves before it are kept
+
+        /// <summary>
+        /// The value of a tag, e.g. tag("White"), empty if the game doesn't have it.
+        /// </summary>
+        std::string_view tag(std::string_view name) const;
+    };
+
+    /// <summary>
+    /// Reads PGN databases: tag pairs, comments, variations, NAGs and several games in a text.
+    /// The file is mapped to the memory and split at the game boundaries into a chunk per thread,
+    /// the tokens are views into the text and the moves are resolved by pgn_to_move without copies.
+    /// </summary>
+    class PgnReader
+    {
+    public:
+        /// <summary>
+        /// Called for each game with the index of the thread reading it, concurrently from the threads.
+        /// The games of a thread come in the order of the text.
+        /// </summary>
+        using Callback = std::function<void(const PgnGame& game, int thread)>;
+
+        /// <summary>
+        /// Only the first max_plies moves of the games are parsed, the rest of the move text is skipped.
+        /// </summary>
+        PgnReader(int threads = 1, int max_plies = INT_MAX) : threads(std::max(threads, 1)), max_plies(max_plies) {}
+
+        /// <summary>
+        /// Returns the number of games read, the games without moves are skipped.
+        /// </summary>
+        size_t read(std::string_view text, const Callback& on_game) const;
+
+        /// <summary>
+        /// Returns the number of games read, 0 if the file can't be mapped.
+        /// </summary>
+        size_t read_file(const std::string& path, const Callback& on_game) const;
+
+        /// <summary>
+        /// Splits the text into at most count chunks, each starting at the tag section of a game.
+        /// </summary>
+        static std::vector<std::string_view> split(std::string_view text, int count);
+
+        static GameResult to_game_result(std::string_view token);
+
+        int thread_count() const { return threads; }
+
+    private:
+        size_t read_chunk(std::string_view chunk, const Callback& on_game, int thread) const;
+
+        int threads;
+        int max_plies;
+    };
+}
@@ -0,0 +1,254 @@
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include "chess.h"
+
+using namespace chess;
+
+namespace
+{
+    // The tables are written as the board is seen by white, the 8th rank first
+    typedef int16_t Table[64];
+
+    const Table pawn_mg = {
+          0,   0,   0,   0,   0,   0,   0,   0,
+         50,  50,  50,  50,  50,  50,  50,  50,
+         10,  10,  20,  30,  30,  20,  10,  10,
+          5,   5,  10,  25,  25,  10,   5,   5,
+          0,   0,   0,  20,  20,   0,   0,   0,
+          5,  -5, -10,   0,   0, -10,  -5,   5,
+          5,  10,  10, -20, -20,  10,  10,   5,
+          0,   0,   0,   0,   0,   0,   0,   0 };
+
+    const Table pawn_eg = {
+          0,   0,   0,   0,   0,   0,   0,   0,
+         80,  80,  80,  80,  80,  80,  80,  80,
+         50,  50,  50,  50,  50,  50,  50,  50,
+         30,  30,  30,  30,  30,  30,  30,  30,
+         20,  20,  20,  20,  20,  20,  20,  20,
+         10,  10,  10,  10,  10,  10,  10,  10,
+          0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0 };
+
+    const Table knight = {
+        -50, -40, -30, -30, -30, -30, -40, -50,
+        -40, -20,   0,   0,   0,   0, -20, -40,
+        -30,   0,  10,  15,  15,  10,   0, -30,
+        -30,   5,  15,  20,  20,  15,   5, -30,
+        -30,   0,  15,  20,  20,  15,   0, -30,
+        -30,   5,  10,  15,  15,  10,   5, -30,
+        -40, -20,   0,   5,   5,   0, -20, -40,
+        -50, -40, -30, -30, -30, -30, -40, -50 };
+
+    const Table bishop = {
+        -20, -10, -10, -10, -10, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,  10,  10,   5,   0, -10,
+        -10,   5,   5,  10,  10,   5,   5, -10,
+        -10,   0,  10,  10,  10,  10,   0, -10,
+        -10,  10,  10,  10,  10,  10,  10, -10,
+        -10,   5,   0,   0,   0,   0,   5, -10,
+        -20, -10, -10, -10, -10, -10, -10, -20 };
+
+    const Table rook = {
+          0,   0,   0,   0,   0,   0,   0,   0,
+          5,  10,  10,  10,  10,  10,  10,   5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+          0,   0,   0,   5,   5,   0,   0,   0 };
+
+    const Table queen = {
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,   5,   5,   5,   0, -10,
+         -5,   0,   5,   5,   5,   5,   0,  -5,
+          0,   0,   5,   5,   5,   5,   0,  -5,
+        -10,   5,   5,   5,   5,   5,   0, -10,
+        -10,   0,   5,   0,   0,   0,   0, -10,
+        -20, -10, -10,  -5,  -5, -10, -10, -20 };
+
+    const Table king_mg = {
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -20, -30, -30, -40, -40, -30, -30, -20,
+        -10, -20, -20, -20, -20, -20, -20, -10,
+         20,  20,   0,   0,   0,   0,  20,  20,
+         20,  30,  10,   0,   0,  10,  30,  20 };
+
+    const Table king_eg = {
+        -50, -40, -30, -20, -20, -30, -40, -50,
+        -30, -20, -10,   0,   0, -10, -20, -30,
+        -30, -10,  20,  30,  30,  20, -10, -30,
+        -30, -10,  30,  40,  40,  30, -10, -30,
+        -30, -10,  30,  40,  40,  30, -10, -30,
+        -30, -10,  20,  30,  30,  20, -10, -30,
+        -30, -30,   0,   0,   0,   0, -30, -30,
+        -50, -30, -30, -30, -30, -30, -30, -50 };
+
+    // Indexed by abs(piece): None, King, Queen, Rook, Bishop, Knight, Pawn
+    const Table* const tables_mg[7] = { nullptr, &king_mg, &queen, &rook, &bishop, &knight, &pawn_mg };
+    const Table* const tables_eg[7] = { nullptr, &king_eg, &queen, &rook, &bishop, &knight, &pawn_eg };
+    const int16_t values_mg[7] = { 0, 0, 1025, 477, 365, 337, 82 };
+    const int16_t values_eg[7] = { 0, 0, 936, 512, 297, 281, 94 };
+    const int phases[7] = { 0, 0, 4, 2, 1, 1, 0 };
+
+    const char* const piece_names[7] = { "none", "king", "queen", "rook", "bishop", "knight", "pawn" };
+
+    // From the order of the tables to the square, the 8th rank first
+    int table_square(int i)
+    {
+        return (7 - i / 8) * 8 + i % 8;
+    }
+
+    int piece_index(const std::string& name)
+    {
+        for (int i = 1; i < 7; i++)
+            if (name == piece_names[i])
+                return i;
+        return -1;
+    }
+}
+
+namespace
+{
+    // The threads turning the tracking on at once set the weights once
+    std::once_flag pst_initialized;
+
+    void set_default_pst()
+    {
+        for (int j = 0; j < 64; j++)
+        {
+            ChessPosition::pst_mg[0][j] = 0;
+            ChessPosition::pst_eg[0][j] = 0;
+        }
+        for (int i = 1; i < 7; i++)
+        {
+            for (int j = 0; j < 64; j++)
+            {
+                ChessPosition::pst_mg[i][table_square(j)] = values_mg[i] + (*tables_mg[i])[j];
+                ChessPosition::pst_eg[i][table_square(j)] = values_eg[i] + (*tables_eg[i])[j];
+            }
+            ChessPosition::pst_phase[i] = phases[i];
+        }
+        ChessPosition::pst_phase[0] = 0;
+    }
+}
+
+void ChessPosition::initialize_pst(bool force)
+{
+    std::call_once(pst_initialized, set_default_pst);
+    if (force)
+        set_default_pst();
+}
+
+/*
+Format of the file, the tokens are separated by whitespaces, # starts a comment till the end of the line:
+    mg <piece> <64 values, the 8th rank first>
+    eg <piece> <64 values>
+    phase <piece> <value>
+where <piece> is one of king, queen, rook, bishop, knight, pawn.
+The values not present in the file keep the defaults.
+*/
+bool ChessPosition::load_pst(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::stringstream ss;
+    std::string line;
+    while (std::getline(in, line))
+        ss << line.substr(0, line.find('#')) << '\n';
+
+    initialize_pst();
+    int16_t mg[7][64], eg[7][64];
+    int phase[7];
+    std::copy(&pst_mg[0][0], &pst_mg[0][0] + 7 * 64, &mg[0][0]);
+    std::copy(&pst_eg[0][0], &pst_eg[0][0] + 7 * 64, &eg[0][0]);
+    std::copy(pst_phase, pst_phase + 7, phase);
+
+    std::string kind, name;
+    while (ss >> kind)
+    {
+        if (!(ss >> name))
+            return false;
+        int piece = piece_index(name);
+        if (piece == -1)
+            return false;
+
+        if (kind == "phase")
+        {
+            if (!(ss >> phase[piece]))
+                return false;
+        }
+        else if (kind == "mg" || kind == "eg")
+        {
+            int16_t (&table)[64] = kind == "mg" ? mg[piece] : eg[piece];
+            for (int j = 0; j < 64; j++)
+            {
+                if (!(ss >> table[table_square(j)]))
+                    return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    std::copy(&mg[0][0], &mg[0][0] + 7 * 64, &pst_mg[0][0]);
+    std::copy(&eg[0][0], &eg[0][0] + 7 * 64, &pst_eg[0][0]);
+    std::copy(phase, phase + 7, pst_phase);
+    return true;
+}
+
+bool ChessPosition::save_pst(const std::string& path)
+{
+    initialize_pst();
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    for (int i = 1; i < 7; i++)
+    {
+        for (const char* kind : { "mg", "eg" })
+        {
+            const int16_t* table = std::string(kind) == "mg" ? pst_mg[i] : pst_eg[i];
+            out << kind << ' ' << piece_names[i] << '\n';
+            for (int j = 0; j < 64; j++)
+                out << table[table_square(j)] << (j % 8 == 7 ? '\n' : ' ');
+        }
+        out << "phase " << piece_names[i] << ' ' << pst_phase[i] << "\n\n";
+    }
+    return bool(out);
+}
+
+ChessPosition::PstScore ChessPosition::get_pst_full() const
+{
+    initialize_pst();
+    PstScore ret;
+    for (int i = 0; i < 64; i++)
+    {
+        Piece piece = table[i];
+        if (piece == Piece::None)
+            continue;
+        int index = int8_t(abs(piece));
+        if (belongs_to(piece, Player::First))
+        {
+            ret.mg += pst_mg[index][i];
+            ret.eg += pst_eg[index][i];
+        }
+        else
+        {
+            ret.mg -= pst_mg[index][i ^ 56];
+            ret.eg -= pst_eg[index][i ^ 56];
+        }
+        ret.phase += pst_phase[index];
+    }
+    return ret;
+}
@@ -0,0 +1,187 @@
+#include <array>
+#include <bit>
+#include "chess.h"
+
+using namespace chess;
+
+namespace
+{
+    // Values for the exchange, the king can't be captured but it has to be the last to capture
+    inline int see_value(Piece piece)
+    {
+        piece = abs(piece);
+        return piece == Piece::King ? 100 : piece_to_value(piece);
+    }
+
+    constexpr uint64_t bit(int x, int y)
+    {
+        return (x >= 0 && x < 8 && y >= 0 && y < 8) ? uint64_t(1) << (y * 8 + x) : 0;
+    }
+
+    struct AttackTables
+    {
+        std::array<uint64_t, 64> knight{};
+        std::array<uint64_t, 64> king{};
+        std::array<uint64_t, 64> white_pawn{};  // squares of the white pawns attacking the square
+        std::array<uint64_t, 64> black_pawn{};
+    };
+
+    constexpr AttackTables make_attack_tables()
+    {
+        AttackTables ret;
+        for (int sq = 0; sq < 64; sq++)
+        {
+            int x = sq % 8, y = sq / 8;
+            ret.knight[sq] = bit(x + 1, y + 2) | bit(x - 1, y + 2) | bit(x + 2, y + 1) | bit(x - 2, y + 1)
+                | bit(x + 1, y - 2) | bit(x - 1, y - 2) | bit(x + 2, y - 1) | bit(x - 2, y - 1);
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++)
+                    if (dx != 0 || dy != 0)
+                        ret.king[sq] |= bit(x + dx, y + dy);
+            ret.white_pawn[sq] = bit(x - 1, y - 1) | bit(x + 1, y - 1);
+            ret.black_pawn[sq] = bit(x - 1, y + 1) | bit(x + 1, y + 1);
+        }
+        return ret;
+    }
+
+    constexpr AttackTables attack_tables = make_attack_tables();
+
+    constexpr int directions[8][2] = { {0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1} };
+
+    /// <summary>
+    /// Attacker sets of the exchange on a square, the pieces taking part are removed one by one.
+    /// </summary>
+    class Exchange
+    {
+    public:
+        Exchange(const Piece* table, Square target) : table(table), tx(target.x()), ty(target.y())
+        {
+            int t = ty * 8 + tx;
+            add_matching(attack_tables.knight[t], Piece::Knight);
+            add_matching(attack_tables.king[t], Piece::King);
+            add_matching(attack_tables.white_pawn[t], Piece::Pawn, Player::First);
+            add_matching(attack_tables.black_pawn[t], Piece::Pawn, Player::Second);
+            for (int d = 0; d < 8; d++)
+                scan(tx, ty, directions[d][0], directions[d][1]);
+        }
+
+        /// <summary>
+        /// Removes the piece which captured, the slider behind it (if any) attacks the target now.
+        /// </summary>
+        void remove(int sq)
+        {
+            uint64_t b = uint64_t(1) << sq;
+            attackers &= ~b;
+            removed |= b;
+
+            int dx = sq % 8 - tx, dy = sq / 8 - ty;
+            if (dx != 0 && dy != 0 && std::abs(dx) != std::abs(dy))
+                return;
+            scan(sq % 8, sq / 8, (dx > 0) - (dx < 0), (dy > 0) - (dy < 0));
+        }
+
+        /// <summary>
+        /// The square of the least valuable attacker of the player, -1 if none.
+        /// </summary>
+        int least_valuable(Player player) const
+        {
+            int ret = -1, ret_value = 1000;
+            for (uint64_t set = attackers; set != 0; set &= set - 1)
+            {
+                int sq = std::countr_zero(set);
+                Piece piece = table[sq];
+                if (!belongs_to(piece, player))
+                    continue;
+                int value = see_value(piece);
+                if (value < ret_value)
+                {
+                    ret = sq;
+                    ret_value = value;
+                }
+            }
+            return ret;
+        }
+
+        bool any(Player player) const { return least_valuable(player) != -1; }
+
+    private:
+        const Piece* table;
+        int tx, ty;
+        uint64_t attackers = 0;
+        uint64_t removed = 0;
+
+        bool occupied(int sq) const { return table[sq] != Piece::None && (removed & (uint64_t(1) << sq)) == 0; }
+
+        void add_matching(uint64_t candidates, Piece abs_piece, Player player = Player(0))
+        {
+            for (; candidates != 0; candidates &= candidates - 1)
+            {
+                int sq = std::countr_zero(candidates);
+                Piece piece = table[sq];
+                if (abs(piece) == abs_piece && (player == Player(0) || belongs_to(piece, player)))
+                    attackers |= uint64_t(1) << sq;
+            }
+        }
+
+        // The first piece from (x, y) in the direction, added if it is a slider moving that way
+        void scan(int x, int y, int dx, int dy)
+        {
+            for (x += dx, y += dy; x >= 0 && x < 8 && y >= 0 && y < 8; x += dx, y += dy)
+            {
+                int sq = y * 8 + x;
+                if (!occupied(sq))
+                    continue;
+                Piece piece = abs(table[sq]);
+                bool diagonal = dx != 0 && dy != 0;
+                if (piece == Piece::Queen || piece == (diagonal ? Piece::Bishop : Piece::Rook))
+                    attackers |= uint64_t(1) << sq;
+                return;
+            }
+        }
+    };
+}
+
+int ChessPosition::see(Move move) const
+{
+    Square from = move.from();
+    Square to = move.to();
+    Player player = sgn(move.piece());
+
+    // gain[d] is the balance of the side making the capture d, if its piece isn't recaptured
+    int gain[32];
+    int d = 0;
+    gain[0] = see_value(move.captured());
+    Piece on_target = move.piece();
+    if (move.promotion() != Piece::None)
+    {
+        gain[0] += see_value(move.promotion()) - see_value(move.piece());
+        on_target = move.promotion();
+    }
+
+    Exchange exchange(table, to);
+    int attacker = int(from);
+    do
+    {
+        d++;
+        gain[d] = see_value(on_target) - gain[d - 1];
+        exchange.remove(attacker);
+        player = oponent(player);
+        attacker = exchange.least_valuable(player);
+        if (attacker == -1)
+            break;
+        on_target = table[attacker];
+
+        // The king captures only if it isn't captured back
+        if (abs(on_target) == Piece::King)
+        {
+            Exchange after = exchange;
+            after.remove(attacker);
+            if (after.any(oponent(player)))
+                break;
+        }
+    } while (d < 31);
+
+    while (--d)
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    return gain[0];
+}
@@ -0,0 +1,278 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "core.h"
+
+/// <summary>
+/// Sequential probability ratio test of H0: elo = elo0 against H1: elo = elo1,
+/// with the normal approximation of the game scores (generalized SPRT).
+/// </summary>
+struct Sprt
+{
+	double elo0 = 0;
+	double elo1 = 5;
+	double alpha = 0.05;	// the false positives, accepting H1 when H0 is true
+	double beta = 0.05;		// the false negatives
+
+	double lower_bound() const { return std::log(beta / (1 - alpha)); }
+	double upper_bound() const { return std::log((1 - beta) / alpha); }
+
+	/// <summary>
+	/// The log-likelihood ratio of the results, 0 without games.
+	/// </summary>
+	double llr(size_t wins, size_t draws, size_t losses) const
+	{
+		if (wins + draws + losses == 0)
+			return 0;
+
+		// Half a game of each outcome as a prior, so the variance isn't 0 for e.g. the first wins
+		double w = wins + 0.5, d = draws + 0.5, l = losses + 0.5;
+		double games = w + d + l;
+		double score = (w + d / 2) / games;
+		double variance = (w + d / 4) / games - score * score;
+		double score0 = expected_score(elo0), score1 = expected_score(elo1);
+		return games * (score1 - score0) * (2 * score - score0 - score1) / (2 * variance);
+	}
+
+	static double expected_score(double elo)
+	{
+		return 1 / (1 + std::pow(10.0, -elo / 400));
+	}
+};
+
+enum class SprtDecision
+{
+	None = 0,	// the games ran out before a bound was crossed
+	H0,			// accepted elo0, e.g. the change isn't an improvement
+	H1			// accepted elo1
+};
+
+/// <summary>
+/// The results of a match from the point of view of the first engine.
+/// </summary>
+struct MatchResult
+{
+	size_t wins = 0;
+	size_t draws = 0;
+	size_t losses = 0;
+	size_t plies = 0;
+	double seconds = 0;
+	double llr = 0;
+	SprtDecision decision = SprtDecision::None;
+
+	size_t games() const { return wins + draws + losses; }
+
+	double score() const { return games() > 0 ? (wins + draws / 2.0) / games() : 0.5; }
+
+	/// <summary>
+	/// The Elo difference of the score, infinite for all wins or all losses.
+	/// </summary>
+	double elo() const { return score_to_elo(score()); }
+
+	/// <summary>
+	/// The half width of the 95% confidence interval of elo().
+	/// </summary>
+	double elo_error() const
+	{
+		if (games() == 0)
+			return 0;
+		if (wins == games() || losses == games())
+			return std::numeric_limits<double>::infinity();
+		double s = score();
+		double deviation = std::sqrt(std::max(0.0, (wins + draws / 4.0) / games() - s * s) / games());
+		return (score_to_elo(std::min(s + 1.96 * deviation, 1.0)) - score_to_elo(std::max(s - 1.96 * deviation, 0.0))) / 2;
+	}
+
+	static double score_to_elo(double score)
+	{
+		return -400 * std::log10(1 / score - 1);
+	}
+};
+
+/// <summary>
+/// Plays games between two engines on multiple threads, e.g. two killer options or two evaluation weights.
+/// Each opening is played twice with the colors swapped. A game ends with a winning move (easycheck_winning_move),
+/// without legal moves (a loss if checked, a draw otherwise), by a third repetition or 100 reversible plies
+/// in the games with hashes and reversible moves, or as a draw after max_plies.
+/// The threads add the results to a single atomic counter, so the SPRT sees consistent totals without locks.
+/// </summary>
+template <typename Pos>
+	requires BoardPosition<Pos>
+class Match
+{
+	using Move = typename Pos::Move;
+
+	// As in MinMax, the history of the positions since the last irreversible move is kept
+	static constexpr bool detects_repetitions = Pos::implements_hash() && requires(Move move) { move.is_reversible(); };
+
+public:
+	/// <summary>
+	/// Returns the move to play, invalid if there is no legal move.
+	/// The history are the keys of the positions before, as the history of MinMax::FindBestMove.
+	/// Called concurrently from the threads.
+	/// </summary>
+	using Engine = std::function<Move(const Pos& position, const std::vector<uint64_t>& history)>;
+
+	struct Options
+	{
+		size_t games = 100;
+		int threads = 1;
+		int max_plies = 400;
+		std::optional<Sprt> sprt;	// stops the match at a decision
+	};
+
+	Match(Engine first, Engine second, std::vector<Pos> openings = { Pos() }) :
+		engines{ std::move(first), std::move(second) },
+		openings(std::move(openings))
+	{
+		DCHECK(!this->openings.empty());
+	}
+
+	MatchResult Run(const Options& options) const
+	{
+		DCHECK(options.threads > 0 && options.games <= Score::max_games);
+		auto start = std::chrono::steady_clock::now();
+
+		Score score;
+		std::atomic<size_t> next_game = 0;
+		std::atomic<size_t> plies = 0;
+		std::atomic<int> decision = int(SprtDecision::None);
+		auto worker = [&]()
+		{
+			for (size_t game = next_game++; game < options.games && decision == int(SprtDecision::None); game = next_game++)
+			{
+				// Game 2i and 2i+1 play opening i with the colors swapped
+				const Pos& opening = openings[(game / 2) % openings.size()];
+				bool first_starts = game % 2 == 0;
+				int game_plies;
+				std::optional<Player> winner = Play(opening,
+					engines[first_starts ? 0 : 1], engines[first_starts ? 1 : 0], options.max_plies, game_plies);
+				plies += game_plies;
+
+				auto [wins, draws, losses] = score.add(!winner ? 0 : (*winner == opening.turn()) == first_starts ? 1 : -1);
+				if (options.sprt)
+				{
+					// The first crossing decides, the games in progress are still counted
+					double llr = options.sprt->llr(wins, draws, losses);
+					int none = int(SprtDecision::None);
+					if (llr >= options.sprt->upper_bound())
+						decision.compare_exchange_strong(none, int(SprtDecision::H1));
+					else if (llr <= options.sprt->lower_bound())
+						decision.compare_exchange_strong(none, int(SprtDecision::H0));
+				}
+			}
+		};
+
+		if (options.threads == 1)
+		{
+			worker();
+		}
+		else
+		{
+			std::vector<std::thread> pool;
+			for (int i = 0; i < options.threads; i++)
+				pool.emplace_back(worker);
+			for (auto& thread : pool)
+				thread.join();
+		}
+
+		MatchResult result;
+		std::tie(result.wins, result.draws, result.losses) = score.get();
+		result.plies = plies;
+		result.decision = SprtDecision(decision.load());
+		if (options.sprt)
+			result.llr = options.sprt->llr(result.wins, result.draws, result.losses);
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return result;
+	}
+
+	/// <summary>
+	/// Plays a game from the position, mover plays the side to move. Returns the winner, nullopt for a draw.
+	/// </summary>
+	static std::optional<Player> Play(const Pos& start, const Engine& mover, const Engine& other, int max_plies, int& plies)
+	{
+		Pos position = start;
+		std::vector<uint64_t> history;
+		for (plies = 0; plies < max_plies; plies++)
+		{
+			const Engine& engine = plies % 2 == 0 ? mover : other;
+			Move move = engine(position, history);
+			if (!move.is_valid())
+			{
+				if (position.is_checked(position.turn()))
+					return oponent(position.turn());
+				return std::nullopt;
+			}
+
+			if (position.easycheck_winning_move(move))
+			{
+				plies++;
+				return position.turn();
+			}
+
+			if constexpr (detects_repetitions)
+			{
+				if (move.is_reversible())
+					history.push_back(position.template get_hash<true>());
+				else
+					history.clear();
+			}
+			position += move;
+
+			if constexpr (detects_repetitions)
+			{
+				uint64_t key = position.template get_hash<true>();
+				if (std::count(history.begin(), history.end(), key) >= 2 || history.size() >= 100)
+				{
+					plies++;
+					return std::nullopt;
+				}
+			}
+		}
+		return std::nullopt;
+	}
+
+private:
+	/// <summary>
+	/// Wins, draws and losses in 21 bits each of a single word, added by one fetch_add.
+	/// </summary>
+	class Score
+	{
+	public:
+		static constexpr size_t max_games = (size_t(1) << 21) - 1;
+
+		// outcome: 1 win, 0 draw, -1 loss
+		std::tuple<size_t, size_t, size_t> add(int outcome)
+		{
+			uint64_t one = uint64_t(1) << (outcome > 0 ? 0 : outcome == 0 ? bits : 2 * bits);
+			return unpack(packed.fetch_add(one) + one);
+		}
+
+		std::tuple<size_t, size_t, size_t> get() const
+		{
+			return unpack(packed.load());
+		}
+
+	private:
+		static constexpr int bits = 21;
+		static constexpr uint64_t mask = (uint64_t(1) << bits) - 1;
+
+		static std::tuple<size_t, size_t, size_t> unpack(uint64_t value)
+		{
+			return { size_t(value & mask), size_t(value >> bits & mask), size_t(value >> 2 * bits & mask) };
+		}
+
+		std::atomic<uint64_t> packed = 0;
+	};
+
+	Engine engines[2];
+	std::vector<Pos> openings;
+};
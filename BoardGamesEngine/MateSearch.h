@@ -0,0 +1,369 @@
+#pragma once
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "core.h"
+
+/// <summary>
+/// Result of a mate search, from the perspective of the attacker (the player to move).
+/// </summary>
+enum class MateResult
+{
+	Unknown = 0,	// the node budget was exhausted
+	Proven = 1,		// mate in at most the given number of moves
+	Refuted = 2		// no mate in the given number of moves
+};
+
+/// <summary>
+/// Specialized solver for "mate in N" puzzles. Unlike MinMax it doesn't evaluate positions,
+/// it proves or refutes that the attacker forces a mate in at most N moves.
+/// - The attacker tries the moves giving check first, in the checks only mode it tries nothing else.
+/// - The last move of the attacker has to give check, so the other moves are not searched there.
+/// - Transposition table: the proven and refuted distances are kept per position, a position
+///   known to be mated in fewer moves or known to hold for more moves isn't searched again.
+/// - Iterative deepening over N finds the shortest mate: a mate in N is searched only once no mate
+///   in fewer moves exists, so no longer mate is ever proven. The line follows the longest defense.
+/// A winning move of MNK-like games (easycheck_winning_move) counts as a mate.
+/// </summary>
+template <typename Pos>
+	requires BoardPosition<Pos>
+class MateSearch
+{
+	using Move = typename Pos::Move;
+
+public:
+	struct Options
+	{
+		// Only moves giving check are considered for the attacker
+		bool checks_only = false;
+
+		// Node budget for a single search, zero for no budget
+		size_t max_nodes = 0;
+	};
+
+	struct Result
+	{
+		MateResult result = MateResult::Unknown;
+
+		// Number of the attacker's moves to mate, zero if not found
+		int mate_in = 0;
+
+		// Moves of both players, ending with the mate
+		std::vector<Move> line;
+	};
+
+	MateSearch(const Pos& pos, Options options = Options()) : position(pos), options(options)
+	{
+		position.turn_off_all_trackings();
+		attacker = position.turn();
+	}
+
+	/// <summary>
+	/// Finds the shortest mate in up to max_moves moves.
+	/// Refuted means there is no mate in max_moves or fewer.
+	/// </summary>
+	Result Solve(int max_moves)
+	{
+		Result ret;
+		for (int n = 1; n <= max_moves; n++)
+		{
+			ret.result = Prove(n);
+			if (ret.result == MateResult::Proven)
+			{
+				ret.mate_in = n;
+				ret.line = line(n);
+				return ret;
+			}
+			if (ret.result == MateResult::Unknown)
+				return ret;
+		}
+		return ret;
+	}
+
+	/// <summary>
+	/// Proves or refutes a mate in at most n moves.
+	/// </summary>
+	MateResult Prove(int n)
+	{
+		aborted = false;
+		bool proven = attack(n);
+		if (aborted)
+			return MateResult::Unknown;
+		return proven ? MateResult::Proven : MateResult::Refuted;
+	}
+
+	static Result FindMate(const Pos& pos, int max_moves, bool checks_only = false)
+	{
+		MateSearch search(pos, Options{ checks_only, 0 });
+		return search.Solve(max_moves);
+	}
+
+	/// <summary>
+	/// Number of positions visited since the construction.
+	/// </summary>
+	size_t nodes() const { return _nodes; }
+
+private:
+	// Distances of the attacker's moves known for a position, the entries of the transposition table
+	struct Distances
+	{
+		int proven = std::numeric_limits<int>::max();	// mate in this many moves or fewer
+		int refuted = -1;								// no mate in this many moves
+	};
+
+	Pos position;
+	Options options;
+	Player attacker;
+	int ply = 0;
+	size_t _nodes = 0;
+	bool aborted = false;
+	std::unordered_map<uint64_t, Distances> transpositions;
+
+	// Attacker's moves per ply, reused to avoid allocations during the search
+	std::vector<std::vector<Move>> checks_stack;
+	std::vector<std::vector<Move>> quiet_stack;
+
+	static constexpr bool hashed()
+	{
+		if constexpr (requires { Pos::implements_hash(); })
+			return Pos::implements_hash();
+		else
+			return false;
+	}
+
+	uint64_t key() const
+	{
+		if constexpr (requires(const Pos& pos) { pos.template get_hash<true>(); })
+			return position.template get_hash<true>();
+		else
+			return position.get_hash();
+	}
+
+	bool lookup(int n, bool& proven)
+	{
+		if constexpr (hashed())
+		{
+			auto it = transpositions.find(key());
+			if (it != transpositions.end())
+			{
+				if (it->second.proven <= n)
+				{
+					proven = true;
+					return true;
+				}
+				if (it->second.refuted >= n)
+				{
+					proven = false;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void store(int n, bool proven)
+	{
+		if constexpr (hashed())
+		{
+			if (aborted)
+				return;
+			Distances& b = transpositions[key()];
+			if (proven)
+				b.proven = std::min(b.proven, n);
+			else
+				b.refuted = std::max(b.refuted, n);
+		}
+	}
+
+	bool visit()
+	{
+		_nodes++;
+		if (options.max_nodes != 0 && _nodes > options.max_nodes)
+			aborted = true;
+		return !aborted;
+	}
+
+	/// <summary>
+	/// The attacker's moves with the checks first. Only checks if it is the last move or in the checks only mode.
+	/// </summary>
+	void generate(int n, std::vector<Move>& checks, std::vector<Move>& quiet)
+	{
+		checks.clear();
+		quiet.clear();
+		Player defender = oponent(attacker);
+		for (Move move : position.all_legal_moves_played())
+		{
+			bool winning = position.easycheck_winning_move(move);
+			bool check = position.is_checked(defender);
+			position -= move;
+
+			if (winning)
+			{
+				// Nothing beats an immediate win
+				checks.clear();
+				quiet.clear();
+				checks.push_back(move);
+				return;
+			}
+			if (check)
+				checks.push_back(move);
+			else if (n > 1 && !options.checks_only)
+				quiet.push_back(move);
+		}
+	}
+
+	/// <summary>
+	/// True if the attacker (to move) mates in at most n moves.
+	/// </summary>
+	bool attack(int n)
+	{
+		DCHECK(position.turn() == attacker);
+		if (!visit())
+			return false;
+
+		bool proven;
+		if (lookup(n, proven))
+			return proven;
+
+		// The stacks may grow in the recursion, so the moves are accessed by the index
+		if (int(checks_stack.size()) <= ply)
+		{
+			checks_stack.emplace_back();
+			quiet_stack.emplace_back();
+		}
+		generate(n, checks_stack[ply], quiet_stack[ply]);
+
+		proven = false;
+		for (int pass = 0; pass < 2 && !proven; pass++)
+		{
+			for (size_t i = 0; !proven && !aborted; i++)
+			{
+				auto& moves = pass == 0 ? checks_stack[ply] : quiet_stack[ply];
+				if (i >= moves.size())
+					break;
+				Move move = moves[i];
+				bool winning = position.easycheck_winning_move(move);
+				position += move;
+				ply++;
+				proven = winning || defend(n - 1);
+				ply--;
+				position -= move;
+			}
+		}
+
+		store(n, proven);
+		return proven;
+	}
+
+	/// <summary>
+	/// True if the defender (to move) is mated, or every reply allows a mate in at most n moves.
+	/// </summary>
+	bool defend(int n)
+	{
+		DCHECK(position.turn() != attacker);
+		if (!visit())
+			return false;
+
+		bool proven;
+		if (lookup(n, proven))
+			return proven;
+
+		bool any_moves = false;
+		proven = true;
+		for (Move move : position.all_legal_moves_played())
+		{
+			any_moves = true;
+			if (n == 0 || position.easycheck_winning_move(move) || !attack(n))
+				proven = false;
+			position -= move;
+			if (!proven || aborted)
+				break;
+		}
+
+		if (!any_moves)
+			proven = position.is_checked(position.turn());
+
+		store(n, proven);
+		return proven;
+	}
+
+	/// <summary>
+	/// Smallest number of moves in which the attacker mates, at most n, zero if none.
+	/// </summary>
+	int distance(int n)
+	{
+		for (int k = 1; k <= n; k++)
+		{
+			if (attack(k))
+				return k;
+		}
+		return 0;
+	}
+
+	/// <summary>
+	/// Mating line of the proven mate in n: the attacker plays the quickest mate,
+	/// the defender the reply that holds the longest.
+	/// The mate is proven, so the line is completed without the node budget.
+	/// </summary>
+	std::vector<Move> line(int n)
+	{
+		std::vector<Move> ret;
+		Pos start = position;
+		size_t max_nodes = options.max_nodes;
+		options.max_nodes = 0;
+		while (n > 0)
+		{
+			// Attacker's move
+			std::vector<Move> checks, quiet;
+			generate(n, checks, quiet);
+			checks.insert(checks.end(), quiet.begin(), quiet.end());
+			Move best = Move();
+			for (Move move : checks)
+			{
+				bool winning = position.easycheck_winning_move(move);
+				position += move;
+				bool proven = winning || defend(n - 1);
+				position -= move;
+				if (proven)
+				{
+					best = move;
+					break;
+				}
+			}
+			DCHECK(best.is_valid());
+			if (!best.is_valid())
+				break;
+			ret.push_back(best);
+			bool winning = position.easycheck_winning_move(best);
+			position += best;
+			if (winning || n == 1)
+				break;
+
+			// Defender's reply
+			std::vector<Move> replies;
+			for (Move move : position.all_legal_moves())
+				replies.push_back(move);
+			if (replies.empty())
+				break;
+			Move longest = replies[0];
+			int longest_distance = 0;
+			for (Move move : replies)
+			{
+				position += move;
+				int d = distance(n - 1);
+				position -= move;
+				if (d > longest_distance)
+				{
+					longest = move;
+					longest_distance = d;
+				}
+			}
+			ret.push_back(longest);
+			position += longest;
+			n = longest_distance;
+		}
+		position = start;
+		options.max_nodes = max_nodes;
+		return ret;
+	}
+};
@@ -0,0 +1,206 @@
+#include "MemoryMappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(_data, other._data);
+		std::swap(_size, other._size);
+		std::swap(file, other.file);
+#ifdef _WIN32
+		std::swap(mapping, other.mapping);
+#endif
+	}
+	return *this;
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+static bool map(HANDLE file, size_t size, bool writable, void*& mapping, uint8_t*& data)
+{
+	mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+		DWORD(uint64_t(size) >> 32), DWORD(size & 0xFFFFFFFF), nullptr);
+	if (mapping == nullptr)
+		return false;
+	data = static_cast<uint8_t*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+	return data != nullptr;
+}
+
+bool MemoryMappedFile::open_read(const std::string& path)
+{
+	close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || !map(file, size_t(size.QuadPart), false, mapping, _data))
+	{
+		close();
+		return false;
+	}
+	_size = size_t(size.QuadPart);
+	return true;
+}
+
+bool MemoryMappedFile::open_write(const std::string& path, size_t size)
+{
+	close();
+	if (size == 0)
+		return false;
+	file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER current;
+	if (!GetFileSizeEx(file, &current))
+	{
+		close();
+		return false;
+	}
+	if (size_t(current.QuadPart) != size)
+	{
+		LARGE_INTEGER new_size;
+		new_size.QuadPart = LONGLONG(size);
+		if (!SetFilePointerEx(file, new_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+		{
+			close();
+			return false;
+		}
+	}
+
+	if (!map(file, size, true, mapping, _data))
+	{
+		close();
+		return false;
+	}
+	_size = size;
+	return true;
+}
+
+void MemoryMappedFile::flush()
+{
+	if (_data != nullptr)
+	{
+		FlushViewOfFile(_data, _size);
+		FlushFileBuffers(file);
+	}
+}
+
+void MemoryMappedFile::close()
+{
+	if (_data != nullptr)
+		UnmapViewOfFile(_data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+	_data = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	_size = 0;
+}
+
+#else
+
+bool MemoryMappedFile::open_read(const std::string& path)
+{
+	close();
+	file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(file, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, file, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	_data = static_cast<uint8_t*>(data);
+	_size = size_t(st.st_size);
+	return true;
+}
+
+bool MemoryMappedFile::open_write(const std::string& path, size_t size)
+{
+	close();
+	if (size == 0)
+		return false;
+	file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(file, &st) != 0 || (size_t(st.st_size) != size && ftruncate(file, off_t(size)) != 0))
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	_data = static_cast<uint8_t*>(data);
+	_size = size;
+	return true;
+}
+
+void MemoryMappedFile::flush()
+{
+	if (_data != nullptr)
+		msync(_data, _size, MS_SYNC);
+}
+
+void MemoryMappedFile::close()
+{
+	if (_data != nullptr)
+		munmap(_data, _size);
+	if (file >= 0)
+		::close(file);
+	_data = nullptr;
+	file = -1;
+	_size = 0;
+}
+
+#endif
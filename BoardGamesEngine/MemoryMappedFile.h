@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// A file mapped into the memory, shared with the other processes mapping the same file.
+/// Changes are written back to the file by the operating system, flush() forces it.
+/// </summary>
+class MemoryMappedFile
+{
+public:
+	MemoryMappedFile() = default;
+	MemoryMappedFile(const MemoryMappedFile&) = delete;
+	MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+	MemoryMappedFile(MemoryMappedFile&& other) noexcept;
+	MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+	~MemoryMappedFile();
+
+	/// <summary>
+	/// Maps the whole file for reading, returns false if it doesn't exist or can't be mapped.
+	/// </summary>
+	bool open_read(const std::string& path);
+
+	/// <summary>
+	/// Maps the file for reading and writing. It is created if it doesn't exist,
+	/// and resized to the given size if it differs.
+	/// </summary>
+	bool open_write(const std::string& path, size_t size);
+
+	void flush();
+	void close();
+
+	bool is_open() const { return _data != nullptr; }
+	uint8_t* data() { return _data; }
+	const uint8_t* data() const { return _data; }
+	size_t size() const { return _size; }
+
+private:
+	uint8_t* _data = nullptr;
+	size_t _size = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int file = -1;
+#endif
+};
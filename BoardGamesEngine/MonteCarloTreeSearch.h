@@ -0,0 +1,401 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "core.h"
+#include "Playout.h"
+
+/// <summary>
+/// Monte Carlo Tree Search (UCT) for games with a large branching factor, where MinMax
+/// can't get past a few plies, e.g. Gomoku19 with 361 moves per node.
+/// With rave=true the selection is blended with all-moves-as-first statistics (RAVE),
+/// which requires std::hash of the moves, as MNK-like games provide.
+/// The tree nodes are allocated from a fixed size arena. A leaf gets its children only
+/// after it was visited a few times. Multiple threads share the tree (tree parallelization),
+/// a visit is counted before the playout so it works as a virtual loss,
+/// steering the other threads away from the same path.
+/// </summary>
+template <typename Pos, bool rave = false>
+	requires BoardPosition<Pos> && (!rave || requires(typename Pos::Move move) { { std::hash<typename Pos::Move>{}(move) } -> std::convertible_to<size_t>; })
+class MonteCarloTreeSearch
+{
+	using Move = typename Pos::Move;
+
+	// Outcome of a node from the perspective of the player who moved into it
+	enum class Terminal : uint8_t
+	{
+		None = 0,
+		Won,
+		Drawn
+	};
+
+	static constexpr uint32_t not_expanded = 0;	// the root is at 0, so no children block starts there
+	static constexpr uint32_t expanding = std::numeric_limits<uint32_t>::max();
+	static constexpr uint32_t no_moves = std::numeric_limits<uint32_t>::max() - 1;
+
+	struct Node
+	{
+		Move move;
+		std::atomic<Terminal> terminal{ Terminal::None };
+		uint32_t children_count = 0;
+		std::atomic<uint32_t> children{ not_expanded };
+		std::atomic<uint32_t> visits{ 0 };
+		std::atomic<uint32_t> score{ 0 };	// half points of the player who moved into the node
+		std::atomic<uint32_t> amaf_visits{ 0 };
+		std::atomic<uint32_t> amaf_score{ 0 };
+	};
+
+public:
+	struct Options
+	{
+		size_t playouts = 10000;				// zero for no playout budget
+		std::chrono::milliseconds time{ 0 };	// zero for no time budget
+		int threads = 1;
+		size_t memory = size_t(32) << 20;		// arena size in bytes
+		double exploration = 1.4;
+		uint32_t expand_threshold = 2;			// visits of a leaf before it gets expanded
+		int max_playout_plies = 1000;			// longer playouts are scored as draws
+		double rave_equivalence = 1000;			// visits at which UCT and RAVE values weigh the same
+		uint64_t seed = 0;
+	};
+
+	static Move FindBestMove(const Pos& position, size_t playouts, int threads = 1)
+	{
+		Options options;
+		options.playouts = playouts;
+		options.threads = threads;
+		return FindBestMove(position, options);
+	}
+
+	static Move FindBestMove(const Pos& position, const Options& options)
+	{
+		MonteCarloTreeSearch mcts(position, options);
+		return mcts.Search();
+	}
+
+	MonteCarloTreeSearch(const Pos& position, const Options& options = Options()) :
+		position(position),
+		options(options)
+	{
+		DCHECK(options.playouts > 0 || options.time.count() > 0);
+		DCHECK(options.threads > 0);
+		this->position.turn_off_all_trackings();
+		capacity = std::max<size_t>(options.memory / sizeof(Node), 1);
+		capacity = std::min<size_t>(capacity, no_moves - 1);
+		nodes = std::make_unique<Node[]>(capacity);
+		next_node = 1;
+	}
+
+	/// <summary>
+	/// Runs the playouts within the budget and returns the most visited move.
+	/// </summary>
+	Move Search()
+	{
+		start = std::chrono::steady_clock::now();
+		if (options.threads == 1)
+		{
+			Worker(0);
+		}
+		else
+		{
+			std::vector<std::thread> threads;
+			for (int i = 0; i < options.threads; i++)
+				threads.emplace_back([this, i]() { Worker(i); });
+			for (auto& thread : threads)
+				thread.join();
+		}
+		return best_move();
+	}
+
+	/// <summary>
+	/// Number of playouts performed, including those ending in a known terminal node.
+	/// </summary>
+	size_t playouts() const { return _playouts_done.load(); }
+
+	size_t nodes_used() const { return std::min<size_t>(next_node.load(), capacity); }
+
+	/// <summary>
+	/// Number of visits of the root child with the given move, zero if not in the tree.
+	/// </summary>
+	uint32_t visits(Move move) const
+	{
+		uint32_t children = nodes[0].children.load(std::memory_order_acquire);
+		if (children == not_expanded || children == expanding || children == no_moves)
+			return 0;
+		for (uint32_t i = 0; i < nodes[0].children_count; i++)
+			if (nodes[children + i].move == move)
+				return nodes[children + i].visits.load();
+		return 0;
+	}
+
+private:
+	Pos position;
+	Options options;
+	std::unique_ptr<Node[]> nodes;
+	size_t capacity;
+	std::atomic<size_t> next_node;
+	std::atomic<size_t> _playouts{ 0 };		// playouts started, used for the budget
+	std::atomic<size_t> _playouts_done{ 0 };
+	std::atomic<bool> stop{ false };
+	std::atomic<bool> arena_full{ false };
+	std::chrono::steady_clock::time_point start;
+
+	// Scratch buffers of a single thread, reused between the playouts
+	struct ThreadState
+	{
+		Pos position;
+		Xoshiro256 rng;
+		std::vector<uint32_t> path;
+		std::vector<Move> moves;
+		std::vector<Move> played;
+		std::unordered_map<size_t, int> first_played;
+	};
+
+	Move best_move() const
+	{
+		Move best;
+		uint32_t children = nodes[0].children.load(std::memory_order_acquire);
+		if (children == not_expanded || children == expanding || children == no_moves)
+			return best;
+
+		uint32_t best_visits = 0;
+		for (uint32_t i = 0; i < nodes[0].children_count; i++)
+		{
+			const Node& child = nodes[children + i];
+			if (child.terminal == Terminal::Won)
+				return child.move;
+			uint32_t visits = child.visits.load();
+			if (!best.is_valid() || visits > best_visits)
+			{
+				best = child.move;
+				best_visits = visits;
+			}
+		}
+		return best;
+	}
+
+	bool budget_exhausted(size_t iteration)
+	{
+		if (stop.load(std::memory_order_relaxed))
+			return true;
+		if (options.playouts > 0 && _playouts.fetch_add(1) >= options.playouts)
+		{
+			stop = true;
+			return true;
+		}
+		if (options.time.count() > 0 && iteration % 64 == 0 && std::chrono::steady_clock::now() - start >= options.time)
+		{
+			stop = true;
+			return true;
+		}
+		return false;
+	}
+
+	void Worker(int thread_index)
+	{
+		ThreadState state{ position, Xoshiro256(options.seed + thread_index) };
+		for (size_t iteration = 0; !budget_exhausted(iteration); iteration++)
+		{
+			Iterate(state);
+			_playouts_done++;
+		}
+	}
+
+	/// <summary>
+	/// Creates the children of the node at the current position of the thread.
+	/// Only a single thread succeeds, the others perform a playout from the leaf meanwhile.
+	/// </summary>
+	bool Expand(Node& node, ThreadState& state)
+	{
+		if (arena_full.load(std::memory_order_relaxed))
+			return false;
+
+		uint32_t expected = not_expanded;
+		if (!node.children.compare_exchange_strong(expected, expanding, std::memory_order_acquire))
+			return false;
+
+		Pos& pos = state.position;
+		state.moves.clear();
+		bool winning = false;
+		for (Move move : pos.all_legal_moves())
+		{
+			// Only the winning move is kept, the others don't matter
+			if (pos.easycheck_winning_move(move))
+			{
+				state.moves.clear();
+				state.moves.push_back(move);
+				winning = true;
+				break;
+			}
+			state.moves.push_back(move);
+		}
+
+		if (state.moves.empty())
+		{
+			// Checkmated or a draw
+			node.terminal = pos.is_checked(pos.turn()) ? Terminal::Won : Terminal::Drawn;
+			node.children.store(no_moves, std::memory_order_release);
+			return true;
+		}
+
+		size_t first = next_node.fetch_add(state.moves.size());
+		if (first + state.moves.size() > capacity)
+		{
+			// The arena is full, the node stays a leaf
+			arena_full = true;
+			node.children.store(not_expanded, std::memory_order_release);
+			return false;
+		}
+
+		for (size_t i = 0; i < state.moves.size(); i++)
+		{
+			Node& child = nodes[first + i];
+			child.move = state.moves[i];
+			child.terminal = winning ? Terminal::Won : Terminal::None;
+		}
+		node.children_count = uint32_t(state.moves.size());
+		node.children.store(uint32_t(first), std::memory_order_release);
+		return true;
+	}
+
+	uint32_t Select(const Node& node, uint32_t children)
+	{
+		double log_visits = std::log(double(std::max<uint32_t>(node.visits.load(std::memory_order_relaxed), 1)));
+		double best_value = -1;
+		uint32_t best = children;
+		for (uint32_t i = children; i < children + node.children_count; i++)
+		{
+			const Node& child = nodes[i];
+			uint32_t visits = child.visits.load(std::memory_order_relaxed);
+			if (visits == 0)
+				return i;
+
+			double value = child.score.load(std::memory_order_relaxed) / (2.0 * visits);
+			if constexpr (rave)
+			{
+				uint32_t amaf_visits = child.amaf_visits.load(std::memory_order_relaxed);
+				if (amaf_visits > 0)
+				{
+					double amaf_value = child.amaf_score.load(std::memory_order_relaxed) / (2.0 * amaf_visits);
+					double beta = std::sqrt(options.rave_equivalence / (3 * visits + options.rave_equivalence));
+					value = (1 - beta) * value + beta * amaf_value;
+				}
+			}
+			value += options.exploration * std::sqrt(log_visits / visits);
+
+			if (value > best_value)
+			{
+				best_value = value;
+				best = i;
+			}
+		}
+		return best;
+	}
+
+	void Iterate(ThreadState& state)
+	{
+		Pos& pos = state.position;
+		state.path.clear();
+		state.played.clear();
+
+		// Selection, the visit is counted on the way down as a virtual loss
+		uint32_t index = 0;
+		state.path.push_back(index);
+		nodes[index].visits++;
+		std::optional<Player> winner;
+		bool terminal = false;
+		while (true)
+		{
+			Node& node = nodes[index];
+			uint32_t children = node.children.load(std::memory_order_acquire);
+			if (children == no_moves || node.terminal.load(std::memory_order_relaxed) != Terminal::None)
+			{
+				// The player who moved into the node
+				Player mover = oponent(pos.turn());
+				winner = node.terminal == Terminal::Won ? std::optional<Player>(mover) : std::nullopt;
+				terminal = true;
+				break;
+			}
+
+			if (children == not_expanded)
+			{
+				if ((index == 0 || node.visits.load(std::memory_order_relaxed) >= options.expand_threshold) && Expand(node, state))
+					continue;
+				break;
+			}
+			if (children == expanding)
+				break;
+
+			index = Select(node, children);
+			nodes[index].visits++;
+			pos += nodes[index].move;
+			state.path.push_back(index);
+		}
+
+		// Simulation
+		size_t path_plies = state.path.size() - 1;
+		if (!terminal)
+			winner = Playout<Pos>::Play(pos, state.rng, options.max_playout_plies, &state.played).winner;
+
+		for (size_t i = state.played.size(); i-- > 0;)
+			pos -= state.played[i];
+
+		// Backpropagation, the mover into path[i] has the turn at path[i-1]
+		Player root_turn = position.turn();
+		for (size_t i = path_plies; i > 0; i--)
+		{
+			Player mover = i % 2 == 1 ? root_turn : oponent(root_turn);
+			Node& node = nodes[state.path[i]];
+			node.score += !winner ? 1 : *winner == mover ? 2 : 0;
+			pos -= node.move;
+		}
+
+		if constexpr (rave)
+			UpdateAmaf(state, winner);
+	}
+
+	/// <summary>
+	/// Updates the children of the nodes in the path with the moves played later
+	/// in the simulation by the same player.
+	/// </summary>
+	void UpdateAmaf(ThreadState& state, std::optional<Player> winner)
+	{
+		auto& first_played = state.first_played;
+		first_played.clear();
+
+		// Plies are counted from the root, the earliest occurrence of a move wins
+		int path_plies = int(state.path.size()) - 1;
+		for (int i = int(state.played.size()) - 1; i >= 0; i--)
+			first_played[std::hash<Move>{}(state.played[i])] = path_plies + i;
+
+		Player root_turn = position.turn();
+		for (int i = path_plies; i >= 0; i--)
+		{
+			if (i < path_plies)
+				first_played[std::hash<Move>{}(nodes[state.path[i + 1]].move)] = i;
+
+			Node& node = nodes[state.path[i]];
+			uint32_t children = node.children.load(std::memory_order_acquire);
+			if (children == not_expanded || children == expanding || children == no_moves)
+				continue;
+
+			Player player = i % 2 == 0 ? root_turn : oponent(root_turn);
+			uint32_t points = !winner ? 1 : *winner == player ? 2 : 0;
+			for (uint32_t c = children; c < children + node.children_count; c++)
+			{
+				auto it = first_played.find(std::hash<Move>{}(nodes[c].move));
+				if (it != first_played.end() && (it->second - i) % 2 == 0)
+				{
+					nodes[c].amaf_visits++;
+					nodes[c].amaf_score += points;
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "core.h"
+
+/// <summary>
+/// Result of a single random game.
+/// </summary>
+struct PlayoutResult
+{
+	std::optional<Player> winner;	// nullopt for a draw
+	int plies = 0;
+};
+
+/// <summary>
+/// Random playouts for Monte Carlo evaluation, MCTS and self-play.
+/// A move is sampled in a single pass over the legal moves, straight from a xoshiro256** generator,
+/// so nothing is stored per move. The game ends with a winning move (easycheck_winning_move),
+/// with no legal moves (a loss if checked, a draw otherwise) or as a draw after max_plies.
+/// </summary>
+template <typename Pos>
+	requires BoardPosition<Pos>
+class Playout
+{
+	using Move = typename Pos::Move;
+
+public:
+	struct Stats
+	{
+		size_t playouts = 0;
+		size_t first_wins = 0;
+		size_t second_wins = 0;
+		size_t draws = 0;
+		size_t plies = 0;
+		double seconds = 0;
+
+		double playouts_per_second() const { return seconds > 0 ? playouts / seconds : 0; }
+	};
+
+	/// <summary>
+	/// Plays random moves till the end of the game, the moves stay played.
+	/// If played is not null, the moves are appended to it, so they can be reverted.
+	/// </summary>
+	static PlayoutResult Play(Pos& position, Xoshiro256& rng, int max_plies = 1000, std::vector<Move>* played = nullptr)
+	{
+		PlayoutResult result;
+		for (; result.plies < max_plies; result.plies++)
+		{
+			Move pick;
+			uint32_t count = 0;
+			for (Move move : position.all_legal_moves())
+			{
+				if (position.easycheck_winning_move(move))
+				{
+					result.winner = position.turn();
+					pick = move;
+					break;
+				}
+				if (rng.below(++count) == 0)
+					pick = move;
+			}
+
+			if (!pick.is_valid())
+			{
+				if (position.is_checked(position.turn()))
+					result.winner = oponent(position.turn());
+				return result;
+			}
+
+			position += pick;
+			if (played != nullptr)
+				played->push_back(pick);
+			if (result.winner)
+			{
+				result.plies++;
+				return result;
+			}
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Same as above, the game is reproducible by its seed.
+	/// </summary>
+	static PlayoutResult Play(Pos& position, uint64_t seed, int max_plies = 1000)
+	{
+		Xoshiro256 rng(seed);
+		return Play(position, rng, max_plies);
+	}
+
+	/// <summary>
+	/// Plays the given number of games from the position on multiple threads.
+	/// Game i is seeded with seed + i, so the totals don't depend on the number of threads.
+	/// </summary>
+	static Stats Run(const Pos& position, size_t games, int threads = 1, uint64_t seed = 0, int max_plies = 1000)
+	{
+		DCHECK(threads > 0);
+		auto start = std::chrono::steady_clock::now();
+
+		std::atomic<size_t> next_game = 0;
+		std::vector<Stats> thread_stats(threads);
+		auto worker = [&](int thread_index)
+		{
+			Pos start_position = position;
+			start_position.turn_off_all_trackings();
+			Stats& stats = thread_stats[thread_index];
+			for (size_t game = next_game++; game < games; game = next_game++)
+			{
+				Pos pos = start_position;
+				PlayoutResult result = Play(pos, seed + game, max_plies);
+				stats.playouts++;
+				stats.plies += result.plies;
+				if (!result.winner)
+					stats.draws++;
+				else if (*result.winner == Player::First)
+					stats.first_wins++;
+				else
+					stats.second_wins++;
+			}
+		};
+
+		if (threads == 1)
+		{
+			worker(0);
+		}
+		else
+		{
+			std::vector<std::thread> pool;
+			for (int i = 0; i < threads; i++)
+				pool.emplace_back(worker, i);
+			for (auto& thread : pool)
+				thread.join();
+		}
+
+		Stats total;
+		for (const Stats& stats : thread_stats)
+		{
+			total.playouts += stats.playouts;
+			total.first_wins += stats.first_wins;
+			total.second_wins += stats.second_wins;
+			total.draws += stats.draws;
+			total.plies += stats.plies;
+		}
+		total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return total;
+	}
+};
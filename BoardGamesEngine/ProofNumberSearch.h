@@ -0,0 +1,344 @@
+#pragma once
+#include <limits>
+#include <unordered_set>
+#include <vector>
+#include "core.h"
+
+/// <summary>
+/// Game theoretical value of a position from the perspective of the player to move.
+/// </summary>
+enum class ProofResult
+{
+	Unknown = 0,	// the node budget was exhausted before the proof was complete
+	Win = 1,
+	Loss = 2,
+	Draw = 3
+};
+
+/// <summary>
+/// Depth-first proof-number search (df-pn) solver.
+/// Unlike MinMax it does not evaluate positions but proves their value.
+/// Proof and disproof numbers are kept in a fixed size transposition table,
+/// so the memory is bounded regardless of the size of the searched tree.
+/// Positions are identified by get_hash(), which has to identify the player to move as well,
+/// as it does for MNK-like games where the turn is implied by the number of tokens.
+/// </summary>
+template <typename Pos>
+	requires BoardPosition<Pos> && requires(const Pos pos) { { pos.get_hash() } -> std::convertible_to<uint64_t>; }
+class ProofNumberSearch
+{
+	using Move = typename Pos::Move;
+	using pn_t = uint32_t;
+
+	// Large enough to be never reached by a sum of proof numbers.
+	static constexpr pn_t infinity = std::numeric_limits<pn_t>::max() / 2;
+	static constexpr int bucket_size = 4;
+
+	struct Entry
+	{
+		uint64_t key;
+		pn_t phi;		// proof number for the player to move reaching its goal
+		pn_t delta;		// disproof number for the player to move reaching its goal
+		uint32_t work;	// number of nodes searched below, used for replacement
+	};
+
+public:
+	/// <summary>
+	/// Creates a solver whose transposition table doesn't exceed the given memory.
+	/// </summary>
+	/// <param name="memory">Transposition table size in bytes</param>
+	/// <param name="max_nodes">Node budget for a single proof, zero for no budget</param>
+	ProofNumberSearch(size_t memory = size_t(64) << 20, size_t max_nodes = 0) : max_nodes(max_nodes)
+	{
+		size_t entries = bucket_size;
+		while (entries * 2 * sizeof(Entry) <= memory)
+			entries *= 2;
+		table.resize(entries);
+		mask = entries - bucket_size;
+	}
+
+	/// <summary>
+	/// Proves whether the player to move wins, loses or draws.
+	/// Two proofs are performed: whether the player to move wins and whether the opponent wins.
+	/// If both are disproved the position is a draw.
+	/// </summary>
+	ProofResult solve(const Pos& pos)
+	{
+		position = pos;
+		position.turn_off_all_trackings();
+		_nodes = 0;
+		_proof_tree_size = 0;
+
+		Player player = position.turn();
+		ProofResult first = prove(player);
+		if (first != ProofResult::Draw)
+			return first == ProofResult::Win ? ProofResult::Win : ProofResult::Unknown;
+
+		ProofResult second = prove(oponent(player));
+		if (second == ProofResult::Win)
+			return ProofResult::Loss;
+		return second == ProofResult::Draw ? ProofResult::Draw : ProofResult::Unknown;
+	}
+
+	/// <summary>
+	/// Number of nodes expanded by the last solve().
+	/// </summary>
+	size_t nodes() const { return _nodes; }
+
+	/// <summary>
+	/// Number of distinct positions of the (dis)proof trees establishing the result of the last solve().
+	/// For a draw it is the sum of both disproof trees.
+	/// </summary>
+	size_t proof_tree_size() const { return _proof_tree_size; }
+
+	size_t memory() const { return table.size() * sizeof(Entry); }
+
+private:
+	Pos position;
+	Player attacker;
+	std::vector<Entry> table;
+	size_t mask;
+	size_t max_nodes;
+	size_t _nodes = 0;
+	size_t _proof_tree_size = 0;
+	bool aborted = false;
+
+	// Moves, child keys and child numbers per ply, reused to avoid allocations during the search.
+	// The numbers are kept locally as well, so the search progresses even when the children get evicted.
+	std::vector<std::vector<Move>> moves_stack;
+	std::vector<std::vector<uint64_t>> keys_stack;
+	std::vector<std::vector<std::pair<pn_t, pn_t>>> numbers_stack;
+
+	/// <summary>
+	/// Proves if the attacker wins. Returns Win if proved, Draw if disproved and Unknown otherwise.
+	/// </summary>
+	ProofResult prove(Player attacker)
+	{
+		this->attacker = attacker;
+		aborted = false;
+		for (Entry& entry : table)
+			entry = Entry{ 0, 0, 0, 0 };
+
+		uint64_t key = position.get_hash();
+		pn_t phi, delta;
+		mid(key, 0, infinity, infinity, phi, delta);
+		if (aborted || (phi != 0 && delta != 0))
+			return ProofResult::Unknown;
+
+		std::unordered_set<uint64_t> visited;
+		_proof_tree_size += count_proof_tree(key, 0, visited);
+
+		bool attacker_to_move = position.turn() == attacker;
+		bool proved = attacker_to_move ? phi == 0 : delta == 0;
+		return proved ? ProofResult::Win : ProofResult::Draw;
+	}
+
+	static pn_t add(pn_t a, pn_t b)
+	{
+		pn_t sum = a + b;
+		return sum >= infinity ? infinity : sum;
+	}
+
+	Entry* lookup(uint64_t key)
+	{
+		Entry* bucket = &table[key & mask];
+		for (int i = 0; i < bucket_size; i++)
+			if (bucket[i].key == key && bucket[i].work != 0)
+				return &bucket[i];
+		return nullptr;
+	}
+
+	void store(uint64_t key, pn_t phi, pn_t delta, size_t work)
+	{
+		Entry* bucket = &table[key & mask];
+		Entry* victim = &bucket[0];
+		for (int i = 0; i < bucket_size; i++)
+		{
+			if (bucket[i].key == key)
+			{
+				victim = &bucket[i];
+				break;
+			}
+			if (bucket[i].work < victim->work)
+				victim = &bucket[i];
+		}
+		uint32_t w = work >= std::numeric_limits<uint32_t>::max() ? std::numeric_limits<uint32_t>::max() : uint32_t(work);
+		*victim = Entry{ key, phi, delta, w > 0 ? w : 1 };
+	}
+
+	void child_numbers(uint64_t key, pn_t& phi, pn_t& delta)
+	{
+		Entry* entry = lookup(key);
+		if (entry != nullptr)
+		{
+			phi = entry->phi;
+			delta = entry->delta;
+		}
+	}
+
+	/// <summary>
+	/// Expands the node and sets the numbers of terminal nodes.
+	/// Returns false for terminal nodes.
+	/// </summary>
+	bool expand(int ply, pn_t& phi, pn_t& delta)
+	{
+		if (int(moves_stack.size()) <= ply)
+		{
+			moves_stack.resize(ply + 1);
+			keys_stack.resize(ply + 1);
+			numbers_stack.resize(ply + 1);
+		}
+		auto& moves = moves_stack[ply];
+		auto& keys = keys_stack[ply];
+		auto& numbers = numbers_stack[ply];
+		moves.clear();
+		keys.clear();
+		numbers.clear();
+
+		for (Move move : position.all_legal_moves())
+		{
+			// The player to move wins immediately
+			if (position.easycheck_winning_move(move))
+			{
+				phi = 0;
+				delta = infinity;
+				return false;
+			}
+			moves.push_back(move);
+		}
+
+		if (moves.empty())
+		{
+			// Lost when checkmated. Otherwise it is a draw which is
+			// a failure for the attacker and a success for the defender.
+			bool lost = position.is_checked(position.turn()) || position.turn() == attacker;
+			phi = lost ? infinity : 0;
+			delta = lost ? 0 : infinity;
+			return false;
+		}
+
+		for (Move move : moves)
+		{
+			position += move;
+			keys.push_back(position.get_hash());
+			position -= move;
+			numbers.emplace_back(1, 1);
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Searches the current position until its numbers exceed the thresholds.
+	/// The resulting numbers are returned in phi and delta.
+	/// </summary>
+	void mid(uint64_t key, int ply, pn_t threshold_phi, pn_t threshold_delta, pn_t& phi, pn_t& delta)
+	{
+		size_t nodes_before = _nodes++;
+		phi = 1;
+		delta = 1;
+		if (max_nodes != 0 && _nodes > max_nodes)
+		{
+			aborted = true;
+			return;
+		}
+
+		if (!expand(ply, phi, delta))
+		{
+			store(key, phi, delta, 1);
+			return;
+		}
+
+		while (!aborted)
+		{
+			// The player to move needs a single child in which the opponent fails (min of deltas),
+			// and fails only if the opponent reaches its goal in all the children (sum of phis).
+			phi = infinity;
+			delta = 0;
+			int best = -1;
+			pn_t best_delta = infinity, second_delta = infinity, best_phi = infinity;
+			for (int i = 0; i < int(keys_stack[ply].size()); i++)
+			{
+				auto& [child_phi, child_delta] = numbers_stack[ply][i];
+				child_numbers(keys_stack[ply][i], child_phi, child_delta);
+				delta = add(delta, child_phi);
+				if (child_delta < best_delta || best == -1)
+				{
+					second_delta = best_delta;
+					best_delta = child_delta;
+					best_phi = child_phi;
+					best = i;
+				}
+				else if (child_delta < second_delta)
+				{
+					second_delta = child_delta;
+				}
+			}
+			phi = best_delta;
+
+			if (phi >= threshold_phi || delta >= threshold_delta)
+				break;
+
+			pn_t child_threshold_phi = add(threshold_delta - delta, best_phi);
+			pn_t child_threshold_delta = std::min(threshold_phi, add(second_delta, 1));
+
+			Move move = moves_stack[ply][best];
+			position += move;
+			auto& [child_phi, child_delta] = numbers_stack[ply][best];
+			mid(keys_stack[ply][best], ply + 1, child_threshold_phi, child_threshold_delta, child_phi, child_delta);
+			position -= move;
+		}
+
+		if (!aborted)
+			store(key, phi, delta, _nodes - nodes_before);
+	}
+
+	/// <summary>
+	/// Counts distinct positions of the (dis)proof tree below the solved position.
+	/// The entries evicted from the table are proved again.
+	/// </summary>
+	size_t count_proof_tree(uint64_t key, int ply, std::unordered_set<uint64_t>& visited)
+	{
+		if (!visited.insert(key).second)
+			return 0;
+
+		pn_t phi = 1, delta = 1;
+		child_numbers(key, phi, delta);
+		if (phi != 0 && delta != 0)
+			mid(key, ply, infinity, infinity, phi, delta);
+		bool success = phi == 0;
+
+		if (!expand(ply, phi, delta))
+			return 1;
+
+		size_t size = 1;
+		for (int i = 0; i < int(keys_stack[ply].size()); i++)
+		{
+			uint64_t child_key = keys_stack[ply][i];
+			Move move = moves_stack[ply][i];
+			position += move;
+
+			// On success a single child where the opponent fails is enough,
+			// on failure all the children are needed.
+			if (success)
+			{
+				// The child may have been evicted from the table, so prove it again
+				pn_t child_phi = 1, child_delta = 1;
+				child_numbers(child_key, child_phi, child_delta);
+				if (child_phi != 0 && child_delta != 0)
+					mid(child_key, ply + 1, infinity, infinity, child_phi, child_delta);
+				if (child_delta != 0)
+				{
+					position -= move;
+					continue;
+				}
+			}
+
+			size += count_proof_tree(child_key, ply + 1, visited);
+			position -= move;
+
+			if (success)
+				break;
+		}
+		return size;
+	}
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include "core.h"
+
+/// <summary>
+/// Extension policy of MinMax which never extends, the search stops at the nominal depth.
+/// A policy returns the extension of the move just played, in fractions of a ply (one_ply per ply),
+/// and limits the sum of the extensions along a path by budget.
+/// </summary>
+struct NoExtensions
+{
+	static constexpr int one_ply = 4;
+	static constexpr int budget = 0;
+
+	template <typename Pos>
+	static int extension(const Pos& position, typename Pos::Move move, typename Pos::Move previous)
+	{
+		return 0;
+	}
+};
+
+/// <summary>
+/// Extends the forcing lines so they aren't cut at the horizon:
+/// - a move giving check (is_checked),
+/// - a check with a single legal reply, on top of the check extension,
+/// - a capture on the square of the previous capture (for moves with captured() and to()).
+/// The extensions are in quarter plies, so e.g. two recaptures make one ply.
+/// The sum along a path is limited by max_plies, so the tree can't explode.
+/// </summary>
+template <int check = 4, int single_reply = 4, int recapture = 2, int max_plies = 4>
+struct SearchExtensions
+{
+	static constexpr int one_ply = 4;
+	static constexpr int budget = max_plies * one_ply;
+
+	/// <summary>
+	/// Extension of the move already played on the position.
+	/// </summary>
+	template <typename Pos>
+	static int extension(const Pos& position, typename Pos::Move move, typename Pos::Move previous)
+	{
+		int ret = 0;
+		Player player = position.turn();
+		if (position.is_checked(player))
+		{
+			ret += check;
+			if constexpr (single_reply > 0)
+			{
+				int replies = 0;
+				for (auto reply : position.all_legal_moves())
+				{
+					if (++replies > 1)
+						break;
+				}
+				if (replies == 1)
+					ret += single_reply;
+			}
+		}
+
+		if constexpr (recapture > 0 && requires(typename Pos::Move m) { m.captured(); m.to(); })
+		{
+			using Piece = decltype(move.captured());
+			if (previous.is_valid() && move.captured() != Piece() && previous.captured() != Piece() && move.to() == previous.to())
+				ret += recapture;
+		}
+		return ret;
+	}
+};
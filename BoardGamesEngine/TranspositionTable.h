@@ -0,0 +1,214 @@
+#pragma once
+#include <cstring>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <vector>
+#include "core.h"
+#include "MemoryMappedFile.h"
+
+/// <summary>
+/// Fixed size transposition table for MinMax, either in memory or backed by a memory mapped file.
+/// A file backed table survives the process, so a later run (or another process mapping the same file)
+/// starts with the results of the previous searches. The file starts with a header identifying
+/// the key scheme: the game type and its Zobrist seed. A file with a different header is cleared.
+/// Each slot is checked by its key xor-ed with the payload, so a slot torn by a concurrent writer
+/// reads as a miss instead of a wrong result.
+/// </summary>
+template <typename Pos>
+class TranspositionTable
+{
+	using Move = typename Pos::Move;
+	static_assert(std::is_trivially_copyable_v<Move>, "The moves are stored in the file as they are");
+
+public:
+	static constexpr uint64_t magic = 0x3142545447524342ull;	// "BCRGTTB1"
+	static constexpr uint32_t version = 1;
+
+	struct Header
+	{
+		uint64_t magic;
+		uint32_t version;
+		uint32_t entry_size;
+		uint64_t game_type;
+		uint64_t zobrist_seed;
+		uint64_t entries;
+	};
+
+	struct Payload
+	{
+		Move move;
+		int32_t value;
+		int16_t depth;	// remaining depth of the search below the position
+	};
+
+	TranspositionTable() = default;
+
+	/// <summary>
+	/// In memory table with the given number of entries, rounded down to a power of two.
+	/// </summary>
+	explicit TranspositionTable(size_t entries)
+	{
+		memory.resize(round_entries(entries));
+		slots = memory.data();
+		mask = memory.size() - 1;
+	}
+
+	/// <summary>
+	/// Maps the table to the file, creating it if needed. Returns false if the file can't be mapped.
+	/// Check warm() whether the previous content was kept.
+	/// </summary>
+	bool open(const std::string& path, size_t entries)
+	{
+		close();
+		entries = round_entries(entries);
+		if (!file.open_write(path, sizeof(Header) + entries * sizeof(Slot)))
+			return false;
+
+		Header* header = reinterpret_cast<Header*>(file.data());
+		Header expected = expected_header(entries);
+		slots = reinterpret_cast<Slot*>(file.data() + sizeof(Header));
+		mask = entries - 1;
+		if (std::memcmp(header, &expected, sizeof(Header)) == 0)
+		{
+			_warm = true;
+		}
+		else
+		{
+			std::memset(file.data(), 0, file.size());
+			*header = expected;
+		}
+		return true;
+	}
+
+	void flush() { file.flush(); }
+
+	void close()
+	{
+		file.close();
+		memory.clear();
+		slots = nullptr;
+		_warm = false;
+		_hits = 0;
+		_misses = 0;
+	}
+
+	void clear()
+	{
+		for (size_t i = 0; i <= mask && slots != nullptr; i++)
+			slots[i] = Slot();
+	}
+
+	/// <summary>
+	/// True if the table was loaded from a file written with the same key scheme.
+	/// </summary>
+	bool warm() const { return _warm; }
+
+	size_t size() const { return slots != nullptr ? mask + 1 : 0; }
+
+	bool probe(uint64_t key, Payload& payload)
+	{
+		Slot* bucket = &slots[key & mask & ~size_t(1)];
+		for (int i = 0; i < 2; i++)
+		{
+			Slot slot = bucket[i];
+			if (slot.check != 0 && (slot.check ^ checksum(slot.payload)) == key)
+			{
+				payload = slot.payload;
+				_hits++;
+				return true;
+			}
+		}
+		_misses++;
+		return false;
+	}
+
+	/// <summary>
+	/// The first slot of a bucket keeps the deepest result, the second one the most recent.
+	/// </summary>
+	void store(uint64_t key, Move move, int32_t value, int depth)
+	{
+		Slot slot;
+		slot.payload.move = move;
+		slot.payload.value = value;
+		slot.payload.depth = int16_t(depth);
+		slot.check = key ^ checksum(slot.payload);
+
+		Slot* bucket = &slots[key & mask & ~size_t(1)];
+		Slot& deepest = bucket[0];
+		bool same_key = deepest.check != 0 && (deepest.check ^ checksum(deepest.payload)) == key;
+		if (deepest.check == 0 || same_key || depth >= deepest.payload.depth)
+			deepest = slot;
+		else
+			bucket[1] = slot;
+	}
+
+	size_t hits() const { return _hits; }
+	size_t misses() const { return _misses; }
+
+	/// <summary>
+	/// Identifies the game, so the tables of different games don't get mixed.
+	/// </summary>
+	static uint64_t game_type()
+	{
+		// FNV-1a of the type name
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (const char* c = typeid(Pos).name(); *c; c++)
+			hash = (hash ^ uint8_t(*c)) * 0x100000001B3ull;
+		return hash;
+	}
+
+private:
+	struct Slot
+	{
+		uint64_t check = 0;	// key ^ checksum(payload), zero for empty slot
+		Payload payload{};
+	};
+
+	MemoryMappedFile file;
+	std::vector<Slot> memory;
+	Slot* slots = nullptr;
+	size_t mask = 0;
+	bool _warm = false;
+	size_t _hits = 0;
+	size_t _misses = 0;
+
+	static size_t round_entries(size_t entries)
+	{
+		size_t rounded = 2;
+		while (rounded * 2 <= entries)
+			rounded *= 2;
+		return rounded;
+	}
+
+	static uint64_t checksum(const Payload& payload)
+	{
+		uint64_t words[(sizeof(Payload) + 7) / 8] = {};
+		std::memcpy(words, &payload, sizeof(Payload));
+		uint64_t ret = 0;
+		for (uint64_t word : words)
+			ret = splitmix64(ret ^ word);
+		return ret;
+	}
+
+	static uint64_t zobrist_seed()
+	{
+		if constexpr (requires { Pos::zobrist_seed; })
+			return Pos::zobrist_seed;
+		else
+			return 0;
+	}
+
+	static Header expected_header(size_t entries)
+	{
+		Header header;
+		std::memset(&header, 0, sizeof(Header));
+		header.magic = magic;
+		header.version = version;
+		header.entry_size = uint32_t(sizeof(Slot));
+		header.game_type = game_type();
+		header.zobrist_seed = zobrist_seed();
+		header.entries = entries;
+		return header;
+	}
+};
@@ -124,23 +124,28 @@ public:
 	{
 	}
 
+	// The zeros after the ones come first, as in get_combination
 	void add_zero()
 	{
-		DCHECK(curr_k < k);
+		DCHECK(curr_n < n);
+		if (curr_k < k)
+			index += nk(n - curr_n - 1, k - curr_k - 1);
 		curr_n++;
 	}
 
 	void add_one()
 	{
 		DCHECK(curr_n < n);
+		DCHECK(curr_k < k);
 		curr_k++;
 		curr_n++;
 	}
 
-	SIZE get_index()
+	SIZE get_index() const
 	{
 		DCHECK(curr_n == n);
 		DCHECK(curr_k == k);
+		return index;
 	}
 
 	/// <summary>
@@ -158,7 +163,7 @@ public:
 		{
 			if (k_ == 0)
 			{
-				while (--n >= 0) { co_yield false; }
+				while (n_-- > 0) { co_yield false; }
 				co_return;
 			}
  			SIZE treshold = nk(n_ - 1, k_ - 1);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <experimental/generator>
+#include <limits>
 #include <random>
 #include <string>
 #include <vector>
@@ -544,6 +545,12 @@ public:
         return ret;
     }
 
+    // The occupied squares
+    int count_pieces() const
+    {
+        return W * H - count_piece(piece_t());
+    }
+
     void roate_90()
     {
         static_assert(W == H, "Allowed only for square boards");
@@ -605,7 +612,7 @@ public:
 class TableEntry
 {
     static_assert(std::numeric_limits<int8_t>::min() == 0 - std::numeric_limits<int8_t>::max() - 1);
-    const int8_t CheckMate = std::numeric_limits<int8_t>::min();
+    static const int8_t CheckMate = std::numeric_limits<int8_t>::min();
 public:
     static const int8_t Open = 0;
     TableEntry()
@@ -614,27 +621,45 @@ public:
     }
 	TableEntry(int8_t data) : data(data) { }
 
-    TableEntry& operator=(const TableEntry& other)
-    {
-        data = other.data;
-        return *this;
-    }
+    // Trivially copyable, the tables are saved to files as they are
+    TableEntry& operator=(const TableEntry& other) = default;
 
     TableEntry(bool check_mate)
     {
         data = check_mate ? CheckMate : Open;
     }
 
-    bool operator==(const TableEntry& other)
+    bool operator==(const TableEntry& other) const
     {
         return data == other.data;
     }
 
-    bool operator>(const TableEntry& entry)
+    bool operator>(const TableEntry& entry) const
     {
         return data > entry.data;
     }
 
+    bool is_win() const { return data > Open; }
+    bool is_lose() const { return data < Open; }
+
+    /// <summary>
+    /// The half moves to the end of the game, odd for the wins and even for the loses, 0 for open.
+    /// </summary>
+    int plies() const
+    {
+        if (is_win())
+            return 2 * (std::numeric_limits<int8_t>::max() - data) - 1;
+        if (is_lose())
+            return 2 * (data - std::numeric_limits<int8_t>::min());
+        return 0;
+    }
+
+    // The win or lose in the given half moves, see plies()
+    static TableEntry FromPlies(int plies)
+    {
+        return plies % 2 == 1 ? Win((plies + 1) / 2) : Lose(plies / 2);
+    }
+
     // Win with number of full moves. Win(1) is half move to win, Win(2) is 3 half moves to win.
     static TableEntry Win(int moves)
     {
@@ -643,10 +668,10 @@ public:
         return entry;
     }
 
-    // Lose with number of full moves. Lose(1) is one full move to check-mate, Lose(2) is 2 full moves to check-mate.
+    // Lose with number of full moves. Lose(0) is check-mate, Lose(1) is one full move to check-mate, Lose(2) is 2 full moves to check-mate.
     static TableEntry Lose(int moves)
     {
-        DCHECK(moves > 0 && moves < std::numeric_limits<int8_t>::max());
+        DCHECK(moves >= 0 && moves < std::numeric_limits<int8_t>::max());
         TableEntry entry; entry.data = std::numeric_limits<int8_t>::min() + moves;
         return entry;
     }
@@ -720,24 +745,92 @@ concept BoardPosition = requires(T pos, const T const_pos, T::Move move, Player
     { pos.turn_off_all_trackings() } -> std::convertible_to<void>;
 };
 
-template <typename Board, typename Move = Board::Move>
-	requires BoardPosition<Board>
-Move random_move(Board& board, int seed = 0, size_t& number_of_moves = s_number_of_moves)
+/// <summary>
+/// Mixes the bits of the input, see SplitMix64. Consecutive inputs give uncorrelated outputs,
+/// which makes it suitable for seeding and for deriving hash keys.
+/// </summary>
+constexpr uint64_t splitmix64(uint64_t x)
 {
-    std::vector<Move> moves;
-    for (Move move : board.all_legal_moves())
+    uint64_t z = x + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/// <summary>
+/// xoshiro256** generator, much faster and smaller than std::mt19937.
+/// Satisfies UniformRandomBitGenerator, so it works with the standard distributions too.
+/// </summary>
+class Xoshiro256
+{
+public:
+    using result_type = uint64_t;
+
+    explicit Xoshiro256(uint64_t seed = 0)
     {
-        moves.push_back(move);
+        for (int i = 0; i < 4; i++)
+            s[i] = seed = splitmix64(seed);
     }
 
-    number_of_moves = moves.size();
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
 
-    if (moves.size() == 0)
-        return Move();
+    result_type operator()()
+    {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    /// <summary>
+    /// Uniform number in [0, n) by multiplication instead of division, the bias is negligible for small n.
+    /// </summary>
+    uint32_t below(uint32_t n)
+    {
+        return uint32_t(((*this)() >> 32) * n >> 32);
+    }
 
-    //std::random_device rd;
-    static std::mt19937 gen(seed);
-    std::uniform_int_distribution<> dist(0, int(moves.size()) - 1);
-    int index = dist(gen);
-    return moves[index];
+private:
+    uint64_t s[4];
+
+    static constexpr uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+/// <summary>
+/// Picks a uniformly random legal move in a single pass over the moves (reservoir sampling),
+/// no moves are stored. Returns invalid move if there are no legal moves.
+/// </summary>
+template <typename Board, typename Rng, typename Move = Board::Move>
+    requires BoardPosition<Board>
+Move random_move(const Board& board, Rng& rng, size_t& number_of_moves)
+{
+    Move pick;
+    number_of_moves = 0;
+    for (Move move : board.all_legal_moves())
+    {
+        if (rng.below(uint32_t(++number_of_moves)) == 0)
+            pick = move;
+    }
+    return pick;
+}
+
+/// <summary>
+/// Same as above with a generator of the calling thread.
+/// The seed only initializes the generator on the first call of the thread.
+/// </summary>
+template <typename Board, typename Move = Board::Move>
+	requires BoardPosition<Board>
+Move random_move(Board& board, int seed = 0, size_t& number_of_moves = s_number_of_moves)
+{
+    thread_local Xoshiro256 gen(seed);
+    return random_move<Board, Xoshiro256, Move>(board, gen, number_of_moves);
 }
@@ -1,4 +1,25 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+#include "CompressedTable.h"
 #include "core.h"
+#include "MemoryMappedFile.h"
 
 template <typename Con, typename Pos, typename Move, typename Key>
 concept Converter = requires(Con con, Pos& pos, Move move, Key key, SIZE index)
@@ -12,6 +33,13 @@ concept Converter = requires(Con con, Pos& pos, Move move, Key key, SIZE index)
 	{ Con::flip_if_needed(pos) } -> std::convertible_to<void>;
 };
 
+/// <summary>
+/// The values of all the positions of a converter key for the player to move: the wins and the loses
+/// with the distance to the end of the game, open for the draws and for the indices of no position.
+/// The tables are solved by retrograde analysis, the dependent tables first.
+/// With a directory the solved tables are saved to files, mapped to the memory instead of solved again
+/// and probed by any number of threads and processes sharing the pages of the files.
+/// </summary>
 template <typename Conv>
 	requires Converter<Conv, typename Conv::Position, typename Conv::Move, typename Conv::Key>
 class EndTable
@@ -20,36 +48,47 @@ class EndTable
 	using Key = typename Conv::Key;
 	using Move = typename Conv::Move;
 
+public:
+	struct Stats
+	{
+		SIZE size = 0;
+		SIZE valid = 0;		// the indices of a position
+		SIZE wins = 0;
+		SIZE loses = 0;
+		int passes = 0;
+		double seconds = 0;	// of the table and its opponent table, solved together
+
+		double positions_per_second() const { return seconds > 0 ? size / seconds : 0; }
+	};
+
 private:
-	//Key key;
-	std::vector<TableEntry> evals;
+	std::vector<TableEntry> evals;			// while solved
+	std::shared_ptr<MemoryMappedFile> file;	// once saved
+	const TableEntry* entries = nullptr;	// either of them
+	SIZE count = 0;
+	Key _key;
+	Stats _stats;
 	inline static std::unordered_map<Key, EndTable> tables; // all tables
 
 public:
-	static Move FindBestMove(const Position& pos)
+	static Move FindBestMove(const Position& pos, int threads = 1)
 	{
-   		Key key = Conv::PositionToKey(pos);
-		solve(key);
-
-		auto nonConstPos = const_cast<Position&>(pos);
-
-		int value = 0; // todo: FindValue(pos);
-		int expected_value = value--;     
-		for (auto move : pos.all_legal_moves())
+		// The successor best for the player to move is the worst for the opponent
+		Position position = pos;
+		Move best;
+		int best_score = std::numeric_limits<int>::min();
+		for (Move move : position.all_legal_moves_played())
 		{
-			return move;
-
-			nonConstPos += move;
-
-			if (FindValue(nonConstPos) == expected_value)
+			TableEntry value = FindValue(position, threads);
+			position -= move;
+			int score = value.is_lose() ? 1000 - value.plies() : value.is_win() ? value.plies() - 1000 : 0;
+			if (score > best_score)
 			{
-				nonConstPos -= move;
-				return move;
+				best_score = score;
+				best = move;
 			}
-
-			nonConstPos -= move;
 		}
-		DCHECK_FAIL;
+		return best;
 	}
 
 	/// <summary>
@@ -59,73 +98,892 @@ public:
 	/// "KPK"/"KKP"
 	/// "KQK"/"KKQ"
 	/// "KQKP"/"KPKQ"
+	/// A table is solved together with its opponent table, the passes are split to the threads.
+	/// Returns false if stopped by the pass limit (see set_out_of_core), in this table or in a dependent one:
+	/// the table isn't solved yet, the next call resumes from the checkpoint.
 	/// </summary>
-	/// <param name="key"></param>
-	static void solve(Key key)
+	static bool solve(Key key, int threads = 1)
 	{
-		if (tables.contains(key))
-			return;
+		return solve(key, threads, files.pass_limit);
+	}
 
-		bool any = false;
-		for (Key dep : Conv::get_dependent_tables(key))
+	/// <summary>
+	/// The value for the player to move, the table is solved first if needed, regardless of the pass limit.
+	/// </summary>
+	static TableEntry FindValue(const Position& pos, int threads = 1)
+	{
+		Key key = Conv::PositionToKey(pos);
+		bool solved = solve(key, threads, std::numeric_limits<int>::max());
+		DCHECK(solved);
+		return tables[key][Conv::PositionToIndex(pos)];
+	}
+
+	/// <summary>
+	/// nullptr if the table isn't solved.
+	/// </summary>
+	static const EndTable* find(const Key& key)
+	{
+		auto it = tables.find(key);
+		return it == tables.end() ? nullptr : &it->second;
+	}
+
+	static void clear()
+	{
+		tables.clear();
+		std::unique_lock lock(files.mutex);
+		files.mapped.clear();
+		files.missing.clear();
+		files.mapped_bytes = 0;
+	}
+
+	EndTable()
+	{
+	}
+
+	SIZE size() const { return count; }
+
+	TableEntry operator[](SIZE index) const
+	{
+		DCHECK(index < count);
+		return entries[index];
+	}
+
+	const Stats& stats() const { return _stats; }
+
+#pragma region Files
+	static constexpr uint64_t magic = 0x3154474547524342ull;	// "BCRGEGT1"
+	static constexpr uint32_t version = 1;
+
+	/// <summary>
+	/// The file is the header and the entries by their indices.
+	/// </summary>
+	struct Header
+	{
+		uint64_t magic;
+		uint32_t version;
+		uint32_t entry_size;
+		uint64_t converter;	// the index scheme, by the type of the converter
+		uint64_t key;		// of the file name
+		uint64_t entries;
+		uint64_t valid;
+		uint64_t wins;
+		uint64_t loses;
+		uint64_t passes;
+	};
+
+	struct ProbeStats
+	{
+		size_t probes = 0;
+		size_t loads = 0;		// the files mapped by probe()
+		size_t evictions = 0;	// unmapped over the budget
+		size_t mapped_bytes = 0;
+	};
+
+	/// <summary>
+	/// The directory of the table files, empty for none. The tables solved later are saved there and solve() maps
+	/// the saved tables instead of solving them again. probe() maps the files lazily with at most budget bytes
+	/// mapped at a time, the least recently probed tables are unmapped first. The budget doesn't apply to the tables
+	/// of solve(), they are all needed by the tables depending on them.
+	/// A missing file is looked for again after retry, e.g. written since by another process.
+	/// </summary>
+	static void set_directory(const std::string& directory, size_t budget = std::numeric_limits<size_t>::max(),
+		std::chrono::milliseconds retry = std::chrono::seconds(1))
+	{
+		std::unique_lock lock(files.mutex);
+		files.directory = directory;
+		files.budget = budget;
+		files.retry = retry;
+		files.mapped.clear();
+		files.missing.clear();
+		files.mapped_bytes = 0;
+		files.probes = files.loads = files.evictions = 0;
+	}
+
+	/// <summary>
+	/// The name of the file of a table, e.g. "ConverterSimple_KQK.egt".
+	/// </summary>
+	static std::string file_name(const Key& key)
+	{
+		std::string name;
+		if constexpr (requires { Conv::name(); })
+			name = Conv::name();
+		else
+			name = "table";
+		name += "_";
+		if constexpr (std::is_convertible_v<Key, std::string>)
+		{
+			name += key;
+		}
+		else
 		{
-			solve(dep);
-			any = true;
+			for (size_t i = 0; i < key.size(); i++)
+				name += (i == 0 ? "" : "-") + std::to_string(int(key[i]));
 		}
+		return name + ".egt";
+	}
 
-		tables[key] = EndTable(key);
+	/// <summary>
+	/// Writes the table to a temporary file renamed to the path when complete,
+	/// so the other processes never map a partial file. Returns false if it can't be written.
+	/// </summary>
+	bool save(const std::string& path) const
+	{
+		std::string temporary = path + ".tmp";
+		{
+			MemoryMappedFile out;
+			if (!out.open_write(temporary, sizeof(Header) + count * sizeof(TableEntry)))
+				return false;
+			Header header = expected_header(_key);
+			header.valid = _stats.valid;
+			header.wins = _stats.wins;
+			header.loses = _stats.loses;
+			header.passes = _stats.passes;
+			std::memcpy(out.data(), &header, sizeof(Header));
+			std::memcpy(out.data() + sizeof(Header), entries, count * sizeof(TableEntry));
+			out.flush();
+		}
+		std::error_code error;
+		std::filesystem::rename(temporary, path, error);
+		return !error;
 	}
 
-	static int FindValue(const Position& pos)
+	/// <summary>
+	/// Writes the entries to a compressed file with random access by the index, see CompressedTable.
+	/// </summary>
+	bool save_compressed(const std::string& path, uint32_t block_size = CompressedTable::default_block_size) const
 	{
-		auto index = Conv::PositionToIndex(pos);
-		return 0;
+		return CompressedTable::write(path, entries, count, block_size);
 	}
-	
-	EndTable()
+
+	/// <summary>
+	/// The value of the position from the file of its table in the directory, nullopt without the file.
+	/// Safe to call from any number of threads: the probes of the mapped tables share a lock,
+	/// mapping and unmapping a table takes it exclusively.
+	/// </summary>
+	static std::optional<TableEntry> probe(const Position& pos)
 	{
+		auto [key, index] = KeyIndex(pos);
+		files.probes++;
+		{
+			std::shared_lock lock(files.mutex);
+			auto it = files.mapped.find(key);
+			if (it != files.mapped.end())
+				return it->second->probe(index, ++files.clock);
+			auto missing = files.missing.find(key);
+			if (missing != files.missing.end() && std::chrono::steady_clock::now() < missing->second)
+				return std::nullopt;
+		}
+
+		std::unique_lock lock(files.mutex);
+		auto it = files.mapped.find(key);
+		if (it == files.mapped.end())
+		{
+			// Not mapped or looked for by another thread since the shared lock was released
+			auto now = std::chrono::steady_clock::now();
+			auto missing = files.missing.find(key);
+			if (missing != files.missing.end() && now < missing->second)
+				return std::nullopt;
+
+			auto mapping = std::make_unique<Mapping>();
+			if (files.directory.empty() || !mapping->file.open_read(path(key)) || !valid(mapping->file, key))
+			{
+				files.missing[key] = now + files.retry;
+				return std::nullopt;
+			}
+			files.loads++;
+			files.mapped_bytes += mapping->file.size();
+			files.missing.erase(key);
+			it = files.mapped.emplace(key, std::move(mapping)).first;
+			Evict(key);
+		}
+		return it->second->probe(index, ++files.clock);
 	}
 
-	EndTable(Key key )
+	/// <summary>
+	/// The tables of at least min_size indices are solved out of core, in working files of the directory
+	/// (without a directory in the memory as the others). The values and the bits of the passes are mapped
+	/// to the memory from the files, so the operating system keeps in the memory only the pages in use:
+	/// the passes go over the indices in order, chunk after chunk, and the frontier of each pass is written
+	/// to the bits in the files in that order. The dependent tables are mapped read-only from their files.
+	/// After each pass the files are flushed and a checkpoint is saved, solve() resumes from the last checkpoint
+	/// after a crash. The pass limit stops solve() after that many passes, to split a generation into sessions.
+	/// </summary>
+	static void set_out_of_core(SIZE min_size = 0, int pass_limit = std::numeric_limits<int>::max())
+	{
+		files.out_of_core = min_size;
+		files.pass_limit = std::max(pass_limit, 1);
+	}
+
+	static ProbeStats probe_stats()
+	{
+		std::shared_lock lock(files.mutex);
+		return { files.probes, files.loads, files.evictions, files.mapped_bytes };
+	}
+#pragma endregion
+
+private:
+#pragma region Files
+	struct Mapping
+	{
+		MemoryMappedFile file;
+		std::atomic<uint64_t> last_use = 0;
+
+		TableEntry probe(SIZE index, uint64_t time)
+		{
+			last_use.store(time, std::memory_order_relaxed);
+			DCHECK(sizeof(Header) + (index + 1) * sizeof(TableEntry) <= file.size());
+			return reinterpret_cast<const TableEntry*>(file.data() + sizeof(Header))[index];
+		}
+	};
+
+	struct Files
 	{
-		if (Conv::get_opponent_table(key) == key)
+		std::string directory;
+		size_t budget = std::numeric_limits<size_t>::max();
+		std::shared_mutex mutex;
+		std::unordered_map<Key, std::unique_ptr<Mapping>> mapped;
+		std::unordered_map<Key, std::chrono::steady_clock::time_point> missing;	// without a valid file, until the next look
+		std::chrono::steady_clock::duration retry = std::chrono::seconds(1);
+		size_t mapped_bytes = 0;
+		std::atomic<uint64_t> clock = 0;
+		std::atomic<size_t> probes = 0, loads = 0, evictions = 0;
+		SIZE out_of_core = std::numeric_limits<SIZE>::max();	// the smallest size solved out of core
+		int pass_limit = std::numeric_limits<int>::max();
+	};
+	inline static Files files;
+
+	static_assert(std::is_trivially_copyable_v<TableEntry> && sizeof(TableEntry) == 1, "The entries are stored in the files as they are");
+
+	// Unmaps the least recently probed tables but the given one while over the budget, under the exclusive lock
+	static void Evict(const Key& keep)
+	{
+		while (files.mapped_bytes > files.budget)
 		{
-			SIZE size = Conv::KeyToSize(key);
-			Position pos;
-			for (int i = 0; i < size; i++)
+			auto oldest = files.mapped.end();
+			for (auto it = files.mapped.begin(); it != files.mapped.end(); ++it)
 			{
-				continue;
+				if (!(it->first == keep) &&
+					(oldest == files.mapped.end() || it->second->last_use < oldest->second->last_use))
+					oldest = it;
+			}
+			if (oldest == files.mapped.end())
+				return;
+			files.mapped_bytes -= oldest->second->file.size();
+			files.evictions++;
+			files.mapped.erase(oldest);
+		}
+	}
 
-				if (!Conv::KeyIndexToPosition(key, i, pos))
-					continue;
-				if (pos.is_lost())
-					evals[i] = TableEntry::Lose(0);
-				else
-					evals[i] = TableEntry::Open;
+	static std::string path(const Key& key)
+	{
+		return (std::filesystem::path(files.directory) / file_name(key)).string();
+	}
+
+	static uint64_t fnv(const std::string& text)
+	{
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (char c : text)
+			hash = (hash ^ uint8_t(c)) * 0x100000001B3ull;
+		return hash;
+	}
+
+	static Header expected_header(const Key& key)
+	{
+		Header header;
+		std::memset(&header, 0, sizeof(Header));
+		header.magic = magic;
+		header.version = version;
+		header.entry_size = uint32_t(sizeof(TableEntry));
+		header.converter = fnv(typeid(Conv).name());
+		header.key = fnv(file_name(key));
+		header.entries = Conv::KeyToSize(key);
+		return header;
+	}
+
+	static bool valid(const MemoryMappedFile& file, const Key& key)
+	{
+		if (file.size() < sizeof(Header))
+			return false;
+		Header expected = expected_header(key);
+		const Header* header = reinterpret_cast<const Header*>(file.data());
+		return header->magic == expected.magic && header->version == expected.version &&
+			header->entry_size == expected.entry_size && header->converter == expected.converter &&
+			header->key == expected.key && header->entries == expected.entries &&
+			file.size() == sizeof(Header) + expected.entries * sizeof(TableEntry);
+	}
+
+	// Maps the saved file of the table for solve(), returns false without a valid one
+	static bool map(const Key& key)
+	{
+		if (files.directory.empty())
+			return false;
+		auto file = std::make_shared<MemoryMappedFile>();
+		if (!file->open_read(path(key)) || !valid(*file, key))
+			return false;
+
+		const Header* header = reinterpret_cast<const Header*>(file->data());
+		EndTable& table = tables[key];
+		table.evals = std::vector<TableEntry>();
+		table.entries = reinterpret_cast<const TableEntry*>(file->data() + sizeof(Header));
+		table.count = header->entries;
+		table._stats = Stats{ header->entries, header->valid, header->wins, header->loses, int(header->passes), 0 };
+		table.file = std::move(file);
+		table._key = key;
+
+		// Found by the next probe
+		std::unique_lock lock(files.mutex);
+		files.missing.erase(key);
+		return true;
+	}
+
+	// Each retrograde stops after pass_limit passes
+	static bool solve(Key key, int threads, int pass_limit)
+	{
+		if (tables.contains(key) || map(key))
+			return true;
+
+		Key opponent = Conv::get_opponent_table(key);
+		for (Key dep : Conv::get_dependent_tables(key))
+		{
+			if (!solve(dep, threads, pass_limit))
+				return false;
+		}
+		if (opponent != key)
+		{
+			for (Key dep : Conv::get_dependent_tables(opponent))
+			{
+				if (!solve(dep, threads, pass_limit))
+					return false;
 			}
+		}
+
+		// Stopped by the pass limit, the next call resumes from the checkpoint
+		if (!Retrograde(key, opponent, threads).Run(pass_limit))
+		{
+			tables.erase(key);
+			tables.erase(opponent);
+			return false;
+		}
 
-			bool chage = false;
-			do
+		// The pages of the files are shared with the other processes
+		if (!files.directory.empty())
+		{
+			for (const Key& solved : { key, opponent })
 			{
-				for (int i = 0; i < size; i++)
+				if (tables[solved].file == nullptr && tables[solved].save(path(solved)))
+					map(solved);
+			}
+		}
+		return true;
+	}
+
+	// A converter may compute both in one pass
+	static std::pair<Key, SIZE> KeyIndex(const Position& pos)
+	{
+		if constexpr (requires { Conv::PositionToKeyIndex(pos); })
+			return Conv::PositionToKeyIndex(pos);
+		else
+			return { Conv::PositionToKey(pos), Conv::PositionToIndex(pos) };
+	}
+#pragma endregion
+
+	/// <summary>
+	/// Solves a table and its opponent table by passes over their indices, pass p finds the positions
+	/// p half moves from the end: the wins by a successor lost in p-1 and the loses by all successors won
+	/// in at most p-1. The first pass marks the terminal positions and the indices of no position.
+	/// A bit per index tells the values known before the pass and another one the values found by the pass,
+	/// so a pass reads only the values not written by it and skips the known ones without decoding them.
+	/// Once the values of the dependent tables can't decide anymore (after the horizon), a position is decided
+	/// in pass p only by a successor found in pass p-1. With an un-move generator (all_reverse_moves) the passes
+	/// then check only the predecessors of the values found by the previous pass instead of all the unknown indices.
+	/// The threads take chunks of chunk_words words of the bits, in the order of the indices.
+	/// Out of core the values and the bits are in a working file per table: the header of the table file,
+	/// the values and the known, found and candidate bits. The finished file is cut to the table file.
+	/// </summary>
+	class Retrograde
+	{
+		static constexpr bool propagates_backward = requires(const Position& pos) { pos.all_reverse_moves(); };
+
+		// 4096 indices, a page of the values
+		static constexpr SIZE chunk_words = 64;
+
+		static constexpr uint64_t checkpoint_magic = 0x31504B4347524342ull;	// "BCRGCKP1"
+
+		struct Checkpoint
+		{
+			uint64_t magic;
+			uint64_t entries;
+			int32_t pass;		// the last pass done
+			int32_t horizon;
+			uint64_t invalid;
+			double seconds;
+		};
+
+		struct Part
+		{
+			Key key;
+			EndTable* table = nullptr;
+			SIZE size = 0;
+			SIZE words = 0;						// of each of the bits
+			TableEntry* evals = nullptr;		// the values of the table or of the working file
+			uint64_t* known = nullptr;			// before the pass
+			uint64_t* found = nullptr;			// by the pass
+			uint64_t* candidates = nullptr;		// the predecessors of the values found by the previous pass
+			std::vector<uint64_t> bits;			// in the memory
+			std::unique_ptr<MemoryMappedFile> work;	// out of core
+		};
+
+	public:
+		Retrograde(Key key, Key opponent, int threads) : threads(std::max(threads, 1))
+		{
+			// The references to the map elements stay valid while the dependent tables are added
+			parts.emplace_back().key = key;
+			if (opponent != key)
+				parts.emplace_back().key = opponent;
+			for (Part& part : parts)
+			{
+				part.table = &tables[part.key];
+				part.size = Conv::KeyToSize(part.key);
+				part.words = (part.size + 63) / 64;
+				part.table->file.reset();
+				part.table->_key = part.key;
+				out_of_core |= !files.directory.empty() && part.size >= files.out_of_core;
+			}
+			if (out_of_core)
+				return;
+
+			for (Part& part : parts)
+			{
+				part.table->evals.assign(part.size, TableEntry());
+				part.evals = part.table->evals.data();
+				part.bits.assign(3 * part.words, 0);
+				part.known = part.bits.data();
+				part.found = part.known + part.words;
+				part.candidates = part.found + part.words;
+			}
+		}
+
+		/// <summary>
+		/// Returns false if stopped by the pass limit, out of core only.
+		/// </summary>
+		bool Run(int pass_limit)
+		{
+			auto start = std::chrono::steady_clock::now();
+			double seconds = 0;
+			int pass = out_of_core ? Open(seconds) : 0;
+			resumed = pass > 0 ? pass : -1;
+			for (int64_t limit = int64_t(pass) + pass_limit; ; pass++)
+			{
+				DCHECK(pass < 2 * std::numeric_limits<int8_t>::max());
+				SIZE found = RunPass(pass);
+
+				// No new value and none of the dependent tables can come later
+				bool done = pass > 0 && found == 0 && pass > horizon;
+				seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				start = std::chrono::steady_clock::now();
+				if (done)
+					break;
+				if (out_of_core)
 				{
-					if (!Conv::KeyIndexToPosition(key, i, pos))
-						continue;
-					
-					//TODO: remove when implemented
+					SaveCheckpoints(pass, seconds);
+					if (pass + 1 == limit)
+						return false;
+				}
+			}
+
+			for (Part& part : parts)
+			{
+				part.table->entries = part.evals;
+				part.table->count = part.size;
+				Stats& stats = part.table->_stats;
+				stats = Stats();
+				stats.size = part.size;
+				stats.passes = pass;
+				stats.seconds = seconds;
+				stats.valid = stats.size - invalid[&part - parts.data()];
+				for (SIZE index = 0; index < part.size; index++)
+				{
+					stats.wins += part.evals[index].is_win();
+					stats.loses += part.evals[index].is_lose();
+				}
+			}
+			if (out_of_core)
+				Close();
+			return true;
+		}
+
+	private:
+		bool out_of_core = false;
+		int resumed = -1;	// the first pass after a checkpoint, it checks all the unknown indices
+
+		static std::string work_path(const Key& key) { return path(key) + ".work"; }
+		static std::string checkpoint_path(const Key& key) { return path(key) + ".checkpoint"; }
+
+		// The values after the header, the bits after the values aligned to their words
+		static size_t bits_offset(SIZE size) { return (sizeof(Header) + size + 7) / 8 * 8; }
+
+		/// <summary>
+		/// Maps the working files, restored to the last pass of both checkpoints if the files are there.
+		/// The passes may run over the checkpoint of one part while the other one was saved, or be cut by a crash:
+		/// the values found after the pass and the bits of the unknown values are cleared.
+		/// Returns the first pass to run.
+		/// </summary>
+		int Open(double& seconds)
+		{
+			std::error_code error;
+			int last = std::numeric_limits<int>::max();
+			for (Part& part : parts)
+			{
+				MemoryMappedFile file;
+				Checkpoint checkpoint;
+				if (!file.open_read(checkpoint_path(part.key)) || file.size() != sizeof(Checkpoint))
+				{
+					last = -1;
+					break;
+				}
+				std::memcpy(&checkpoint, file.data(), sizeof(Checkpoint));
+				if (checkpoint.magic != checkpoint_magic || checkpoint.entries != part.size || checkpoint.pass < 0 ||
+					std::filesystem::file_size(work_path(part.key), error) != bits_offset(part.size) + 3 * part.words * 8)
+				{
+					last = -1;
+					break;
+				}
+				last = std::min(last, int(checkpoint.pass));
+				horizon = checkpoint.horizon;
+				invalid[&part - parts.data()] = checkpoint.invalid;
+				seconds = checkpoint.seconds;
+			}
+
+			for (Part& part : parts)
+			{
+				if (last < 0)
+				{
+					std::filesystem::remove(checkpoint_path(part.key), error);
+					std::filesystem::remove(work_path(part.key), error);
+				}
+				part.work = std::make_unique<MemoryMappedFile>();
+				bool opened = part.work->open_write(work_path(part.key), bits_offset(part.size) + 3 * part.words * 8);
+				DCHECK(opened);
+				part.evals = reinterpret_cast<TableEntry*>(part.work->data() + sizeof(Header));
+				part.known = reinterpret_cast<uint64_t*>(part.work->data() + bits_offset(part.size));
+				part.found = part.known + part.words;
+				part.candidates = part.found + part.words;
+				if (last < 0)
 					continue;
 
-					for (auto move : pos.all_legal_moves_played())
+				for (SIZE word = 0; word < part.words; word++)
+				{
+					part.found[word] = 0;
+					for (SIZE index = word * 64; index < std::min(part.size, word * 64 + 64); index++)
+					{
+						uint64_t bit = uint64_t(1) << (index % 64);
+						bool known = (part.known[word] & bit) && part.evals[index].plies() <= last;
+						if (!known && part.known[word] & bit)
+							part.known[word] &= ~bit;
+						if (!known && !(part.evals[index] == TableEntry()))
+							part.evals[index] = TableEntry();
+					}
+				}
+			}
+			return last + 1;
+		}
+
+		// The working files are flushed before the checkpoints, a checkpoint is replaced whole
+		void SaveCheckpoints(int pass, double seconds)
+		{
+			for (Part& part : parts)
+				part.work->flush();
+			for (Part& part : parts)
+			{
+				Checkpoint checkpoint{ checkpoint_magic, part.size, pass, horizon, invalid[&part - parts.data()], seconds };
+				std::string temporary = checkpoint_path(part.key) + ".tmp";
+				{
+					MemoryMappedFile out;
+					bool opened = out.open_write(temporary, sizeof(Checkpoint));
+					DCHECK(opened);
+					std::memcpy(out.data(), &checkpoint, sizeof(Checkpoint));
+					out.flush();
+				}
+				std::error_code error;
+				std::filesystem::rename(temporary, checkpoint_path(part.key), error);
+				DCHECK(!error);
+			}
+		}
+
+		// The working files are cut to the tables and mapped as the saved ones
+		void Close()
+		{
+			for (Part& part : parts)
+			{
+				Header header = expected_header(part.key);
+				const Stats& stats = part.table->_stats;
+				header.valid = stats.valid;
+				header.wins = stats.wins;
+				header.loses = stats.loses;
+				header.passes = stats.passes;
+				std::memcpy(part.work->data(), &header, sizeof(Header));
+				part.work->close();
+				{
+					MemoryMappedFile table;
+					bool opened = table.open_write(work_path(part.key), sizeof(Header) + part.size * sizeof(TableEntry));
+					DCHECK(opened);
+					table.flush();
+				}
+				std::error_code error;
+				std::filesystem::rename(work_path(part.key), path(part.key), error);
+				std::filesystem::remove(checkpoint_path(part.key), error);
+				double seconds = stats.seconds;
+				bool mapped = map(part.key);
+				DCHECK(mapped);
+				part.table->_stats.seconds = seconds;
+			}
+		}
+
+		size_t chunks() const
+		{
+			size_t ret = 0;
+			for (const Part& part : parts)
+				ret += (part.words + chunk_words - 1) / chunk_words;
+			return ret;
+		}
+
+		// The part and the words of a chunk, the chunks of the parts one after another
+		std::tuple<int, SIZE, SIZE> chunk(size_t chunk) const
+		{
+			int i = 0;
+			for (SIZE count; chunk >= (count = (parts[i].words + chunk_words - 1) / chunk_words); i++)
+				chunk -= count;
+			SIZE first = chunk * chunk_words;
+			return { i, first, std::min(first + chunk_words, parts[i].words) };
+		}
+
+		// Returns the number of the values found
+		SIZE RunPass(int pass)
+		{
+			bool backward = propagates_backward && pass > horizon && pass != resumed;
+			std::atomic<size_t> next = 0;
+			std::atomic<SIZE> found = 0;
+			auto worker = [&]()
+			{
+				Lookup lookup(*this);
+				Position pos;
+				SIZE thread_found = 0;
+				for (size_t index = next++, count = chunks(); index < count; index = next++)
+				{
+					auto [part_index, first, last] = chunk(index);
+					Part& part = parts[part_index];
+					for (SIZE word = first; word < last; word++)
+					{
+						uint64_t todo = ~part.known[word];
+						if (word * 64 + 64 > part.size)
+							todo &= (uint64_t(1) << (part.size % 64)) - 1;
+						if (backward)
+							todo &= part.candidates[word];
+						uint64_t bits = 0;
+						for (; todo; todo &= todo - 1)
+						{
+							int bit = std::countr_zero(todo);
+							if (Solve(part_index, word * 64 + bit, pass, pos, lookup))
+								bits |= uint64_t(1) << bit;
+						}
+						if (bits)
+							part.found[word] = bits;
+						thread_found += std::popcount(bits);
+					}
+				}
+				found += thread_found;
+			};
+			RunThreads(worker);
+
+			if constexpr (propagates_backward)
+				MarkPredecessors();
+
+			for (Part& part : parts)
+			{
+				for (SIZE word = 0; word < part.words; word++)
+				{
+					if (part.found[word])
 					{
+						part.known[word] |= part.found[word];
+						part.found[word] = 0;
+					}
+				}
+			}
+			return found;
+		}
+
+		template <typename Worker>
+		void RunThreads(Worker& worker)
+		{
+			if (threads == 1)
+			{
+				worker();
+			}
+			else
+			{
+				std::vector<std::thread> pool;
+				for (int i = 0; i < threads; i++)
+					pool.emplace_back(worker);
+				for (auto& thread : pool)
+					thread.join();
+			}
+		}
 
-						pos -= move;
+		/// <summary>
+		/// The candidates of the next pass: the unknown predecessors of the wins and the loses found by the pass,
+		/// in the parts of the retrograde only (the predecessors by a capture or a promotion are in other tables).
+		/// The bits are set atomically, a predecessor may be in the chunk of another thread.
+		/// </summary>
+		void MarkPredecessors()
+		{
+			for (Part& part : parts)
+				std::fill(part.candidates, part.candidates + part.words, 0);
+
+			std::atomic<size_t> next = 0;
+			auto worker = [&]()
+			{
+				Position pos;
+				for (size_t index = next++, count = chunks(); index < count; index = next++)
+				{
+					auto [part_index, first, last] = chunk(index);
+					Part& part = parts[part_index];
+					for (SIZE word = first; word < last; word++)
+					{
+						for (uint64_t bits = part.found[word]; bits; bits &= bits - 1)
+						{
+							SIZE found = word * 64 + std::countr_zero(bits);
+							TableEntry value = part.evals[found];
+							if (!value.is_win() && !value.is_lose())
+								continue;
+							Conv::KeyIndexToPosition(part.key, found, pos);
+							for (Move move : pos.all_reverse_moves())
+							{
+								pos -= move;
+								Mark(pos);
+								pos += move;
+							}
+						}
 					}
 				}
-			} while (chage);
+			};
+			RunThreads(worker);
 		}
-		else
+
+		void Mark(const Position& pos)
 		{
-			//TODO:
+			auto [key, index] = KeyIndex(pos);
+			for (Part& part : parts)
+			{
+				if (part.key == key)
+				{
+					uint64_t bit = uint64_t(1) << (index % 64);
+					if (!(part.known[index / 64] & bit) && !(std::atomic_ref(part.candidates[index / 64]).load() & bit))
+						std::atomic_ref(part.candidates[index / 64]).fetch_or(bit);
+					return;
+				}
+			}
 		}
-	}
+
+		/// <summary>
+		/// The value of a successor for the player to move in it, false if not known before the pass.
+		/// The last dependent table is kept, the successors are mostly in the same tables.
+		/// </summary>
+		class Lookup
+		{
+		public:
+			Lookup(Retrograde& retrograde) : retrograde(retrograde) {}
+
+			bool operator()(const Position& pos, TableEntry& value)
+			{
+				auto [key, index] = KeyIndex(pos);
+				for (const Part& part : retrograde.parts)
+				{
+					if (part.key == key)
+					{
+						if (!(part.known[index / 64] & (uint64_t(1) << (index % 64))))
+							return false;
+						value = part.evals[index];
+						return true;
+					}
+				}
+				if (dependent == nullptr || !(dependent_key == key))
+				{
+					dependent_key = key;
+					dependent = find(key);
+					DCHECK(dependent != nullptr);
+				}
+				value = (*dependent)[index];
+				return true;
+			}
+
+		private:
+			Retrograde& retrograde;
+			Key dependent_key;
+			const EndTable* dependent = nullptr;
+		};
+
+		// Returns true if the value of the index is found by the pass
+		bool Solve(int part_index, SIZE index, int pass, Position& pos, Lookup& lookup)
+		{
+			Part& part = parts[part_index];
+			if (pass == 0)
+			{
+				if (!Conv::KeyIndexToPosition(part.key, index, pos))
+				{
+					invalid[part_index]++;
+					return true;
+				}
+				if (pos.is_lost())
+				{
+					part.evals[index] = TableEntry::Lose(0);
+					return true;
+				}
+
+				// A draw without moves, the horizon of the values in the dependent tables
+				bool any_move = false;
+				for (Move move : pos.all_legal_moves_played())
+				{
+					any_move = true;
+					TableEntry value;
+					int plies = horizon;
+					if (lookup(pos, value))
+					{
+						while (value.plies() + 1 > plies && !horizon.compare_exchange_weak(plies, value.plies() + 1));
+					}
+					pos -= move;
+				}
+				return !any_move;
+			}
+
+			Conv::KeyIndexToPosition(part.key, index, pos);
+			bool all_won = true;
+			for (Move move : pos.all_legal_moves_played())
+			{
+				TableEntry value;
+				bool known = lookup(pos, value);
+				pos -= move;
+
+				// The values of the dependent tables are known before their pass
+				if (known && value.plies() < pass)
+				{
+					if (value.is_lose())
+					{
+						part.evals[index] = TableEntry::FromPlies(pass);
+						return true;
+					}
+					if (value.is_win())
+						continue;
+				}
+				all_won = false;
+			}
+			if (all_won)
+				part.evals[index] = TableEntry::FromPlies(pass);
+			return all_won;
+		}
+
+		std::vector<Part> parts;
+		int threads;
+		std::atomic<SIZE> invalid[2];	// counted by the first pass
+		std::atomic<int> horizon = 0;	// the last pass a dependent table value may decide
+	};
 };
@@ -0,0 +1,147 @@
+#include "pch.h"
+
+#include <experimental/generator>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+#include "..\BoardGamesEngine\CompressedTable.h"
+#include "..\BoardGamesEngine\ConverterBatches.h"
+#include "..\BoardGamesEngine\endgametable.h"
+#include "test_files.h"
+
+// Runs of the same result with close distances, as in the tables
+static std::vector<TableEntry> sample_entries(SIZE count)
+{
+	std::mt19937 random(7);
+	std::vector<TableEntry> ret;
+	while (ret.size() < count)
+	{
+		int kind = random() % 3, moves = random() % 30, run = 1 + random() % 50;
+		for (int i = 0; i < run && ret.size() < count; i++)
+		{
+			int distance = std::max(1, moves + int(random() % 3) - 1);
+			ret.push_back(kind == 0 ? TableEntry() : kind == 1 ? TableEntry::Win(distance) : TableEntry::Lose(distance));
+		}
+	}
+	return ret;
+}
+
+TEST(CompressedTable, round_trip)
+{
+	std::string path = temp_path("compressed_round_trip.egtc");
+	std::vector<TableEntry> entries = sample_entries(12345);
+	entries[0] = TableEntry::Lose(0);
+	entries[1] = TableEntry::Win(126);
+	ASSERT_TRUE(CompressedTable::write(path, entries.data(), entries.size(), 1000));
+
+	CompressedTable table;
+	ASSERT_TRUE(table.open(path));
+	EXPECT_EQ(entries.size(), table.size());
+	EXPECT_GT(table.ratio(), 1.5);
+	for (SIZE index = 0; index < entries.size(); index++)
+	{
+		ASSERT_TRUE(entries[index] == table[index]) << index;
+		ASSERT_EQ(entries[index].is_win() ? 1 : entries[index].is_lose() ? -1 : 0, table.wdl(index)) << index;
+	}
+	EXPECT_EQ(13, table.decoded_blocks());
+
+	// The cached blocks aren't decoded again, unlike the blocks of the reopened file
+	for (int i = 0; i < 100; i++)
+		table[5000 + i];
+	EXPECT_EQ(13, table.decoded_blocks());
+	ASSERT_TRUE(table.open(path));
+	table[5000];
+	EXPECT_EQ(14, table.decoded_blocks());
+
+	// Another version isn't opened
+	table.close();
+	{
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(offsetof(CompressedTable::Header, version));
+		file.put(char(CompressedTable::version + 1));
+	}
+	EXPECT_FALSE(table.open(path));
+	EXPECT_FALSE(table.open(temp_path("compressed_missing.egtc")));
+	EXPECT_EQ(0, table.size());
+	std::filesystem::remove(path);
+}
+
+TEST(CompressedTable, endgame)
+{
+	// The compressed table probes as the table, the ratio and the latencies are reported.
+	// The small blocks compress worse and mostly miss the cache, the default blocks of KRK all fit in it.
+	using Table = EndTable<chess::ConverterBatches>;
+	Table::clear();
+	Table::solve("KRK");
+	const Table* solved = Table::find("KRK");
+
+	std::mt19937 random(1);
+	std::vector<SIZE> indices(DebugRelease(2000, 20000));
+	for (SIZE& index : indices)
+		index = random() % solved->size();
+	auto latency = [&indices](auto probe)
+	{
+		auto start = std::chrono::steady_clock::now();
+		int sum = 0;
+		for (SIZE index : indices)
+			sum += probe(index);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		EXPECT_NE(-1, sum);
+		return elapsed.count() / indices.size();
+	};
+	double plain = latency([solved](SIZE index) { return (*solved)[index].plies(); });
+
+	for (uint32_t block_size : { 512u, CompressedTable::default_block_size })
+	{
+		std::string path = temp_path("compressed_KRK.egtc");
+		ASSERT_TRUE(solved->save_compressed(path, block_size));
+		CompressedTable table;
+		ASSERT_TRUE(table.open(path));
+		ASSERT_EQ(solved->size(), table.size());
+		for (SIZE index = 0; index < solved->size(); index++)
+			ASSERT_TRUE((*solved)[index] == table[index]) << index;
+		EXPECT_GT(table.ratio(), block_size == CompressedTable::default_block_size ? 2 : 1);
+
+		size_t decoded = table.decoded_blocks();
+		double compressed = latency([&table](SIZE index) { return table[index].plies(); });
+		double wdl = latency([&table](SIZE index) { return table.wdl(index); });
+		GTEST_LOG_(INFO) << "KRK in blocks of " << block_size << ": " << table.size() << " entries, " << table.compressed_size()
+			<< " bytes, ratio " << table.ratio() << ", random probe " << plain << " ns uncompressed, " << compressed
+			<< " ns compressed, " << wdl << " ns WDL only, " << table.decoded_blocks() - decoded << " blocks decoded";
+		table.close();
+		std::filesystem::remove(path);
+	}
+	Table::clear();
+}
+
+TEST(CompressedTable, threads)
+{
+	// Each thread decodes to its own cache
+	std::string path = temp_path("compressed_threads.egtc");
+	std::vector<TableEntry> entries = sample_entries(100000);
+	ASSERT_TRUE(CompressedTable::write(path, entries.data(), entries.size(), 512));
+	CompressedTable table;
+	ASSERT_TRUE(table.open(path));
+
+	std::atomic<int> errors = 0;
+	auto worker = [&](int seed)
+	{
+		std::mt19937 random(seed);
+		for (int i = 0; i < DebugRelease(2000, 20000); i++)
+		{
+			SIZE index = random() % entries.size();
+			if (!(table[index] == entries[index]))
+				errors++;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int seed = 0; seed < 4; seed++)
+		threads.emplace_back(worker, seed);
+	for (auto& thread : threads)
+		thread.join();
+	EXPECT_EQ(0, errors);
+	std::filesystem::remove(path);
+}
@@ -2,24 +2,510 @@
 
 #include <experimental/generator>
 
+#include <filesystem>
+#include <fstream>
 #include <functional>
+#include <thread>
+#include "..\BoardGamesEngine\Algorithms.h"
+#include "..\BoardGamesEngine\ConverterBatches.h"
 #include "..\BoardGamesEngine\endgametable.h"
 #include "..\BoardGamesEngine\Games\chess_converters.h"
 #include "..\BoardGamesEngine\Games\Connect4.h"
+#include "test_files.h"
 
-TEST(endtable_test, chess)
+// The value of each valid index is the best of its successors
+template <typename Conv>
+void check_consistency(typename Conv::Key key, SIZE step)
+{
+	using Table = EndTable<Conv>;
+	const Table* table = Table::find(key);
+	ASSERT_NE(nullptr, table);
+	typename Conv::Position pos;
+	for (SIZE index = 0; index < table->size(); index += step)
+	{
+		if (!Conv::KeyIndexToPosition(key, index, pos))
+			continue;
+		ASSERT_EQ(index, Conv::PositionToIndex(pos));
+		TableEntry value = (*table)[index];
+		if (pos.is_lost())
+		{
+			EXPECT_TRUE(value == TableEntry::Lose(0));
+			continue;
+		}
+
+		int min_lose = INT_MAX, max_win = -1;
+		bool all_won = true, any_move = false;
+		for (auto move : pos.all_legal_moves_played())
+		{
+			any_move = true;
+			TableEntry next = Table::FindValue(pos);
+			pos -= move;
+			if (next.is_lose())
+				min_lose = std::min(min_lose, next.plies());
+			if (next.is_win())
+				max_win = std::max(max_win, next.plies());
+			else
+				all_won = false;
+		}
+		if (min_lose != INT_MAX)
+			EXPECT_TRUE(value == TableEntry::FromPlies(min_lose + 1)) << index;
+		else if (any_move && all_won)
+			EXPECT_TRUE(value == TableEntry::FromPlies(max_win + 1)) << index;
+		else
+			EXPECT_TRUE(value == TableEntry()) << index;
+	}
+}
+
+TEST(endtable_test, converter_simple)
 {
-	int count = 0;
+	// The index doesn't depend on the color of the player to move
+	chess::ChessPosition white(std::string("4k3/8/8/8/8/8/1Q6/4K3 w - -"));
+	chess::ChessPosition black(std::string("4k3/1q6/8/8/8/8/8/4K3 b - -"));
+	EXPECT_EQ("KQK", chess::ConverterSimple::PositionToKey(white));
+	EXPECT_EQ("KQK", chess::ConverterSimple::PositionToKey(black));
+	EXPECT_EQ(chess::ConverterSimple::PositionToIndex(white), chess::ConverterSimple::PositionToIndex(black));
+	chess::ConverterSimple::flip_if_needed(black);
+	EXPECT_EQ(white.fen(), black.fen());
 
+	// Two pieces on a square, the opponent in check, the same rooks twice
 	chess::ChessPosition pos;
-	EndTable<chess::ConverterSimple>::FindBestMove(pos);
-	EndTable<chess::ConverterReducing>::FindBestMove(pos);
+	EXPECT_FALSE(chess::ConverterSimple::KeyIndexToPosition("KQK", 0, pos));
+	EXPECT_FALSE(chess::ConverterSimple::KeyIndexToPosition("KQK", 4 + 12 * 64 + 60 * 64 * 64, pos));
+	EXPECT_TRUE(chess::ConverterSimple::KeyIndexToPosition("KRRK", 4 + 1 * 64 + 2 * 64 * 64 + 60 * 64 * 64 * 64, pos));
+	EXPECT_FALSE(chess::ConverterSimple::KeyIndexToPosition("KRRK", 4 + 2 * 64 + 1 * 64 * 64 + 60 * 64 * 64 * 64, pos));
+
+	std::vector<std::string> deps;
+	for (auto dep : chess::ConverterSimple::get_dependent_tables("KPKR"))
+		deps.push_back(dep);
+	EXPECT_EQ(std::vector<std::string>({ "KKR", "KQKR", "KRKR", "KBKR", "KNKR", "KPK" }), deps);
+}
+
+TEST(endtable_test, converter_batches)
+{
+	using Conv = chess::ConverterBatches;
+	EXPECT_EQ(462, Conv::king_pairs(false).size());
+	EXPECT_EQ(1806, Conv::king_pairs(true).size());
+	EXPECT_EQ(462 * 62, Conv::KeyToSize("KQK"));
+	EXPECT_EQ(462 * 62 * 61 / 2, Conv::KeyToSize("KRRK"));
+	EXPECT_EQ(1806 * 48 * 47 / 2 * 60, Conv::KeyToSize("KPPKR"));
+
+	// Each index of a position is the index of the position
+	chess::ChessPosition pos;
+	for (std::string key : { "KQK", "KPK", "KPKP", "KRRK" })
+	{
+		for (SIZE index = 0; index < Conv::KeyToSize(key); index += key == "KRRK" ? 97 : 1)
+		{
+			if (Conv::KeyIndexToPosition(key, index, pos))
+			{
+				EXPECT_EQ(key, Conv::PositionToKey(pos));
+				ASSERT_EQ(index, Conv::PositionToIndex(pos)) << key << " " << pos.fen();
+			}
+		}
+	}
+
+	// The symmetric positions and the colors have the same index
+	std::vector<std::string> symmetric = {
+		"8/8/8/8/2k5/8/1Q6/6K1 w - -",
+		"8/8/8/8/5k2/8/6Q1/1K6 w - -",
+		"1K6/6Q1/8/5k2/8/8/8/8 w - -",
+		"8/K7/8/8/8/3k4/1Q6/8 w - -",
+		"6k1/1q6/8/2K5/8/8/8/8 b - -" };
+	for (const std::string& fen : symmetric)
+		EXPECT_EQ(Conv::PositionToIndex(chess::ChessPosition(symmetric[0])), Conv::PositionToIndex(chess::ChessPosition(fen))) << fen;
+
+	// Only the columns are mirrored with pawns
+	EXPECT_EQ(Conv::PositionToIndex(chess::ChessPosition(std::string("8/8/4k3/8/8/8/1P6/6K1 w - -"))),
+		Conv::PositionToIndex(chess::ChessPosition(std::string("8/8/3k4/8/8/8/6P1/1K6 w - -"))));
+	EXPECT_NE(Conv::PositionToIndex(chess::ChessPosition(std::string("8/8/4k3/8/8/8/1P6/6K1 w - -"))),
+		Conv::PositionToIndex(chess::ChessPosition(std::string("6K1/1P6/8/8/8/4k3/8/8 w - -"))));
+}
+
+TEST(endtable_test, batches)
+{
+	// The same values as the tables of 64^n indices, a fraction of the size
+	using Simple = EndTable<chess::ConverterSimple>;
+	using Batches = EndTable<chess::ConverterBatches>;
+	chess::ChessPosition pos;
+	for (std::string key : { "KQK", "KKQ" })
+	{
+		Simple::solve(key, 2);
+		Batches::solve(key, 2);
+		const Simple* simple = Simple::find(key);
+		const Batches* batches = Batches::find(key);
+		GTEST_LOG_(INFO) << key << ": " << batches->size() << " indices instead of " << simple->size()
+			<< ", " << batches->stats().valid << " positions";
+		for (SIZE index = 0; index < simple->size(); index++)
+		{
+			if (chess::ConverterSimple::KeyIndexToPosition(key, index, pos))
+				ASSERT_TRUE((*simple)[index] == (*batches)[chess::ConverterBatches::PositionToIndex(pos)]) << pos.fen();
+		}
+	}
+
+	// The king in front of its pawn on the sixth row wins, the pawn on the sixth row with the king behind is a draw
+	Batches::solve("KPK");
+	EXPECT_TRUE(Batches::FindValue(chess::ChessPosition(std::string("4k3/8/4K3/4P3/8/8/8/8 w - -"))).is_win());
+	EXPECT_TRUE(Batches::FindValue(chess::ChessPosition(std::string("4k3/8/4P3/4K3/8/8/8/8 w - -"))) == TableEntry());
+	EXPECT_TRUE(Batches::FindValue(chess::ChessPosition(std::string("4k3/8/4K3/4P3/8/8/8/8 b - -"))).is_lose());
+	check_consistency<chess::ConverterBatches>("KPK", DebugRelease(97, 7));
+}
+
+TEST(endtable_test, KK)
+{
+	using Table = EndTable<chess::ConverterSimple>;
+	Table::solve("KK");
+	const Table* table = Table::find("KK");
+	ASSERT_NE(nullptr, table);
+	EXPECT_EQ(64 * 64, table->size());
+	EXPECT_EQ(0, table->stats().wins + table->stats().loses);
+	EXPECT_EQ(64 * 64 - 64 - 420, table->stats().valid);
+}
+
+TEST(endtable_test, chess)
+{
+	using Table = EndTable<chess::ConverterSimple>;
+	for (std::string key : { "KQK", "KRK" })
+	{
+		Table::solve(key, 4);
+		auto& stats = Table::find(key)->stats();
+		GTEST_LOG_(INFO) << key << ": " << stats.valid << " positions, " << stats.wins << " wins, " << stats.passes << " passes, "
+			<< int64_t(stats.positions_per_second()) << " positions per second";
+		EXPECT_GT(stats.wins, stats.valid / 2);
+		EXPECT_EQ(0, stats.loses);
+
+		// The lone king never wins, it loses unless it can take the piece or is stalemated
+		auto& opponent = Table::find(chess::ConverterSimple::get_opponent_table(key))->stats();
+		EXPECT_EQ(0, opponent.wins);
+		EXPECT_GT(opponent.loses, opponent.valid / 2);
+	}
+
+	// The longest mates: 10 moves with the queen, 16 with the rook
+	int longest[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		const Table* table = Table::find(i == 0 ? "KQK" : "KRK");
+		for (SIZE index = 0; index < table->size(); index++)
+			longest[i] = std::max(longest[i], (*table)[index].is_win() ? (*table)[index].plies() : 0);
+	}
+	EXPECT_EQ(19, longest[0]);
+	EXPECT_EQ(31, longest[1]);
+
+	chess::ChessPosition mate_in_1(std::string("4k3/8/4K3/8/8/8/8/7R w - -"));
+	EXPECT_TRUE(Table::FindValue(mate_in_1) == TableEntry::Win(1));
+	EXPECT_EQ("H1-H8", Table::FindBestMove(mate_in_1).chess_notation());
+	chess::ChessPosition mate_in_2(std::string("6k1/8/5K2/8/8/8/8/7R w - -"));
+	EXPECT_TRUE(Table::FindValue(mate_in_2) == TableEntry::Win(2));
+	chess::ChessPosition lost(std::string("6k1/8/5K2/8/8/8/8/7R b - -"));
+	EXPECT_TRUE(Table::FindValue(lost).is_lose());
+
+	// The castlings are undone by the backward passes, without the castling rights the king and the rook on their squares castle
+	EXPECT_EQ(21, Table::FindValue(chess::ChessPosition(std::string("8/8/8/6k1/8/8/8/4K2R w K -"))).plies());
+	EXPECT_EQ(23, Table::FindValue(chess::ChessPosition(std::string("8/2k5/8/8/8/8/8/R3K3 w Q -"))).plies());
+
+	check_consistency<chess::ConverterSimple>("KRK", DebugRelease(997, 1));	// every index, the castlings too
+	check_consistency<chess::ConverterSimple>("KKQ", DebugRelease(997, 61));
+}
+
+/// <summary>
+/// The tables of ConverterBatches saved to the directory of the test.
+/// </summary>
+class endtable_files : public TempDirectoryTest
+{
+protected:
+	using Conv = chess::ConverterBatches;
+	using Table = EndTable<Conv>;
+
+	void SetUp() override
+	{
+		TempDirectoryTest::SetUp();
+		Table::clear();
+		Table::set_directory(directory.string());
+	}
+
+	void TearDown() override
+	{
+		Table::set_out_of_core(std::numeric_limits<SIZE>::max());
+		Table::clear();
+		Table::set_directory("");
+		TempDirectoryTest::TearDown();
+	}
+};
+
+TEST_F(endtable_files, files)
+{
+	// The solved tables are saved, then mapped instead of solved again and probed from the files
+	Table::solve("KQK");
+	for (std::string key : { "KQK", "KKQ", "KK" })
+		EXPECT_TRUE(std::filesystem::exists(directory / Table::file_name(key))) << key;
+	EXPECT_EQ("ConverterBatches_KQK.egt", Table::file_name("KQK"));
+	std::vector<TableEntry> solved;
+	for (SIZE index = 0; index < Table::find("KQK")->size(); index++)
+		solved.push_back((*Table::find("KQK"))[index]);
+	auto stats = Table::find("KQK")->stats();
+
+	Table::clear();
+	Table::solve("KQK");
+	const Table* mapped = Table::find("KQK");
+	EXPECT_EQ(0, mapped->stats().seconds);
+	EXPECT_EQ(stats.passes, mapped->stats().passes);
+	EXPECT_EQ(stats.valid, mapped->stats().valid);
+	EXPECT_EQ(stats.wins, mapped->stats().wins);
+	ASSERT_EQ(solved.size(), mapped->size());
+	for (SIZE index = 0; index < solved.size(); index++)
+		ASSERT_TRUE(solved[index] == (*mapped)[index]) << index;
+
+	chess::ChessPosition mate_in_1(std::string("4k3/8/4K3/8/8/8/8/7Q w - -"));
+	EXPECT_TRUE(Table::probe(mate_in_1) == TableEntry::Win(1));
+	EXPECT_FALSE(Table::probe(chess::ChessPosition(std::string("4k3/8/4K3/8/8/8/8/7R w - -"))).has_value());
+
+	// The file of another version isn't mapped
+	Table::clear();
+	{
+		std::fstream file(directory / Table::file_name("KKQ"), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(offsetof(Table::Header, version));
+		file.put(char(Table::version + 1));
+	}
+	EXPECT_FALSE(Table::probe(chess::ChessPosition(std::string("4k3/8/4K3/8/8/8/8/7Q b - -"))).has_value());
+	EXPECT_TRUE(Table::probe(mate_in_1).has_value());
+	EXPECT_EQ(2, Table::probe_stats().loads);	// the table of white to move twice, before and after clear()
+}
+
+TEST_F(endtable_files, probe_missing)
+{
+	// A missing file is looked for again after the retry time, a table solved since is probed at once
+	Table::set_directory(directory.string(), std::numeric_limits<size_t>::max(), std::chrono::milliseconds(50));
+	chess::ChessPosition mate_in_1(std::string("4k3/8/4K3/8/8/8/8/7Q w - -"));
+	EXPECT_FALSE(Table::probe(mate_in_1).has_value());
+	Table::solve("KQK");
+	EXPECT_TRUE(Table::probe(mate_in_1) == TableEntry::Win(1));
+
+	// Written by another process
+	std::filesystem::path file = directory / Table::file_name("KQK");
+	std::filesystem::rename(file, directory / "moved");
+	Table::clear();
+	EXPECT_FALSE(Table::probe(mate_in_1).has_value());
+	std::filesystem::rename(directory / "moved", file);
+	EXPECT_FALSE(Table::probe(mate_in_1).has_value());
+	std::this_thread::sleep_for(std::chrono::milliseconds(60));
+	EXPECT_TRUE(Table::probe(mate_in_1) == TableEntry::Win(1));
+	EXPECT_EQ(2, Table::probe_stats().loads);	// after the solve and once the file is back
+}
+
+TEST_F(endtable_files, probe_budget)
+{
+	// The budget fits one table, the threads probing two tables map and unmap them concurrently
+	Table::solve("KQK");
+	Table::solve("KRK");
+	size_t budget = sizeof(Table::Header) + Conv::KeyToSize("KQK");
+	Table::set_directory(directory.string(), budget);
+
+	std::atomic<int> errors = 0;
+	auto worker = [&](int seed)
+	{
+		chess::ChessPosition pos;
+		for (int i = 0; i < DebugRelease(2000, 20000); i++)
+		{
+			std::string key = (i / 100 + seed) % 2 ? "KQK" : "KRK";
+			SIZE index = (SIZE(i) * 7919 + seed) % Conv::KeyToSize(key);
+			if (!Conv::KeyIndexToPosition(key, index, pos))
+				continue;
+			std::optional<TableEntry> value = Table::probe(pos);
+			if (!value || !(*value == (*Table::find(key))[index]))
+				errors++;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int seed = 0; seed < 4; seed++)
+		threads.emplace_back(worker, seed);
+	for (auto& thread : threads)
+		thread.join();
+
+	auto stats = Table::probe_stats();
+	GTEST_LOG_(INFO) << stats.probes << " probes, " << stats.loads << " loads, " << stats.evictions << " evictions";
+	EXPECT_EQ(0, errors);
+	EXPECT_GT(stats.evictions, 0);
+	EXPECT_EQ(stats.loads, stats.evictions + 1);
+	EXPECT_LE(stats.mapped_bytes, budget);
+}
+
+TEST_F(endtable_files, minmax_probing)
+{
+	// The search of depth 2 plays as the tables: the children are probed instead of searched
+	using Search = MinMax<chess::ChessPosition>;
+	Table::solve("KQK");
+	Table::solve("KRK");
+	Search::attach_endgame_tables(Table::probe, 3);
+
+	// Each move keeps the win and gets a ply closer to the mate
+	chess::ChessPosition pos(std::string("8/8/8/4k3/8/8/8/R3K3 w - -"));
+	int plies = Table::FindValue(pos).plies();
+	EXPECT_GT(plies, 5);
+	for (int i = 0; i < 5; i++)
+	{
+		chess::Move move = Search::FindBestMove(pos, 2);
+		ASSERT_TRUE(move.is_valid());
+		pos += move;
+		TableEntry value = Table::FindValue(pos);
+		EXPECT_EQ(plies - 1, value.plies()) << i;
+		plies = value.plies() - 1;
+		pos += Table::FindBestMove(pos);
+	}
+
+	// The capture of the rook leads to a table, the other moves to the horizon
+	size_t probes = Table::probe_stats().probes;
+	chess::ChessPosition capture(std::string("4k3/8/8/3r4/8/8/8/3QK3 w - -"));
+	EXPECT_EQ("D1-D5", Search::FindBestMove(capture, 2).chess_notation());
+	EXPECT_GT(Table::probe_stats().probes, probes);
+
+	// Over the pieces of the tables nothing is probed
+	Search::attach_endgame_tables(Table::probe, 2);
+	probes = Table::probe_stats().probes;
+	Search::FindBestMove(pos, 2);
+	EXPECT_EQ(probes, Table::probe_stats().probes);
+
+	Search::attach_endgame_tables(nullptr);
+}
+
+TEST_F(endtable_files, out_of_core)
+{
+	// Solved in sessions of a few passes in the working files, as the passes resumed after a crash
+	Table::set_directory("");	// the reference solved in memory
+	Table::solve("KRK");
+	std::vector<TableEntry> solved[2];
+	Table::Stats stats[2];
+	for (int i = 0; i < 2; i++)
+	{
+		const Table* table = Table::find(i == 0 ? "KRK" : "KKR");
+		stats[i] = table->stats();
+		for (SIZE index = 0; index < table->size(); index++)
+			solved[i].push_back((*table)[index]);
+	}
+
+	Table::clear();
+	Table::set_directory(directory.string());
+	Table::set_out_of_core(Conv::KeyToSize("KRK"), 4);
+	Table::solve("KRK", 2);
+	EXPECT_EQ(nullptr, Table::find("KRK"));
+	EXPECT_NE(nullptr, Table::find("KK"));
+	for (std::string key : { "KRK", "KKR" })
+	{
+		EXPECT_TRUE(std::filesystem::exists(directory / (Table::file_name(key) + ".work"))) << key;
+		EXPECT_TRUE(std::filesystem::exists(directory / (Table::file_name(key) + ".checkpoint"))) << key;
+		EXPECT_FALSE(std::filesystem::exists(directory / Table::file_name(key))) << key;
+	}
+
+	// A crash after the checkpoint of one table only, the other one is a pass behind
+	Table::solve("KRK", 2);
+	{
+		std::fstream file(directory / (Table::file_name("KKR") + ".checkpoint"), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekg(16);
+		int32_t pass;
+		file.read(reinterpret_cast<char*>(&pass), sizeof(pass));
+		EXPECT_EQ(7, pass);
+		pass--;
+		file.seekp(16);
+		file.write(reinterpret_cast<const char*>(&pass), sizeof(pass));
+	}
+
+	int sessions = 2;
+	for (; Table::find("KRK") == nullptr && sessions < 20; sessions++)
+		Table::solve("KRK", 2);
+	EXPECT_EQ((stats[0].passes - 7) / 4 + 3, sessions);
+	for (int i = 0; i < 2; i++)
+	{
+		std::string key = i == 0 ? "KRK" : "KKR";
+		const Table* table = Table::find(key);
+		ASSERT_NE(nullptr, table);
+		EXPECT_EQ(stats[i].passes, table->stats().passes);
+		EXPECT_EQ(stats[i].valid, table->stats().valid);
+		EXPECT_EQ(stats[i].wins, table->stats().wins);
+		EXPECT_EQ(stats[i].loses, table->stats().loses);
+		ASSERT_EQ(solved[i].size(), table->size());
+		for (SIZE index = 0; index < table->size(); index++)
+			ASSERT_TRUE(solved[i][index] == (*table)[index]) << key << " " << index;
+		EXPECT_TRUE(std::filesystem::exists(directory / Table::file_name(key))) << key;
+		EXPECT_FALSE(std::filesystem::exists(directory / (Table::file_name(key) + ".work"))) << key;
+		EXPECT_FALSE(std::filesystem::exists(directory / (Table::file_name(key) + ".checkpoint"))) << key;
+	}
+
+	// The finished files are the table files
+	Table::clear();
+	Table::solve("KRK");
+	EXPECT_EQ(0, Table::find("KRK")->stats().seconds);
+	EXPECT_TRUE(Table::find("KRK")->stats().passes == stats[0].passes);
+}
+
+TEST_F(endtable_files, out_of_core_dependent)
+{
+	// All the tables out of core: the promotions of KPK stop by the pass limit before KPK starts
+	Table::set_out_of_core(0, 4);
+
+	// FindValue solves whole, regardless of the pass limit
+	EXPECT_TRUE(Table::FindValue(chess::ChessPosition(std::string("4k3/8/4K3/8/8/8/8/7Q w - -"))) == TableEntry::Win(1));
+	EXPECT_GT(Table::find("KQK")->stats().passes, 4);
+
+	Table::clear();
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	EXPECT_FALSE(Table::solve("KPK", 4));
+	EXPECT_EQ(nullptr, Table::find("KPK"));
+	EXPECT_EQ(nullptr, Table::find("KQK"));
+
+	int sessions = 1;
+	for (; !Table::solve("KPK", 4) && sessions < 100; sessions++)
+		EXPECT_EQ(nullptr, Table::find("KPK"));
+	EXPECT_GT(sessions, 10);
+	EXPECT_LT(sessions, 100);
+	ASSERT_NE(nullptr, Table::find("KPK"));
+	EXPECT_TRUE(Table::FindValue(chess::ChessPosition(std::string("4k3/8/4K3/4P3/8/8/8/8 w - -"))).is_win());
+	EXPECT_TRUE(Table::FindValue(chess::ChessPosition(std::string("4k3/8/4P3/4K3/8/8/8/8 w - -"))) == TableEntry());
+	check_consistency<Conv>("KPK", DebugRelease(997, 61));
+}
+
+TEST(endtable_test, threads)
+{
+	// The passes give the same values on any number of threads
+	using Table = EndTable<chess::ConverterSimple>;
+	Table::solve("KQK", 1);
+	std::vector<TableEntry> single;
+	for (SIZE index = 0; index < Table::find("KQK")->size(); index++)
+		single.push_back((*Table::find("KQK"))[index]);
+	Table::clear();
+	Table::solve("KQK", 3);
+	for (SIZE index = 0; index < single.size(); index++)
+		ASSERT_TRUE(single[index] == (*Table::find("KQK"))[index]) << index;
+}
+
+template <int W, int H, int R>
+void solve_mnk(int threads)
+{
+	using Conv = MNKGGravityConverter<W, H, R>;
+	using Table = EndTable<Conv>;
+	typename Conv::Key empty{};
+	auto start = std::chrono::steady_clock::now();
+	Table::solve(empty, threads);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	TableEntry value = Table::FindValue(typename Conv::Position());
+	GTEST_LOG_(INFO) << W << "x" << H << " connect " << R << ": " << (value.is_win() ? "win" : value.is_lose() ? "lose" : "draw")
+		<< " in " << value.plies() << " plies, " << seconds << "s";
+	check_consistency<Conv>(empty, 1);
 }
 
-TEST(endtable_test, Connect4)
+TEST(endtable_test, MNKGravity)
 {
-	int count = 0;
+	// Connect 3 on 3x3 is a draw, on 4x3 the first player wins
+	using Small = EndTable<MNKGGravityConverter<3, 3, 3>>;
+	solve_mnk<3, 3, 3>(1);
+	EXPECT_TRUE(Small::FindValue(MNKGravity<3, 3, 3>()) == TableEntry());
+	using Large = EndTable<MNKGGravityConverter<4, 4, 3>>;
+	solve_mnk<4, 4, 3>(4);
+	EXPECT_TRUE(Large::FindValue(MNKGravity<4, 4, 3>()).is_win());
 
-	Connect4 connect4;
-	EndTable<MNKGGravityConverter<7,6,4>>::FindBestMove(connect4);
+	using Conv = MNKGGravityConverter<4, 4, 3>;
+	MNKGravity<4, 4, 3> pos;
+	for (SIZE index = 0; index < Conv::KeyToSize({ 2, 1, 0, 1 }); index++)
+	{
+		if (Conv::KeyIndexToPosition({ 2, 1, 0, 1 }, index, pos))
+			EXPECT_EQ(index, Conv::PositionToIndex(pos));
+	}
 }
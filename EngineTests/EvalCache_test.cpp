@@ -0,0 +1,90 @@
+#include "pch.h"
+#include <thread>
+#include "..\BoardGamesEngine\Games\chess.h"
+#include "..\BoardGamesEngine\Algorithms.h"
+#include "..\BoardGamesEngine\EvalCache.h"
+
+TEST(EvalCache, store_probe)
+{
+	EvalCache cache(1000);
+	EXPECT_EQ(512, cache.size());
+
+	int32_t value;
+	EXPECT_FALSE(cache.probe(0, value));
+	EXPECT_FALSE(cache.probe(12345, value));
+
+	cache.store(12345, -7);
+	ASSERT_TRUE(cache.probe(12345, value));
+	EXPECT_EQ(-7, value);
+
+	// Same slot, different key: not a hit, and the new key replaces the old one
+	uint64_t other = 12345 + (uint64_t(1) << 40);
+	EXPECT_FALSE(cache.probe(other, value));
+	cache.store(other, 3);
+	EXPECT_TRUE(cache.probe(other, value));
+	EXPECT_EQ(3, value);
+	EXPECT_FALSE(cache.probe(12345, value));
+
+	cache.clear();
+	EXPECT_FALSE(cache.probe(other, value));
+}
+
+TEST(EvalCache, threads)
+{
+	// The value is a function of the key, a hit never returns the value of another key
+	EvalCache cache(1 << 10);
+	auto value_of = [](uint64_t key) { return int32_t(key * 0x9E3779B97F4A7C15ull >> 40); };
+	std::atomic<int> wrong = 0, hits = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			Xoshiro256 rng(t + 1);
+			for (int i = 0; i < 200000; i++)
+			{
+				uint64_t key = rng() % 5000 * 0x2545F4914F6CDD1Dull;
+				int32_t value;
+				if (cache.probe(key, value))
+				{
+					hits++;
+					if (value != value_of(key))
+						wrong++;
+				}
+				else
+				{
+					cache.store(key, value_of(key));
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	EXPECT_EQ(0, wrong);
+	EXPECT_GT(hits, 0);
+}
+
+TEST(EvalCache, MinMax)
+{
+	// The legal moves term generates the moves at each leaf
+	size_t evaluations = 0;
+	auto eval = [&evaluations](chess::ChessPosition& pos) -> EvalValue::payload_t
+	{
+		evaluations++;
+		return pos.evaluate<10, 0, 1>();
+	};
+
+	chess::ChessPosition pos(std::string("1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5"));
+	chess::Move move = MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, true>::FindBestMove(pos, 4, eval);
+	size_t uncached = evaluations;
+
+	EvalCache cache;
+	MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, true>::attach_eval_cache(&cache);
+	evaluations = 0;
+	chess::Move cached_move = MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, true>::FindBestMove(pos, 4, eval);
+	MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, true>::attach_eval_cache(nullptr);
+
+	EXPECT_EQ(move.chess_notation(), cached_move.chess_notation());
+	EXPECT_LT(evaluations, uncached);
+	GTEST_LOG_(INFO) << "Evaluations without the cache: " << uncached << ", with the cache: " << evaluations;
+}
@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "..\BoardGamesEngine\Match.h"
+#include "..\BoardGamesEngine\Algorithms.h"
+#include "..\BoardGamesEngine\Games\Connect4.h"
+#include "..\BoardGamesEngine\Games\chess.h"
+
+TEST(Match, sprt)
+{
+	Sprt sprt{ .elo0 = 0, .elo1 = 10 };
+	EXPECT_NEAR(-2.944, sprt.lower_bound(), 0.001);
+	EXPECT_NEAR(2.944, sprt.upper_bound(), 0.001);
+	EXPECT_NEAR(0.5, Sprt::expected_score(0), 1e-9);
+
+	// A better score moves toward H1, all draws toward H0 and all wins toward H1 despite no variance
+	EXPECT_EQ(0, sprt.llr(0, 0, 0));
+	EXPECT_LT(sprt.llr(0, 100, 0), sprt.lower_bound());
+	EXPECT_GT(sprt.llr(100, 0, 0), sprt.upper_bound());
+	EXPECT_GT(sprt.llr(60, 20, 40), 0);
+	EXPECT_LT(sprt.llr(40, 20, 60), 0);
+	EXPECT_GT(sprt.llr(600, 200, 400), sprt.llr(60, 20, 40));
+}
+
+TEST(Match, elo)
+{
+	MatchResult result{ .wins = 50, .draws = 0, .losses = 50 };
+	EXPECT_NEAR(0, result.elo(), 1e-9);
+	result.wins = 100;
+	result.draws = 100;
+	result.losses = 0;
+	EXPECT_NEAR(0.75, result.score(), 1e-9);
+	EXPECT_NEAR(190.85, result.elo(), 0.01);
+	EXPECT_GT(result.elo_error(), 0);
+
+	// More games narrow the interval
+	MatchResult more{ .wins = 500, .draws = 1000, .losses = 0 };
+	EXPECT_LT(more.elo_error(), result.elo_error());
+}
+
+static Match<Connect4>::Engine connect4_minmax(int depth)
+{
+	return [depth](const Connect4& position, const std::vector<uint64_t>&)
+	{
+		return MinMax<Connect4>::FindBestMove(position, depth);
+	};
+}
+
+static Match<Connect4>::Engine connect4_random = [](const Connect4& position, const std::vector<uint64_t>&)
+{
+	Connect4 copy = position;
+	return random_move(copy, 1);
+};
+
+TEST(Match, sprt_stops)
+{
+	Match<Connect4> match(connect4_minmax(4), connect4_random);
+	Sprt sprt{ .elo0 = 0, .elo1 = 50 };
+	for (int threads : { 1, 4 })
+	{
+		auto result = match.Run({ .games = 1000, .threads = threads, .sprt = sprt });
+		EXPECT_EQ(SprtDecision::H1, result.decision);
+		EXPECT_LT(result.games(), 1000);
+		EXPECT_GE(result.llr, sprt.upper_bound());
+		EXPECT_GT(result.wins, result.losses);
+		GTEST_LOG_(INFO) << threads << " threads: " << result.games() << " games, elo " << result.elo() << " +- " << result.elo_error();
+	}
+
+	// Without the SPRT all the games are played
+	auto result = Match<Connect4>(connect4_random, connect4_random).Run({ .games = 40, .threads = 3 });
+	EXPECT_EQ(40, result.games());
+	EXPECT_EQ(SprtDecision::None, result.decision);
+}
+
+TEST(Match, chess_colors_alternate)
+{
+	chess::ChessPosition::initialize_transposition_tables();
+	auto engine = [](const chess::ChessPosition& position, const std::vector<uint64_t>& history)
+	{
+		return MinMax<chess::ChessPosition, KillerOptions::Fixed2>::FindBestMove(position, 2,
+			[](chess::ChessPosition& pos) -> EvalValue::payload_t { return pos.evaluate<1>(); }, history);
+	};
+	std::vector<chess::ChessPosition> openings;
+	for (std::string pgn : { "1. e4 e5", "1. d4 d5", "1. c4 e5 2. Nc3" })
+		openings.push_back(chess::ChessPosition(pgn));
+
+	// The same deterministic engine loses each opening with one color as much as it wins it with the other
+	auto result = Match<chess::ChessPosition>(engine, engine, openings).Run({ .games = 6, .threads = 2, .max_plies = 60 });
+	EXPECT_EQ(6, result.games());
+	EXPECT_EQ(result.wins, result.losses);
+	EXPECT_GT(result.plies, 0);
+	EXPECT_NEAR(0, result.elo(), 1e-9);
+}
+
+TEST(Match, repetition)
+{
+	// The kings walk back and forth, the third repetition is a draw
+	auto shuffle = [](const chess::ChessPosition& position, const std::vector<uint64_t>&)
+	{
+		for (chess::Move move : position.all_legal_moves())
+		{
+			std::string notation = move.chess_notation();
+			if (notation == "E1-D1" || notation == "D1-E1" || notation == "E8-D8" || notation == "D8-E8")
+				return move;
+		}
+		return chess::Move();
+	};
+	int plies;
+	auto winner = Match<chess::ChessPosition>::Play(chess::ChessPosition(std::string("4k3/8/8/8/8/8/8/4K3")), shuffle, shuffle, 100, plies);
+	EXPECT_FALSE(winner);
+	EXPECT_EQ(8, plies);
+}
@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "..\BoardGamesEngine\MonteCarloTreeSearch.h"
+#include "..\BoardGamesEngine\Algorithms.h"
+#include "..\BoardGamesEngine\Games\Gomoku.h"
+
+TEST(MonteCarloTreeSearch, TicTacToe_win)
+{
+	TicTacToe ttt(std::string("3/1XO/1XO"));
+	auto move = MonteCarloTreeSearch<TicTacToe>::FindBestMove(ttt, 100);
+	EXPECT_TRUE(ttt.easycheck_winning_move(move)) << move.chess_notation();
+}
+
+TEST(MonteCarloTreeSearch, TicTacToe_block)
+{
+	// O threatens on the diagonal, blocking it creates a fork
+	TicTacToe ttt(std::string("X1O/1O1/1X1"));
+	Move<3, 3> expected = MinMax<TicTacToe>::FindBestMove(ttt, 4);
+
+	MonteCarloTreeSearch<TicTacToe> mcts(ttt);
+	EXPECT_EQ(expected, mcts.Search());
+	EXPECT_EQ(10000, mcts.playouts());
+
+	MonteCarloTreeSearch<TicTacToe, true> rave(ttt);
+	EXPECT_EQ(expected, rave.Search());
+}
+
+TEST(MonteCarloTreeSearch, TicTacToe_threads)
+{
+	TicTacToe ttt(std::string("X1O/1O1/1X1"));
+	Move<3, 3> expected = MinMax<TicTacToe>::FindBestMove(ttt, 4);
+
+	MonteCarloTreeSearch<TicTacToe>::Options options;
+	options.threads = 4;
+	MonteCarloTreeSearch<TicTacToe> mcts(ttt, options);
+	EXPECT_EQ(expected, mcts.Search());
+	EXPECT_EQ(options.playouts, mcts.playouts());
+}
+
+TEST(MonteCarloTreeSearch, small_arena)
+{
+	// Not enough nodes to expand beyond the root, the search continues with the playouts only
+	TicTacToe ttt(std::string("X1O/1O1/1X1"));
+	MonteCarloTreeSearch<TicTacToe>::Options options;
+	options.memory = 0;
+	MonteCarloTreeSearch<TicTacToe> mcts(ttt, options);
+	EXPECT_FALSE(mcts.Search().is_valid());
+	EXPECT_EQ(1, mcts.nodes_used());
+	EXPECT_EQ(options.playouts, mcts.playouts());
+}
+
+TEST(MonteCarloTreeSearch, Gomoku19_open_four)
+{
+	Gomoku19 gomoku;
+	for (int i = 0; i < 4; i++)
+	{
+		gomoku += Move<19, 19>{ SquareBase<19, 19>(5 + i, 5), Field::X };
+		gomoku += Move<19, 19>{ SquareBase<19, 19>(2 * i, 12), Field::O };
+	}
+
+	MonteCarloTreeSearch<Gomoku19>::Options options;
+	options.playouts = 200;
+	options.threads = 2;
+	auto move = MonteCarloTreeSearch<Gomoku19>::FindBestMove(gomoku, options);
+	EXPECT_TRUE(gomoku.easycheck_winning_move(move)) << move.square.x() << "," << move.square.y();
+}
+
+TEST(MonteCarloTreeSearch, Gomoku19_time_budget)
+{
+	Gomoku19 gomoku;
+	MonteCarloTreeSearch<Gomoku19, true>::Options options;
+	options.playouts = 0;
+	options.time = std::chrono::milliseconds(200);
+	options.threads = 2;
+	MonteCarloTreeSearch<Gomoku19, true> mcts(gomoku, options);
+	auto move = mcts.Search();
+	EXPECT_TRUE(gomoku.is_legal(move));
+	GTEST_LOG_(INFO) << "Playouts: " << mcts.playouts() << " Nodes: " << mcts.nodes_used() << " Move: " << move.square.x() << "," << move.square.y();
+}
@@ -0,0 +1,94 @@
+#include "pch.h"
+#include <map>
+#include "..\BoardGamesEngine\Playout.h"
+#include "..\BoardGamesEngine\Games\Connect4.h"
+#include "..\BoardGamesEngine\Games\chess.h"
+
+TEST(Playout, xoshiro)
+{
+	Xoshiro256 a(1), b(1), c(2);
+	bool differ = false;
+	for (int i = 0; i < 100; i++)
+	{
+		uint64_t x = a();
+		EXPECT_EQ(x, b());
+		differ |= x != c();
+	}
+	EXPECT_TRUE(differ);
+
+	int counts[3] = {};
+	for (int i = 0; i < 3000; i++)
+	{
+		uint32_t n = a.below(3);
+		ASSERT_LT(n, 3);
+		counts[n]++;
+	}
+	for (int count : counts)
+		EXPECT_NEAR(count, 1000, 150);
+}
+
+TEST(Playout, random_move_uniform)
+{
+	// All 9 moves are picked about the same number of times
+	TicTacToe ttt;
+	Xoshiro256 rng(7);
+	std::map<int, int> counts;
+	size_t number_of_moves;
+	for (int i = 0; i < 9000; i++)
+		counts[int(random_move(ttt, rng, number_of_moves).square)]++;
+	EXPECT_EQ(9, number_of_moves);
+	EXPECT_EQ(9, counts.size());
+	for (auto [square, count] : counts)
+		EXPECT_NEAR(count, 1000, 150) << square;
+}
+
+TEST(Playout, reproducible)
+{
+	for (uint64_t seed = 0; seed < 20; seed++)
+	{
+		TicTacToe a, b;
+		PlayoutResult ra = Playout<TicTacToe>::Play(a, seed);
+		PlayoutResult rb = Playout<TicTacToe>::Play(b, seed);
+		EXPECT_EQ(ra.winner, rb.winner);
+		EXPECT_EQ(ra.plies, rb.plies);
+		EXPECT_LE(ra.plies, 9);
+		EXPECT_EQ(a.get_hash(), b.get_hash());
+	}
+}
+
+TEST(Playout, revert)
+{
+	Connect4 connect4;
+	Xoshiro256 rng(3);
+	std::vector<Move<7, 6>> played;
+	PlayoutResult result = Playout<Connect4>::Play(connect4, rng, 1000, &played);
+	EXPECT_EQ(result.plies, played.size());
+	for (size_t i = played.size(); i-- > 0;)
+		connect4 -= played[i];
+	EXPECT_EQ(Connect4().get_hash(), connect4.get_hash());
+	EXPECT_EQ(Player::First, connect4.turn());
+}
+
+TEST(Playout, threads)
+{
+	// The totals don't depend on the number of threads
+	Connect4 connect4;
+	auto single = Playout<Connect4>::Run(connect4, 2000, 1, 42);
+	auto multi = Playout<Connect4>::Run(connect4, 2000, 4, 42);
+	EXPECT_EQ(2000, single.playouts);
+	EXPECT_EQ(single.first_wins, multi.first_wins);
+	EXPECT_EQ(single.second_wins, multi.second_wins);
+	EXPECT_EQ(single.draws, multi.draws);
+	EXPECT_EQ(single.plies, multi.plies);
+	GTEST_LOG_(INFO) << "Connect4 playouts/sec: " << single.playouts_per_second() << " (1 thread), "
+		<< multi.playouts_per_second() << " (4 threads)";
+}
+
+TEST(Playout, chess)
+{
+	chess::ChessPosition pos;
+	auto stats = Playout<chess::ChessPosition>::Run(pos, DebugRelease(10, 100), 2, 1, 500);
+	EXPECT_EQ(stats.playouts, stats.first_wins + stats.second_wins + stats.draws);
+	GTEST_LOG_(INFO) << "Chess playouts/sec: " << stats.playouts_per_second()
+		<< " plies/sec: " << stats.plies / stats.seconds;
+}
@@ -0,0 +1,74 @@
+#include "pch.h"
+#include "..\BoardGamesEngine\ProofNumberSearch.h"
+#include "..\BoardGamesEngine\Games\Connect4.h"
+
+TEST(ProofNumberSearch, TicTacToe_draw)
+{
+	TicTacToe ttt;
+	ProofNumberSearch<TicTacToe> pns;
+	EXPECT_EQ(ProofResult::Draw, pns.solve(ttt));
+	GTEST_LOG_(INFO) << "Nodes: " << pns.nodes() << " Proof tree: " << pns.proof_tree_size();
+}
+
+TEST(ProofNumberSearch, TicTacToe_X_wins)
+{
+	TicTacToe ttt(std::string("3/1XO/1XO"));
+	ProofNumberSearch<TicTacToe> pns;
+	EXPECT_EQ(ProofResult::Win, pns.solve(ttt));
+	EXPECT_EQ(1, pns.proof_tree_size());
+}
+
+TEST(ProofNumberSearch, TicTacToe_X_forks_and_wins)
+{
+	TicTacToe ttt(std::string("3/XXO/1O1"));
+	ProofNumberSearch<TicTacToe> pns;
+	EXPECT_EQ(ProofResult::Win, pns.solve(ttt));
+
+	// The fork in the corner leaves O in a lost position,
+	// while playing next to it lets O fork instead
+	int losses = 0, wins = 0;
+	for (auto move : ttt.all_legal_moves())
+	{
+		TicTacToe child = ttt;
+		child += move;
+		ProofResult result = pns.solve(child);
+		losses += result == ProofResult::Loss;
+		wins += result == ProofResult::Win;
+	}
+	EXPECT_GT(losses, 0);
+	EXPECT_GT(wins, 0);
+}
+
+TEST(ProofNumberSearch, MNK_4_4_3)
+{
+	MNK<4, 4, 3> mnk;
+	ProofNumberSearch<MNK<4, 4, 3>> pns;
+	EXPECT_EQ(ProofResult::Win, pns.solve(mnk));
+	GTEST_LOG_(INFO) << "Nodes: " << pns.nodes() << " Proof tree: " << pns.proof_tree_size();
+}
+
+TEST(ProofNumberSearch, MNK_4_4_3_bounded_memory)
+{
+	// Only 256 entries, most of the positions get evicted and proved again
+	MNK<4, 4, 3> mnk;
+	ProofNumberSearch<MNK<4, 4, 3>> pns(256 * 24);
+	EXPECT_LE(pns.memory(), 256 * 24);
+	EXPECT_EQ(ProofResult::Win, pns.solve(mnk));
+	GTEST_LOG_(INFO) << "Nodes: " << pns.nodes() << " Proof tree: " << pns.proof_tree_size();
+}
+
+TEST(ProofNumberSearch, Gravity_4_3_3)
+{
+	// Same as Connect4_test.FourByThree, X wins
+	MNKGravity<4, 3, 3> four_by_three;
+	ProofNumberSearch<MNKGravity<4, 3, 3>> pns;
+	EXPECT_EQ(ProofResult::Win, pns.solve(four_by_three));
+	GTEST_LOG_(INFO) << "Nodes: " << pns.nodes() << " Proof tree: " << pns.proof_tree_size();
+}
+
+TEST(ProofNumberSearch, node_budget)
+{
+	MNK<4, 4, 3> mnk;
+	ProofNumberSearch<MNK<4, 4, 3>> pns(size_t(1) << 20, 10);
+	EXPECT_EQ(ProofResult::Unknown, pns.solve(mnk));
+}
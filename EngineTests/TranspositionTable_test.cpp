@@ -0,0 +1,137 @@
+#include "pch.h"
+#include <filesystem>
+#include "..\BoardGamesEngine\Games\chess.h"
+#include "..\BoardGamesEngine\Games\MNKGeneralized.h"
+#include "..\BoardGamesEngine\Algorithms.h"
+#include "..\BoardGamesEngine\TranspositionTable.h"
+#include "test_files.h"
+
+using ChessTable = TranspositionTable<chess::ChessPosition>;
+
+TEST(TranspositionTable, store_probe)
+{
+	ChessTable table(1000);
+	EXPECT_EQ(512, table.size());
+
+	chess::Move move(chess::Square("E2"), chess::Square("E4"), chess::Piece::Pawn);
+	ChessTable::Payload payload;
+	EXPECT_FALSE(table.probe(12345, payload));
+
+	table.store(12345, move, -7, 4);
+	ASSERT_TRUE(table.probe(12345, payload));
+	EXPECT_TRUE(move == payload.move);
+	EXPECT_EQ(-7, payload.value);
+	EXPECT_EQ(4, payload.depth);
+
+	// Same bucket, shallower: kept in the second slot, the deeper one stays
+	uint64_t other = 12345 + 512;
+	table.store(other, move, 3, 2);
+	EXPECT_TRUE(table.probe(12345, payload));
+	EXPECT_TRUE(table.probe(other, payload));
+	EXPECT_EQ(3, payload.value);
+
+	// Different key in the same slot isn't a hit
+	EXPECT_FALSE(table.probe(12345 + 1024, payload));
+}
+
+TEST(TranspositionTable, file_reload)
+{
+	std::string path = temp_path("tt_reload.bin");
+	chess::Move move(chess::Square("G1"), chess::Square("F3"), chess::Piece::Knight);
+	{
+		ChessTable table;
+		ASSERT_TRUE(table.open(path, 1 << 12));
+		EXPECT_FALSE(table.warm());
+		table.store(42, move, 100, 6);
+		table.flush();
+	}
+	{
+		ChessTable table;
+		ASSERT_TRUE(table.open(path, 1 << 12));
+		EXPECT_TRUE(table.warm());
+		ChessTable::Payload payload;
+		ASSERT_TRUE(table.probe(42, payload));
+		EXPECT_TRUE(move == payload.move);
+		EXPECT_EQ(100, payload.value);
+	}
+	{
+		// A different size doesn't match the header, the table starts empty
+		ChessTable table;
+		ASSERT_TRUE(table.open(path, 1 << 10));
+		EXPECT_FALSE(table.warm());
+		ChessTable::Payload payload;
+		EXPECT_FALSE(table.probe(42, payload));
+	}
+	std::filesystem::remove(path);
+}
+
+TEST(TranspositionTable, other_game)
+{
+	std::string path = temp_path("tt_other_game.bin");
+	{
+		ChessTable table;
+		ASSERT_TRUE(table.open(path, 1 << 10));
+	}
+	{
+		// The header of the chess table doesn't match
+		TranspositionTable<TicTacToe> table;
+		ASSERT_TRUE(table.open(path, 1 << 10));
+		EXPECT_FALSE(table.warm());
+	}
+	std::filesystem::remove(path);
+}
+
+TEST(TranspositionTable, MinMax_warm_start)
+{
+	std::string path = temp_path("tt_minmax.bin");
+	chess::ChessPosition pos(std::string("6k1/8/5K2/8/8/8/8/7R"));
+	chess::Move expected = MinMax<chess::ChessPosition>::FindBestMove(pos, 4);
+
+	ChessTable table;
+	ASSERT_TRUE(table.open(path, 1 << 16));
+	MinMax<chess::ChessPosition>::attach_transposition_table(&table);
+	EXPECT_EQ(expected.chess_notation(), MinMax<chess::ChessPosition>::FindBestMove(pos, 4).chess_notation());
+	size_t cold_misses = table.misses();
+	table.close();
+
+	// The second run finds the results of the first one
+	ASSERT_TRUE(table.open(path, 1 << 16));
+	EXPECT_TRUE(table.warm());
+	EXPECT_EQ(expected.chess_notation(), MinMax<chess::ChessPosition>::FindBestMove(pos, 4).chess_notation());
+	EXPECT_GT(table.hits(), 0);
+	EXPECT_LT(table.misses(), cold_misses);
+
+	MinMax<chess::ChessPosition>::attach_transposition_table(nullptr);
+	table.close();
+	std::filesystem::remove(path);
+}
+
+TEST(TranspositionTable, MinMax_repetition_not_stored)
+{
+	// The draw by repetition of a path isn't stored as the value of the position for the other paths.
+	// White is better with the knight on g1, black prefers to repeat the position after Ng1 and Ng8.
+	auto eval = [](chess::ChessPosition& pos) -> EvalValue::payload_t {
+		return pos[chess::Square("G1")] == chess::Piece::Knight ? 37 : -37;
+	};
+	chess::ChessPosition pos(std::string("4k1n1/8/8/8/8/8/8/4K1N1 w - -"));
+	std::vector<uint64_t> history;
+	for (std::string san : { "Nf3", "Nf6" }) {
+		history.push_back(pos.get_hash<true>());
+		pos += pos.pgn_to_move(san);
+	}
+	chess::ChessPosition back = pos;
+	back += back.pgn_to_move("Ng1");
+	uint64_t key = back.get_hash<true>();
+
+	ChessTable table(1 << 12);
+	MinMax<chess::ChessPosition>::attach_transposition_table(&table);
+	ChessTable::Payload payload;
+	EXPECT_EQ("F3-G1", MinMax<chess::ChessPosition>::FindBestMove(pos, 2, eval, history).chess_notation());
+	EXPECT_FALSE(table.probe(key, payload));
+
+	// Without the cycle the position after Ng1 is good for white
+	MinMax<chess::ChessPosition>::FindBestMove(pos, 2, eval);
+	ASSERT_TRUE(table.probe(key, payload));
+	EXPECT_EQ(37, payload.value);
+	MinMax<chess::ChessPosition>::attach_transposition_table(nullptr);
+}
@@ -1,4 +1,5 @@
 #include "pch.h"
+#include <chrono>
 #include "..\BoardGamesEngine\Games\chess.h"
 #include "..\BoardGamesEngine\Algorithms.h"
 
@@ -24,4 +25,17 @@ TEST(Algorithm_suite, chess_material)
 			return pos.evaluate<1>();
 		});
 	std::cout << "Count: " << count << std::endl;
-}
\ No newline at end of file
+}
+
+TEST(Algorithm_suite, chess_deadline)
+{
+	// Past the deadline the search stops without a move, before it the move is the one of the whole search
+	chess::ChessPosition pos(std::string("1. e4 e5 2. Nf3 Nc6 3. Bb5 a6"));
+	auto eval = [](chess::ChessPosition& pos) -> EvalValue::payload_t { return pos.evaluate<1>(); };
+	auto now = std::chrono::steady_clock::now();
+	EXPECT_FALSE(MinMax<chess::ChessPosition>::FindBestMoveUntil(pos, 6, now, eval));
+
+	auto move = MinMax<chess::ChessPosition>::FindBestMoveUntil(pos, 4, now + std::chrono::hours(1), eval);
+	ASSERT_TRUE(move);
+	EXPECT_EQ(MinMax<chess::ChessPosition>::FindBestMove(pos, 4, eval).chess_notation(), move->chess_notation());
+}
@@ -0,0 +1,103 @@
+#include "pch.h"
+#include <filesystem>
+#include <fstream>
+#include "..\BoardGamesEngine\Games\chess_epd.h"
+
+static const char* suite = R"(# Mates in 1
+4k3/8/4K3/8/8/8/8/7R w - - bm Rh8#; id "KRK";
+r1bqkbnr/ppp2ppp/2np4/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - bm Qxf7#; id "Schuster";
+
+k7/8/1K6/8/8/8/8/2Q5 w - - am Qc7; c0 "a; stalemate"; id "Stalemate";
+4k3/8/8/8/8/8/8/4K3 w - - id "No operation";
+4k3/8/8/8/8/8/8/4K3 w - - bm Qh8;
+4k3/8/8/8/8/8/8/4K3 x - - bm Kd1;
+)";
+
+TEST(chess_epd, parse)
+{
+	size_t invalid;
+	auto entries = chess::EpdRunner::parse(suite, invalid);
+	ASSERT_EQ(3, entries.size());
+	EXPECT_EQ(3, invalid);
+
+	EXPECT_EQ("KRK", entries[0].id);
+	ASSERT_EQ(1, entries[0].best.size());
+	EXPECT_EQ("H1-H8", entries[0].best[0].chess_notation());
+	EXPECT_TRUE(entries[0].avoid.empty());
+	EXPECT_EQ("Schuster", entries[1].id);
+	EXPECT_EQ("F3-F7", entries[1].best[0].chess_notation());
+
+	// The semicolon of the quoted comment doesn't end it
+	EXPECT_EQ("Stalemate", entries[2].id);
+	EXPECT_TRUE(entries[2].best.empty());
+	ASSERT_EQ(1, entries[2].avoid.size());
+	EXPECT_FALSE(entries[2].solved_by(entries[2].avoid[0]));
+	EXPECT_TRUE(entries[2].solved_by(entries[2].position.pgn_to_move("Qc8")));
+}
+
+TEST(chess_epd, run)
+{
+	size_t invalid;
+	auto entries = chess::EpdRunner::parse(suite, invalid);
+	for (int threads : { 1, 3 })
+	{
+		auto report = chess::EpdRunner::run(entries, { .depth = 2, .threads = threads });
+		ASSERT_EQ(entries.size(), report.results.size());
+		EXPECT_EQ(entries.size(), report.solved);
+		for (const auto& result : report.results)
+		{
+			EXPECT_TRUE(result.solved);
+			EXPECT_EQ(2, result.depth);
+			EXPECT_GT(result.nodes, 0);
+			EXPECT_GE(result.time_to_solution, 0);
+		}
+		EXPECT_GT(report.nodes, 0);
+		GTEST_LOG_(INFO) << threads << " threads: " << int64_t(report.nodes_per_second) << " nodes per second";
+	}
+}
+
+TEST(chess_epd, time_limit)
+{
+	// The first iteration is always searched
+	chess::EpdEntry entry;
+	ASSERT_TRUE(entry.parse("6k1/8/5K2/8/8/8/8/7R w - - bm Kg6; id \"KRK mate in 2\";"));
+	auto result = chess::EpdRunner::search(entry, { .depth = 0, .seconds = 1e-9 }, chess::EpdRunner::default_eval);
+	EXPECT_EQ(2, result.depth);
+	EXPECT_GT(result.nodes, 0);
+
+	// The search stops inside an iteration, the move of the last finished one is kept
+	ASSERT_TRUE(entry.parse("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - bm Bb5; id \"Ruy Lopez\";"));
+	result = chess::EpdRunner::search(entry, { .depth = 0, .seconds = 0.2 }, chess::EpdRunner::default_eval);
+	EXPECT_GE(result.depth, 2);
+	EXPECT_LT(result.depth, 10);
+	EXPECT_TRUE(entry.position.is_legal(result.move));
+	EXPECT_LT(result.seconds, 0.5);
+}
+
+TEST(chess_epd, percentile)
+{
+	chess::EpdReport report;
+	EXPECT_EQ(-1, report.percentile(50));
+	for (double time : { 4.0, 1.0, 3.0, 2.0 })
+		report.results.push_back({ .solved = true, .time_to_solution = time });
+	report.results.push_back({});
+	EXPECT_EQ(1.0, report.percentile(0));
+	EXPECT_EQ(2.0, report.percentile(50));
+	EXPECT_EQ(3.0, report.percentile(75));
+	EXPECT_EQ(4.0, report.percentile(90));
+	EXPECT_EQ(4.0, report.percentile(100));
+}
+
+TEST(chess_epd, load)
+{
+	auto path = (std::filesystem::temp_directory_path() / "epd_test.epd").string();
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << suite;
+	}
+	size_t invalid;
+	EXPECT_EQ(3, chess::EpdRunner::load(path, invalid).size());
+	EXPECT_EQ(3, invalid);
+	EXPECT_TRUE(chess::EpdRunner::load(path + ".missing", invalid).empty());
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include <chrono>
+#include <filesystem>
+#include "..\BoardGamesEngine\Games\chess.h"
+#include "..\BoardGamesEngine\Algorithms.h"
+
+static void use_random_network()
+{
+	static uint64_t seed = 0;
+	if (seed == 0)
+		chess::ChessPosition::set_nnue(chess::nnue::Network::random(seed = 1));
+}
+
+static int nnue_eval_full(const chess::ChessPosition& pos)
+{
+	chess::ChessPosition copy = pos;
+	copy.turn_off_nnue_tracking();
+	return copy.nnue_eval();
+}
+
+TEST(chess_nnue, incremental)
+{
+	use_random_network();
+	for (int seed = 1; seed <= DebugRelease(5, 20); seed++)
+	{
+		chess::ChessPosition pos;
+		pos.turn_on_nnue_tracking();
+		Xoshiro256 rng(seed);
+		std::vector<chess::Move> moves;
+		for (int ply = 0; ply < 200; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move(pos, rng, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			pos += move;
+			moves.push_back(move);
+
+			// Evaluating only some positions, the accumulators stay dirty for several moves
+			if (rng.below(3) == 0)
+				EXPECT_EQ(nnue_eval_full(pos), pos.nnue_eval()) << pos.fen();
+		}
+
+		while (!moves.empty())
+		{
+			pos -= moves.back();
+			moves.pop_back();
+			EXPECT_EQ(nnue_eval_full(pos), pos.nnue_eval()) << pos.fen();
+		}
+	}
+}
+
+TEST(chess_nnue, castling)
+{
+	use_random_network();
+	chess::ChessPosition pos(std::string("r3k2r/8/8/8/8/8/8/R3K2R"));
+	pos.turn_on_nnue_tracking();
+	pos.nnue_eval();
+	for (std::string san : { "O-O", "O-O-O", "Rfe1", "Rde8" })
+	{
+		chess::Move move = pos.pgn_to_move(san);
+		ASSERT_TRUE(move.is_valid()) << san;
+		pos += move;
+		EXPECT_EQ(nnue_eval_full(pos), pos.nnue_eval()) << san;
+	}
+}
+
+TEST(chess_nnue, symmetry)
+{
+	// The same position from the other side, the side to move is evaluated the same
+	use_random_network();
+	chess::ChessPosition pos(std::string("1. e4 c5 2. Nf3 d6 3. d4 cxd4 4. Nxd4 Nf6 5. Nc3 a6"));
+	chess::ChessPosition flipped = pos;
+	flipped.flip_board();
+	EXPECT_EQ(-pos.nnue_eval(), flipped.nnue_eval());
+	EXPECT_NE(0, pos.nnue_eval());
+}
+
+TEST(chess_nnue, save_load)
+{
+	auto path = (std::filesystem::temp_directory_path() / "nnue_test.bin").string();
+	auto network = chess::nnue::Network::random(7);
+	ASSERT_TRUE(network->save(path));
+
+	chess::ChessPosition pos(std::string("1. d4 d5 2. c4 e6 3. Nc3 Nf6"));
+	chess::ChessPosition::set_nnue(std::move(network));
+	int eval = pos.nnue_eval();
+	chess::ChessPosition::set_nnue(chess::nnue::Network::random(8));
+	EXPECT_NE(eval, pos.nnue_eval());
+
+	ASSERT_TRUE(chess::ChessPosition::load_nnue(path));
+	EXPECT_EQ(eval, pos.nnue_eval());
+
+	// Truncated file, the loaded network is kept
+	std::filesystem::resize_file(path, 1000);
+	EXPECT_FALSE(chess::ChessPosition::load_nnue(path));
+	EXPECT_EQ(eval, pos.nnue_eval());
+	EXPECT_FALSE(chess::ChessPosition::load_nnue(path + ".missing"));
+	std::filesystem::remove(path);
+
+	chess::ChessPosition::set_nnue(chess::nnue::Network::random(1));
+}
+
+TEST(chess_nnue, minmax)
+{
+	// The search keeps the tracking of its copy of the position
+	use_random_network();
+	auto eval = [](chess::ChessPosition& pos) -> EvalValue::payload_t
+	{
+		return pos.evaluate<100, 0, 0, 0, 0, 1>();
+	};
+
+	chess::ChessPosition pos(std::string("1. e4 e5 2. Nf3 Nc6 3. Bb5 a6"));
+	chess::Move untracked = MinMax<chess::ChessPosition>::FindBestMove(pos, 2, eval);
+	pos.turn_on_nnue_tracking();
+	chess::Move tracked = MinMax<chess::ChessPosition>::FindBestMove(pos, 2, eval);
+	EXPECT_EQ(untracked.chess_notation(), tracked.chess_notation());
+	EXPECT_TRUE(pos.is_legal(tracked));
+}
+
+TEST(chess_nnue, speed)
+{
+	use_random_network();
+	chess::ChessPosition pos(std::string("1. e4 c5 2. Nf3 d6 3. d4 cxd4 4. Nxd4 Nf6 5. Nc3 a6"));
+	pos.turn_on_nnue_tracking();
+	pos.nnue_eval();
+
+	// Make, evaluate and unmake all the moves, as at the leaves of a search
+	std::vector<chess::Move> moves;
+	for (auto move : pos.all_legal_moves())
+		moves.push_back(move);
+
+	const int rounds = DebugRelease(100, 20000);
+	int64_t sum = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int round = 0; round < rounds; round++)
+	{
+		for (auto move : moves)
+		{
+			pos += move;
+			sum += pos.nnue_eval();
+			pos -= move;
+		}
+	}
+	auto seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	double evals = double(rounds) * moves.size();
+	GTEST_LOG_(INFO) << "NNUE evaluations per second: " << int64_t(evals / seconds) << " (" << sum << ")";
+}
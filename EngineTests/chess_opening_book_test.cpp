@@ -0,0 +1,145 @@
+#include "pch.h"
+#include <filesystem>
+#include <sstream>
+#include "..\BoardGamesEngine\Games\chess_opening_book.h"
+#include "test_files.h"
+
+TEST(chess_opening_book, pgn_to_move)
+{
+	chess::ChessPosition pos;
+	for (std::string san : { "e4", "e5", "Nf3", "Nc6", "Bb5", "a6", "Bxc6", "dxc6", "O-O", "f6", "d4", "exd4", "Nxd4+" })
+	{
+		chess::Move move = pos.pgn_to_move(san);
+		ASSERT_TRUE(move.is_valid()) << san;
+		pos += move;
+	}
+
+	// Not a legal move
+	EXPECT_FALSE(pos.pgn_to_move("Qh5").is_valid());
+	EXPECT_FALSE(pos.pgn_to_move("O-O").is_valid());
+	EXPECT_FALSE(pos.pgn_to_move("xyz").is_valid());
+}
+
+TEST(chess_opening_book, pgn_to_move_disambiguation)
+{
+	// Knights on b1 and f1 can both go to d2, rooks on a1 and a5 to a3
+	chess::ChessPosition pos(std::string("4k3/8/8/R7/8/8/8/RN2KN2"));
+	EXPECT_FALSE(pos.pgn_to_move("Nd2").is_valid());
+	chess::Move move = pos.pgn_to_move("Nbd2");
+	ASSERT_TRUE(move.is_valid());
+	EXPECT_EQ(chess::Square("B1"), move.from());
+
+	EXPECT_FALSE(pos.pgn_to_move("Ra3").is_valid());
+	move = pos.pgn_to_move("R1a3");
+	ASSERT_TRUE(move.is_valid());
+	EXPECT_EQ(chess::Square("A1"), move.from());
+	move = pos.pgn_to_move("Ra5a3");
+	ASSERT_TRUE(move.is_valid());
+	EXPECT_EQ(chess::Square("A5"), move.from());
+}
+
+TEST(chess_opening_book, pgn_to_move_promotion)
+{
+	chess::ChessPosition pos(std::string("1n2k3/P7/8/8/8/8/8/4K3"));
+	chess::Move move = pos.pgn_to_move("a8=Q+");
+	ASSERT_TRUE(move.is_valid());
+	EXPECT_EQ(chess::Piece::Queen, move.promotion());
+	move = pos.pgn_to_move("axb8N");
+	ASSERT_TRUE(move.is_valid());
+	EXPECT_EQ(chess::Piece::Knight, move.promotion());
+	EXPECT_EQ(chess::Piece::OtherKnight, move.captured());
+}
+
+static const char* games = R"(
+[Event "First"]
+[Result "1-0"]
+
+1. e4 e5 2. Nf3 {the most common} Nc6 (2... d6 3. d4) 3. Bb5 $1 a6 1-0
+
+[Event "Second"]
+[Result "0-1"]
+
+1.e4 c5 2.Nf3 d6 ; Sicilian
+3.d4 0-1
+
+[Event "Third"]
+[Result "1/2-1/2"]
+
+1. d4 d5 2. c4 1/2-1/2
+)";
+
+TEST(chess_opening_book, build_and_probe)
+{
+	chess::OpeningBookBuilder builder(6);
+	std::stringstream ss(games);
+	EXPECT_EQ(3, builder.add_pgn(ss));
+	EXPECT_EQ(3, builder.games());
+
+	std::string path = temp_path("book.bin");
+	ASSERT_TRUE(builder.write(path));
+
+	chess::OpeningBook book;
+	ASSERT_TRUE(book.open(path));
+	EXPECT_EQ(builder.entries(), book.size());
+
+	// Two games started with e4, one with d4
+	chess::ChessPosition pos;
+	auto [begin, end] = book.find(pos);
+	ASSERT_EQ(2, end - begin);
+	EXPECT_EQ(2, begin->games);
+	EXPECT_EQ(1, begin->wins);
+	EXPECT_EQ(1, (begin + 1)->draws);
+
+	chess::Move move = book.probe(pos);
+	EXPECT_TRUE(move == pos.pgn_to_move("e4"));
+	pos += move;
+
+	// Both replies were played once
+	move = book.probe(pos);
+	EXPECT_TRUE(move == pos.pgn_to_move("e5") || move == pos.pgn_to_move("c5"));
+	EXPECT_FALSE(book.probe(pos, 2).is_valid());
+
+	// The variation isn't in the book
+	pos += pos.pgn_to_move("e5");
+	pos += pos.pgn_to_move("Nf3");
+	move = book.probe(pos);
+	EXPECT_TRUE(move == pos.pgn_to_move("Nc6"));
+
+	// Out of the book
+	chess::ChessPosition other;
+	other += other.pgn_to_move("a4");
+	EXPECT_FALSE(book.probe(other).is_valid());
+
+	book.close();
+	std::filesystem::remove(path);
+}
+
+TEST(chess_opening_book, min_games)
+{
+	chess::OpeningBookBuilder builder;
+	std::stringstream ss(games);
+	builder.add_pgn(ss);
+
+	std::string path = temp_path("book_min_games.bin");
+	ASSERT_TRUE(builder.write(path, 2));
+	chess::OpeningBook book;
+	ASSERT_TRUE(book.open(path));
+
+	// Only 1.e4 was played twice, 2.Nf3 twice too but in different positions
+	EXPECT_EQ(1, book.size());
+	book.close();
+	std::filesystem::remove(path);
+}
+
+TEST(chess_opening_book, invalid_file)
+{
+	std::string path = temp_path("book_invalid.bin");
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << "not a book";
+	}
+	chess::OpeningBook book;
+	EXPECT_FALSE(book.open(path));
+	EXPECT_FALSE(book.open(temp_path("book_missing.bin")));
+	std::filesystem::remove(path);
+}
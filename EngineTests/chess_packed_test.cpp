@@ -0,0 +1,106 @@
+#include "pch.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include "..\BoardGamesEngine\Games\chess_packed.h"
+
+// The FENs of random games, a line per position
+static std::vector<std::string> random_fens(int games)
+{
+	std::vector<std::string> fens;
+	for (int seed = 1; seed <= games; seed++)
+	{
+		chess::ChessPosition pos;
+		Xoshiro256 rng(seed);
+		for (int ply = 0; ply < 100; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move(pos, rng, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			pos += move;
+			fens.push_back(pos.fen());
+		}
+	}
+	return fens;
+}
+
+TEST(chess_packed, round_trip)
+{
+	chess::FenFields fields;
+	ASSERT_TRUE(fields.parse("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"));
+	chess::PackedPosition packed;
+	ASSERT_TRUE(chess::PackedPosition::pack(fields, packed));
+
+	char buffer[chess::FenFields::fen_max_length];
+	packed.unpack().write(buffer);
+	EXPECT_STREQ("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", buffer);
+
+	for (const std::string& fen : random_fens(DebugRelease(5, 20)))
+	{
+		ASSERT_TRUE(fields.parse(fen));
+		ASSERT_TRUE(chess::PackedPosition::pack(fields, packed));
+		chess::ChessPosition pos;
+		pos.set_fen(packed.unpack());
+		EXPECT_EQ(fen, pos.fen());
+	}
+}
+
+TEST(chess_packed, batch)
+{
+	std::vector<std::string> fens = random_fens(DebugRelease(20, 200));
+	std::string text;
+	for (size_t i = 0; i < fens.size(); i++)
+	{
+		text += fens[i] + (i % 2 ? "\r\n" : "\n");
+		if (i % 100 == 0)
+			text += "not a fen\n\n";
+	}
+
+	size_t invalid;
+	std::vector<chess::PackedPosition> single = chess::FenBatch::read(text, invalid);
+	ASSERT_EQ(fens.size(), single.size());
+	EXPECT_EQ((fens.size() + 99) / 100, invalid);
+
+	// The same positions in the same order on threads and from the file
+	auto path = (std::filesystem::temp_directory_path() / "fen_batch_test.txt").string();
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << text;
+	}
+	size_t file_invalid;
+	std::vector<chess::PackedPosition> parallel = chess::FenBatch::read_file(path, file_invalid, 4);
+	EXPECT_EQ(invalid, file_invalid);
+	EXPECT_TRUE(single == parallel);
+	std::filesystem::remove(path);
+
+	chess::ChessPosition pos;
+	pos.set_fen(single.back().unpack());
+	EXPECT_EQ(fens.back(), pos.fen());
+	EXPECT_TRUE(chess::FenBatch::read_file(path + ".missing", invalid).empty());
+}
+
+TEST(chess_packed, speed)
+{
+	std::vector<std::string> fens = random_fens(DebugRelease(20, 1000));
+	std::string text;
+	for (const std::string& fen : fens)
+		text += fen + "\n";
+
+	size_t invalid;
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<chess::PackedPosition> packed = chess::FenBatch::read(text, invalid);
+	auto seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	EXPECT_EQ(fens.size(), packed.size());
+
+	char buffer[chess::FenFields::fen_max_length];
+	size_t length = 0;
+	auto middle = std::chrono::high_resolution_clock::now();
+	for (const chess::PackedPosition& position : packed)
+		length += position.unpack().write(buffer);
+	auto write_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - middle).count();
+	EXPECT_EQ(text.size(), length + fens.size());
+
+	GTEST_LOG_(INFO) << "FEN lines packed per second: " << int64_t(fens.size() / seconds)
+		<< ", written per second: " << int64_t(fens.size() / write_seconds);
+}
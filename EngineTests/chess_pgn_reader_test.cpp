@@ -0,0 +1,202 @@
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include "..\BoardGamesEngine\Games\chess_pgn_reader.h"
+#include "..\BoardGamesEngine\Games\chess_opening_book.h"
+
+static const char* annotated = R"([Event "First"]
+[White "Alice"]
+[Result "1-0"]
+
+1. e4 e5 2. Nf3 {the most common} Nc6 (2... d6 3. d4 {a (comment} exd4) 3. Bb5 $1 a6!? 1-0
+
+% an escaped line
+[Event "Second"]
+[Result "0-1"]
+
+1.e4 c5 2.Nf3 d6 ; Sicilian
+3.d4 0-1
+[Event "No termination marker"]
+
+1. d4 d5 2. c4
+[Event "Third"]
+[Result "1/2-1/2"]
+
+1. d4 d5 2. Qxd5 *
+1. c4 e5 1/2-1/2
+)";
+
+static std::string sans(const chess::PgnGame& game)
+{
+	chess::ChessPosition pos;
+	std::string ret;
+	for (chess::Move move : game.moves)
+	{
+		ret += pos.move_to_pgn(move) + " ";
+		pos += move;
+	}
+	return ret;
+}
+
+TEST(chess_pgn_reader, san_round_trip)
+{
+	// The candidates of the piece moves resolve the same moves as the legal moves
+	for (int seed = 1; seed <= DebugRelease(10, 50); seed++)
+	{
+		chess::ChessPosition pos;
+		Xoshiro256 rng(seed);
+		for (int ply = 0; ply < 150; ply++)
+		{
+			std::vector<chess::Move> moves;
+			for (chess::Move move : pos.all_legal_moves())
+				moves.push_back(move);
+			if (moves.empty())
+				break;
+			for (chess::Move move : moves)
+			{
+				std::string san = pos.move_to_pgn(move);
+				EXPECT_TRUE(move == pos.pgn_to_move(san)) << san << " " << pos.fen();
+			}
+			pos += moves[rng.below(moves.size())];
+		}
+	}
+}
+
+TEST(chess_pgn_reader, annotated)
+{
+	std::vector<std::string> moves;
+	std::vector<chess::GameResult> results;
+	std::vector<bool> valid;
+	std::vector<std::string> whites;
+	size_t count = chess::PgnReader().read(annotated, [&](const chess::PgnGame& game, int thread)
+		{
+			EXPECT_EQ(0, thread);
+			moves.push_back(sans(game));
+			results.push_back(game.result);
+			valid.push_back(game.valid);
+			whites.push_back(std::string(game.tag("White")));
+		});
+
+	ASSERT_EQ(5, count);
+	ASSERT_EQ(5, moves.size());
+	EXPECT_EQ("e4 e5 Nf3 Nc6 Bb5 a6 ", moves[0]);
+	EXPECT_EQ(chess::GameResult::WhiteWins, results[0]);
+	EXPECT_EQ("Alice", whites[0]);
+	EXPECT_EQ("e4 c5 Nf3 d6 d4 ", moves[1]);
+	EXPECT_EQ(chess::GameResult::BlackWins, results[1]);
+	EXPECT_EQ("", whites[1]);
+	EXPECT_EQ("d4 d5 c4 ", moves[2]);
+	EXPECT_EQ(chess::GameResult::Unknown, results[2]);
+
+	// The illegal Qxd5 ends the moves, the tag gives the result as the marker is "*"
+	EXPECT_EQ("d4 d5 ", moves[3]);
+	EXPECT_FALSE(valid[3]);
+	EXPECT_EQ(chess::GameResult::Draw, results[3]);
+
+	// A game without tags
+	EXPECT_EQ("c4 e5 ", moves[4]);
+	EXPECT_TRUE(valid[4]);
+	EXPECT_EQ(chess::GameResult::Draw, results[4]);
+}
+
+TEST(chess_pgn_reader, max_plies)
+{
+	std::vector<std::string> moves;
+	chess::PgnReader(1, 3).read(annotated, [&](const chess::PgnGame& game, int)
+		{
+			moves.push_back(sans(game));
+			chess::ChessPosition pos;
+			for (chess::Move move : game.moves)
+				pos += move;
+			EXPECT_EQ(pos, game.position);
+		});
+	ASSERT_EQ(5, moves.size());
+	EXPECT_EQ("e4 e5 Nf3 ", moves[0]);
+	EXPECT_EQ("c4 e5 ", moves[4]);
+}
+
+// Random games in the PGN format, with tags
+static std::string random_database(int games, std::vector<std::string>& expected)
+{
+	std::string text;
+	for (int seed = 1; seed <= games; seed++)
+	{
+		chess::GameRecord game;
+		Xoshiro256 rng(seed);
+		for (int ply = 0; ply < 80; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move(game.position(), rng, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			game.play(move);
+		}
+		chess::PgnGame parsed;
+		parsed.moves = game.moves();
+		expected.push_back(sans(parsed));
+
+		text += "[Event \"Random\"]\n[Round \"" + std::to_string(seed) + "\"]\n[Result \"*\"]\n\n";
+		text += game.pgn() + "*\n\n";
+	}
+	return text;
+}
+
+TEST(chess_pgn_reader, threads)
+{
+	std::vector<std::string> expected;
+	std::string text = random_database(DebugRelease(20, 200), expected);
+
+	auto chunks = chess::PgnReader::split(text, 4);
+	ASSERT_EQ(4, chunks.size());
+	for (size_t i = 1; i < chunks.size(); i++)
+		EXPECT_EQ(0, chunks[i].find("[Event"));
+
+	// Each thread gives its games in order, the rounds put them back in the order of the text
+	std::mutex mutex;
+	std::vector<std::string> moves(expected.size());
+	size_t count = chess::PgnReader(4).read(text, [&](const chess::PgnGame& game, int thread)
+		{
+			EXPECT_TRUE(game.valid);
+			std::lock_guard<std::mutex> lock(mutex);
+			moves[std::stoi(std::string(game.tag("Round"))) - 1] = sans(game);
+		});
+	EXPECT_EQ(expected.size(), count);
+	EXPECT_EQ(expected, moves);
+}
+
+TEST(chess_pgn_reader, file_and_book)
+{
+	std::vector<std::string> expected;
+	std::string text = random_database(DebugRelease(20, 100), expected);
+	auto path = (std::filesystem::temp_directory_path() / "pgn_reader_test.pgn").string();
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << text;
+	}
+
+	// The book is the same built from the file on threads or from the text
+	chess::OpeningBookBuilder single(10), parallel(10);
+	EXPECT_EQ(expected.size(), single.add_pgn(std::string_view(text)));
+	EXPECT_EQ(expected.size(), parallel.add_pgn_file(path, 3));
+	EXPECT_EQ(single.games(), parallel.games());
+	EXPECT_EQ(single.entries(), parallel.entries());
+	EXPECT_EQ(0, parallel.add_pgn_file(path + ".missing", 3));
+	std::filesystem::remove(path);
+}
+
+TEST(chess_pgn_reader, speed)
+{
+	std::vector<std::string> expected;
+	std::string text = random_database(DebugRelease(50, 2000), expected);
+	for (int threads : { 1, 4 })
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t count = chess::PgnReader(threads).read(text, [](const chess::PgnGame&, int) {});
+		auto seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		EXPECT_EQ(expected.size(), count);
+		GTEST_LOG_(INFO) << threads << " threads: " << int64_t(count * 60 / seconds) << " games per minute";
+	}
+}
@@ -1,6 +1,31 @@
 #include "pch.h"
 #include "..\BoardGamesEngine\Games\chess.h"
 #include "..\BoardGamesEngine\Algorithms.h"
+#include "..\BoardGamesEngine\MateSearch.h"
+#include "..\BoardGamesEngine\Games\MNKGeneralized.h"
+
+void check_mate_search(std::string pgn_or_fen, int mate_in) {
+	chess::ChessPosition pos(pgn_or_fen);
+	MateSearch<chess::ChessPosition> search(pos);
+	auto result = search.Solve(mate_in);
+	EXPECT_EQ(MateResult::Proven, result.result);
+	EXPECT_EQ(mate_in, result.mate_in);
+
+	// The line alternates the players and ends with the mate
+	ASSERT_EQ(2 * mate_in - 1, result.line.size());
+	for (size_t i = 0; i < result.line.size(); i++) {
+		EXPECT_FALSE(pos.is_check_mate()) << "Checkmate after " << i << " plies";
+		pos += result.line[i];
+	}
+	EXPECT_TRUE(pos.is_check_mate());
+
+	// Exact: no shorter mate
+	if (mate_in > 1) {
+		MateSearch<chess::ChessPosition> shorter((chess::ChessPosition(pgn_or_fen)));
+		EXPECT_EQ(MateResult::Refuted, shorter.Prove(mate_in - 1));
+	}
+	GTEST_LOG_(INFO) << "Mate search nodes: " << search.nodes();
+}
 
 void check(std::string pgn_or_fen, int depth, int mate_in) {
 	chess::ChessPosition pos(pgn_or_fen);
@@ -23,6 +48,8 @@ void check(std::string pgn_or_fen, int depth, int mate_in) {
 	move = MinMax<chess::ChessPosition>::FindBestMove(pos, depth);
 	pos += move;
 	EXPECT_TRUE(pos.is_check_mate());
+
+	check_mate_search(pgn_or_fen, mate_in);
 }
 
 TEST(chess_puzzles, KRK_MateIn1) {
@@ -44,3 +71,142 @@ TEST(chess_puzzles, SchusterMate) {
 	// https://lichess.org/Ii96fdur#6
 	check("1. e4 e5 2. Bc4 d6 3. Qf3 Nc6", 2, 1);
 }
+
+TEST(chess_puzzles, MateSearch_checks_only) {
+	// The mate in 2 starts with a quiet king move
+	chess::ChessPosition pos(std::string("6k1/8/5K2/8/8/8/8/7R"));
+	MateSearch<chess::ChessPosition> search(pos, { .checks_only = true });
+	EXPECT_EQ(MateResult::Refuted, search.Solve(2).result);
+
+	// Schuster mate is a check
+	auto result = MateSearch<chess::ChessPosition>::FindMate(chess::ChessPosition(std::string("1. e4 e5 2. Bc4 d6 3. Qf3 Nc6")), 1, true);
+	EXPECT_EQ(1, result.mate_in);
+}
+
+TEST(chess_puzzles, MateSearch_no_mate) {
+	chess::ChessPosition pos;
+	MateSearch<chess::ChessPosition> search(pos);
+	auto result = search.Solve(2);
+	EXPECT_EQ(MateResult::Refuted, result.result);
+	EXPECT_EQ(0, result.mate_in);
+	EXPECT_TRUE(result.line.empty());
+}
+
+TEST(chess_puzzles, MateSearch_node_budget) {
+	chess::ChessPosition pos(std::string("8/p7/k1K5/8/1p3P2/5R2/8/4B3"));
+	MateSearch<chess::ChessPosition> search(pos, { .max_nodes = 10 });
+	EXPECT_EQ(MateResult::Unknown, search.Solve(2).result);
+
+	// The budget suffices for the proof, the line is completed beyond it
+	MateSearch<chess::ChessPosition> unbounded(pos);
+	unbounded.Prove(1);
+	ASSERT_EQ(MateResult::Proven, unbounded.Prove(2));
+	MateSearch<chess::ChessPosition> bounded(pos, { .max_nodes = unbounded.nodes() });
+	auto result = bounded.Solve(2);
+	ASSERT_EQ(MateResult::Proven, result.result);
+	EXPECT_GT(bounded.nodes(), unbounded.nodes());
+	ASSERT_EQ(3, result.line.size());
+	for (auto move : result.line)
+	{
+		ASSERT_TRUE(pos.is_legal(move)) << move.chess_notation();
+		pos += move;
+	}
+	EXPECT_TRUE(pos.is_check_mate());
+}
+
+TEST(chess_puzzles, MateSearch_stalemate_isnt_mate) {
+	// Qc7 stalemates, Qc8 mates
+	chess::ChessPosition pos(std::string("k7/8/1K6/8/8/8/8/2Q5"));
+	auto result = MateSearch<chess::ChessPosition>::FindMate(pos, 1);
+	ASSERT_EQ(1, result.mate_in);
+	pos += result.line[0];
+	EXPECT_TRUE(pos.is_check_mate());
+}
+
+TEST(chess_puzzles, MateSearch_TicTacToe) {
+	// A win counts as a mate, the fork wins in 2
+	auto result = MateSearch<TicTacToe>::FindMate(TicTacToe(std::string("3/XXO/1O1")), 3);
+	EXPECT_EQ(2, result.mate_in);
+	EXPECT_EQ(3, result.line.size());
+	EXPECT_EQ(MateResult::Refuted, MateSearch<TicTacToe>::FindMate(TicTacToe(), 4).result);
+}
+
+using ExtendedMinMax = MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, false, SearchExtensions<>>;
+
+TEST(chess_puzzles, Extensions_SmotheredMate) {
+	// 1. Qg8+ Rxg8 (the only reply) 2. Nf7#, found at the nominal depth 2
+	chess::ChessPosition pos(std::string("5r1k/6pp/7N/3Q4/8/8/8/7K"));
+	auto result = MateSearch<chess::ChessPosition>::FindMate(pos, 2);
+	ASSERT_EQ(2, result.mate_in);
+
+	size_t leaves = 0;
+	auto count_leaves = [&leaves](chess::ChessPosition&) -> EvalValue::payload_t { leaves++; return 0; };
+
+	chess::Move move = ExtendedMinMax::FindBestMove(pos, 2, count_leaves);
+	size_t extended_leaves = leaves;
+	EXPECT_EQ("D5-G8", move.chess_notation());
+	pos += move;
+	EXPECT_EQ(1, pos.count_all_legal_moves());
+	pos += ExtendedMinMax::FindBestMove(pos, 2);
+	pos += ExtendedMinMax::FindBestMove(pos, 2);
+	EXPECT_TRUE(pos.is_check_mate());
+
+	// Without the extensions the mate needs the nominal depth 4
+	leaves = 0;
+	chess::ChessPosition start(std::string("5r1k/6pp/7N/3Q4/8/8/8/7K"));
+	MinMax<chess::ChessPosition>::FindBestMove(start, 4, count_leaves);
+	EXPECT_LT(extended_leaves, leaves);
+}
+
+TEST(chess_puzzles, Extensions_MateIn2) {
+	for (std::string fen : { "6k1/8/5K2/8/8/8/8/7R", "8/p7/k1K5/8/1p3P2/5R2/8/4B3" }) {
+		chess::ChessPosition pos(fen);
+		pos += ExtendedMinMax::FindBestMove(pos, 4);
+		pos += ExtendedMinMax::FindBestMove(pos, 4);
+		pos += ExtendedMinMax::FindBestMove(pos, 4);
+		EXPECT_TRUE(pos.is_check_mate()) << fen;
+	}
+}
+
+TEST(chess_puzzles, Repetition_ClaimsDraw) {
+	// A queen down, white repeats the position after Kf1 instead of losing on material
+	auto material = [](chess::ChessPosition& pos) -> EvalValue::payload_t { return pos.evaluate(); };
+	chess::ChessPosition pos(std::string("3qk3/8/8/8/8/8/8/4K3"));
+	std::vector<uint64_t> history;
+	for (std::string san : { "Kf1", "Qd7", "Ke1", "Qd8" }) {
+		history.push_back(pos.get_hash<true>());
+		pos += pos.pgn_to_move(san);
+	}
+	EXPECT_EQ(history[0], pos.get_hash<true>());
+
+	chess::Move move = MinMax<chess::ChessPosition>::FindBestMove(pos, 2, material, history);
+	EXPECT_EQ("E1-F1", move.chess_notation());
+
+	// Without the history there is no draw
+	move = MinMax<chess::ChessPosition>::FindBestMove(pos, 2, material);
+	EXPECT_NE("E1-F1", move.chess_notation());
+}
+
+TEST(chess_puzzles, Repetition_AvoidedWhenWinning) {
+	// A queen up and the king prefers f1, but there it repeats the position, a draw
+	auto eval = [](chess::ChessPosition& pos) -> EvalValue::payload_t {
+		return 10 * pos.evaluate() + (pos[chess::Square("F1")] == chess::Piece::King ? 1 : 0);
+	};
+	chess::ChessPosition pos(std::string("4k3/8/8/8/8/8/8/3QK3"));
+	std::vector<uint64_t> history;
+	for (std::string san : { "Kf1", "Kd7", "Ke1", "Ke8" }) {
+		history.push_back(pos.get_hash<true>());
+		pos += pos.pgn_to_move(san);
+	}
+
+	EXPECT_EQ("E1-F1", MinMax<chess::ChessPosition>::FindBestMove(pos, 2, eval).chess_notation());
+	for (int depth : { 2, 4 }) {
+		chess::Move move = MinMax<chess::ChessPosition>::FindBestMove(pos, depth, eval, history);
+		EXPECT_NE("E1-F1", move.chess_notation()) << depth;
+	}
+
+	// The positions before a capture or a pawn move can't repeat
+	chess::ChessPosition pawns(std::string("4k3/7p/8/8/8/8/7P/3QK3"));
+	EXPECT_FALSE(pawns.pgn_to_move("h3").is_reversible());
+	EXPECT_TRUE(pawns.pgn_to_move("Kf1").is_reversible());
+}
@@ -1,4 +1,7 @@
 #include "pch.h"
+#include <chrono>
+#include <filesystem>
+#include <thread>
 #include "..\BoardGamesEngine\Games\chess.h"
 #include "..\BoardGamesEngine\Algorithms.h"
 
@@ -15,8 +18,8 @@ TEST(chess, pgn)
 {
 	for (int seed = 1; seed <= DebugRelease(10, 50); seed++)
 	{
-		chess::ChessPosition pos;
-		pos.track_pgn();
+		chess::GameRecord game;
+		const chess::ChessPosition& pos = game.position();
 		stats moves;
 		int ply;
 		for (ply = 0; ply < 150; ply++)
@@ -26,15 +29,15 @@ TEST(chess, pgn)
 
 			// Get a random move and check that the board isn't affected
 			size_t number_of_moves;
-			chess::Move move = random_move<chess::ChessPosition, chess::Move>(pos, seed, number_of_moves);
+			chess::Move move = random_move<chess::ChessPosition, chess::Move>(game.position(), seed, number_of_moves);
 			
 			// Check for end of the game, either by checkmate or stalemate
 			if (number_of_moves == 0)
 				break;
 
-			pos += move;
+			game.play(move);
 
-			std::string pgn = pos.pgn();
+			std::string pgn = game.pgn();
 			chess::ChessPosition pos2(pgn);
 			EXPECT_EQ(pos, pos2) << "seed=" << seed << " ply=" << pos.ply() << " pgn=" << pgn << std::endl;
 		}
@@ -46,7 +49,6 @@ TEST(chess, fen)
 	for (int seed = 1; seed <= DebugRelease(10, 50); seed++)
 	{
 		chess::ChessPosition pos;
-		pos.track_pgn();
 		stats moves;
 		int ply;
 		for (ply = 0; ply < 150; ply++)
@@ -71,8 +73,9 @@ TEST(chess, fen)
 				EXPECT_EQ(pos[square], pos2[square]) << "seed=" << seed << " ply=" << pos.ply() << " fen=" << fen << " square=" << square.chess_notation() << std::endl;
 			}
 
-			// TODO: implement ends, for example " b "
-			//EXPECT_EQ(pos.turn(), pos2.turn());
+			EXPECT_EQ(pos.turn(), pos2.turn());
+			EXPECT_EQ(pos.ply(), pos2.ply());
+			EXPECT_EQ(fen, pos2.fen());
 		}
 	}
 }
@@ -81,13 +84,58 @@ TEST(chess, fen_specific_positions) {
 	chess::ChessPosition pos(false);
 	chess::ChessPosition pos_fen(std::string("4k3/8/8/8/8/8/8/4K3"));
 	std::string fen2 = pos_fen.fen();
-	EXPECT_EQ(std::string("4k3/8/8/8/8/8/8/4K3"), fen2);// << pos << std::endl << pos_fen;
+	EXPECT_EQ(std::string("4k3/8/8/8/8/8/8/4K3 w - - 0 1"), fen2);// << pos << std::endl << pos_fen;
 
 	chess::ChessPosition pos_full(true);
 	chess::ChessPosition pos_full_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR");
 	EXPECT_EQ(pos_full, pos_full_fen);
 }
 
+TEST(chess, fen_fields) {
+	chess::ChessPosition start;
+	EXPECT_EQ("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", start.fen());
+
+	// The fen doesn't change the position
+	chess::ChessPosition copy = start;
+	start.fen();
+	EXPECT_EQ(copy, start);
+
+	chess::ChessPosition pos;
+	EXPECT_TRUE(pos.set_fen("r3k2r/8/8/8/4P3/8/8/R3K3 b Qk e3 12 34"));
+	EXPECT_EQ(Player::Second, pos.turn());
+	EXPECT_EQ(67, pos.ply());
+	EXPECT_EQ(chess::Piece::OtherRook, pos[chess::Square("H8")]);
+	EXPECT_EQ(chess::Piece::King, pos[chess::Square("E1")]);
+	EXPECT_EQ("r3k2r/8/8/8/4P3/8/8/R3K3 b Qkq - 0 34", pos.fen());
+
+	chess::FenFields fields;
+	ASSERT_TRUE(fields.parse("r3k2r/8/8/8/4P3/8/8/R3K3 b Qk e3 12 34"));
+	EXPECT_EQ(chess::FenFields::white_long | chess::FenFields::black_short, fields.castling);
+	EXPECT_EQ(20, fields.en_passant);
+	EXPECT_EQ(12, fields.halfmove);
+	char buffer[chess::FenFields::fen_max_length];
+	size_t length = fields.write(buffer);
+	EXPECT_EQ("r3k2r/8/8/8/4P3/8/8/R3K3 b Qk e3 12 34", std::string(buffer, length));
+	EXPECT_EQ(length, strlen(buffer));
+
+	// Invalid, the position is kept
+	for (const char* fen : { "", "8/8/8/8/8/8/8/8", "4k3/8/8/8/8/8/8/4K2", "4k3/8/8/8/8/8/8/4K4", "4k3/8/8/8/8/8/8/4K3/8",
+		"4k3/8/8/8/8/8/8/4KX2", "4k3/8/8/8/8/8/8/4K3 x", "4k3/8/8/8/8/8/8/4K3 w KX", "4k3/8/8/8/8/8/8/4K3 w - e4",
+		"4k3/8/8/8/8/8/8/4K3 w - - -1", "4k3/8/8/8/8/8/8/4K3 w - - 0 0", "4k3/8/8/8/8/8/8/4K3 w - - 0 1 x" })
+	{
+		EXPECT_FALSE(pos.set_fen(fen)) << fen;
+	}
+	EXPECT_EQ("r3k2r/8/8/8/4P3/8/8/R3K3 b Qkq - 0 34", pos.fen());
+
+	// The trackings follow the new board
+	chess::ChessPosition tracked;
+	tracked.turn_on_material_tracking();
+	tracked.turn_on_pawn_tracking();
+	EXPECT_TRUE(tracked.set_fen("4k3/8/8/8/4P3/8/8/R3K3 w - - 0 1"));
+	EXPECT_EQ(tracked.get_material_full(), tracked.get_material());
+	EXPECT_EQ(tracked.get_pawn_key_full(), tracked.get_pawn_key());
+}
+
 TEST(chess, init_position) {
 	chess::ChessPosition pos;
 	EXPECT_FALSE(pos.is_checked(Player::First));
@@ -295,9 +343,9 @@ TEST(chess, is_legal) {
 TEST(chess, minmax_vs_random) {
 	for (int round = 1; round <= DebugRelease(1, 2); round++)
 	{
-		chess::ChessPosition pos;
+		chess::GameRecord game;
+		chess::ChessPosition& pos = game.position();
 		pos.turn_on_material_tracking();
-		pos.track_pgn();
 		
 		while (true)
 		{
@@ -317,17 +365,17 @@ TEST(chess, minmax_vs_random) {
 
 			if (!move.is_valid())
 			{
-				EXPECT_TRUE(random) << "round:" << round << " game:" << pos.pgn() << std::endl;
-				EXPECT_TRUE(pos.is_checked(pos.turn())) << pos.pgn() << std::endl;
+				EXPECT_TRUE(random) << "round:" << round << " game:" << game.pgn() << std::endl;
+				EXPECT_TRUE(pos.is_checked(pos.turn())) << game.pgn() << std::endl;
 
-				GTEST_LOG_(INFO) << pos.pgn() << std::endl;
+				GTEST_LOG_(INFO) << game.pgn() << std::endl;
 				break;
 			}
 
 			EXPECT_TRUE(pos.is_legal(move));
-			pos += move;
+			game.play(move);
 		}
-		std::string pgn = pos.pgn();
+		std::string pgn = game.pgn();
 	}
 }
 
@@ -356,9 +404,10 @@ TEST(chess, random_games) {
 
 	for (int seed = 1; seed <= DebugRelease(20, 500); seed++)
 	{
-		chess::ChessPosition pos;
-		pos.track_pgn();
+		chess::GameRecord game;
+		chess::ChessPosition& pos = game.position();
 		stats moves;
+		Xoshiro256 rng(seed);
 		int ply;
 		for (ply = 0; ply < 15000; ply++)
 		{
@@ -368,7 +417,7 @@ TEST(chess, random_games) {
 			// Get a random move and check that the board isn't affected
 			chess::ChessPosition pos_backup = pos;
 			size_t number_of_moves;
-			chess::Move move = random_move<chess::ChessPosition, chess::Move>(pos, seed, number_of_moves);
+			chess::Move move = random_move(pos, rng, number_of_moves);
 			if (number_of_moves > 0)
 				moves.add(int(number_of_moves));
 			
@@ -377,7 +426,7 @@ TEST(chess, random_games) {
 				<< pos_backup.fen() << std::endl;
 			if (pos != pos_backup)
 			{
-				std::string pgn = pos.pgn();
+				std::string pgn = game.pgn();
 				FAIL();
 			}
 
@@ -423,7 +472,7 @@ TEST(chess, random_games) {
 					if (abs(piece) == chess::Piece::Bishop
 						|| abs(piece) == chess::Piece::Knight)
 					{
-						std::string pgn = pos.pgn();
+						std::string pgn = game.pgn();
 						should_break = true;
 						file_csv << "Insufficient material,";
 						draws.add(ply);
@@ -437,7 +486,7 @@ TEST(chess, random_games) {
 			
 			EXPECT_TRUE(pos.is_legal(move));
 
-			pos += move;
+			game.play(move);
 
 			// No pawns on the 1st and 8th rows
 			chess::Square first("A1"), last("A8");
@@ -461,7 +510,7 @@ TEST(chess, random_games) {
 		}
 		total.add(ply);
 
-		std::string png = pos.pgn();
+		std::string png = game.pgn();
 		std::ofstream file_game;
 		file_game.open(std::string("game") + std::to_string(seed) + ".pgn");
 		file_game << png;
@@ -473,7 +522,7 @@ TEST(chess, random_games) {
 		file_csv << moves.max() << ",";
 		file_csv << moves.avg() << ",";
 		file_csv << pos.fen() << ",";
-		file_csv << pos.pgn() << std::endl;
+		file_csv << game.pgn() << std::endl;
 	}
 
 	std::ofstream all_stats;
@@ -514,6 +563,9 @@ TEST(chess, hash)
 {
 	chess::ChessPosition pos;
 	
+	// The hash without the turn is of the placement, the first field of the FEN
+	auto placement = [](const chess::ChessPosition& pos) { std::string fen = pos.fen(); return fen.substr(0, fen.find(' ')); };
+
 	std::unordered_map<uint64_t, chess::ChessPosition> hash_positions;
 	for (int seed = 0; seed < 10; seed++)
 	{
@@ -530,7 +582,7 @@ TEST(chess, hash)
 			if (hash_positions.contains(hash))
 			{
 				auto pos2 = hash_positions[hash];
-				EXPECT_EQ(pos.fen(), pos2.fen()) << "These two have same hash:" << pos.fen() << " and " << pos2.fen();
+				EXPECT_EQ(placement(pos), placement(pos2)) << "These two have same hash:" << pos.fen() << " and " << pos2.fen();
 			}
 			else
 			{
@@ -551,3 +603,482 @@ TEST(chess, four_promotion_pieces)
 	}
 	EXPECT_EQ(count, 4);
 }
+
+// Each legal move is a reverse move of the position after it, each reverse move a legal move of the position before
+static void check_reverse_moves(chess::ChessPosition& pos)
+{
+	std::string fen = pos.fen();
+	for (chess::Move move : pos.all_legal_moves())
+	{
+		pos += move;
+		bool found = false;
+		for (chess::Move reverse : pos.all_reverse_moves(chess::abs(move.captured()), move.promotion() != chess::Piece::None))
+		{
+			found |= reverse == move;
+			EXPECT_TRUE(pos.is_reverse_legal(reverse));
+			pos -= reverse;
+			bool legal = false;
+			for (chess::Move forward : pos.all_legal_moves())
+				legal |= forward == reverse;
+			EXPECT_TRUE(legal) << fen << " " << reverse.chess_notation();
+			pos += reverse;
+		}
+		EXPECT_TRUE(found) << fen << " " << move.chess_notation();
+		pos -= move;
+		EXPECT_EQ(fen, pos.fen());
+	}
+}
+
+TEST(chess, reverse_moves)
+{
+	for (std::string fen : {
+		"4k3/P7/8/8/8/8/8/4K3 w - - 0 1",			// promotions
+		"1n2k3/P7/8/8/8/8/8/4K3 w - - 0 1",			// promotions by capture
+		"4k3/8/8/3p4/4P3/8/8/R3K2R w KQ - 0 1",		// castling
+		"8/8/8/3k4/8/8/2Q5/3K4 b - - 0 1",
+		"8/8/8/8/8/2k5/8/2K1r3 w - - 0 1" })		// in check
+	{
+		chess::ChessPosition pos(fen);
+		check_reverse_moves(pos);
+	}
+
+	for (int seed = 1; seed <= DebugRelease(3, 10); seed++)
+	{
+		chess::ChessPosition pos;
+		for (int ply = 0; ply < 100; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move<chess::ChessPosition, chess::Move>(pos, seed, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			pos += move;
+			check_reverse_moves(pos);
+		}
+	}
+}
+
+TEST(chess, reverse_moves_count)
+{
+	// The white king came from 4 squares, the queen from 12 of the 22 squares behind it,
+	// the other 10 would give check to the black king
+	chess::ChessPosition pos(std::string("8/8/8/3k4/8/8/2Q5/3K4 b - - 0 1"));
+	int king = 0, queen = 0;
+	for (chess::Move move : pos.all_reverse_moves())
+	{
+		king += move.piece() == chess::Piece::King;
+		queen += move.piece() == chess::Piece::Queen;
+	}
+	EXPECT_EQ(4, king);
+	EXPECT_EQ(12, queen);
+
+	// The black king left in check, no position before
+	chess::ChessPosition illegal(std::string("2k5/8/8/8/8/8/8/2R1K3 w - - 0 1"));
+	int count = 0;
+	for (chess::Move move : illegal.all_reverse_moves())
+		count++;
+	EXPECT_EQ(0, count);
+}
+
+static int see(std::string fen, std::string san)
+{
+	chess::ChessPosition pos(fen);
+	chess::Move move = pos.pgn_to_move(san);
+	EXPECT_TRUE(move.is_valid()) << san;
+	return pos.see(move);
+}
+
+TEST(chess, see)
+{
+	// Undefended and defended pieces
+	EXPECT_EQ(9, see("4k3/8/8/4q3/8/8/8/4RK2", "Rxe5"));
+	EXPECT_EQ(2, see("4k3/8/3p4/4n3/3P4/8/8/4K3", "dxe5"));
+	EXPECT_EQ(-4, see("4k3/8/3p4/4p3/8/8/8/4RK2", "Rxe5"));
+
+	// A quiet move to an attacked square
+	EXPECT_EQ(-5, see("4k3/8/3p4/8/8/8/8/2R1K3", "Rc5"));
+	EXPECT_EQ(0, see("4k3/8/3p4/8/8/8/8/2R1K3", "Rc4"));
+}
+
+TEST(chess, see_xray)
+{
+	// The rook behind the rook, the queen behind the bishop
+	EXPECT_EQ(1, see("4r1k1/8/8/4p3/8/8/4R3/4RK2", "Rexe5"));
+	EXPECT_EQ(-1, see("6k1/8/5p2/4p3/3B4/2Q5/8/6K1", "Bxe5"));
+
+	// Black x-ray defends too
+	EXPECT_EQ(-4, see("4r1k1/4r3/8/4p3/8/8/4R3/4RK2", "Rexe5"));
+}
+
+TEST(chess, see_king)
+{
+	// The king can't recapture a defended piece
+	EXPECT_EQ(-4, see("8/8/8/3k4/4p3/8/8/4RK2", "Rxe4"));
+	EXPECT_EQ(1, see("8/8/8/3k4/4p3/6N1/8/4RK2", "Rxe4"));
+}
+
+TEST(chess, see_promotion)
+{
+	EXPECT_EQ(-1, see("1r2k3/P7/8/8/8/8/8/4K3", "a8=Q"));
+	EXPECT_EQ(13, see("1r2k3/P7/8/8/8/8/8/4K3", "axb8=Q"));
+}
+
+TEST(chess, see_speed)
+{
+	std::vector<std::pair<chess::ChessPosition, chess::Move>> captures;
+	for (int seed = 1; seed <= 20; seed++)
+	{
+		chess::ChessPosition pos;
+		Xoshiro256 rng(seed);
+		for (int ply = 0; ply < 60; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move(pos, rng, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			for (auto capture : pos.all_legal_moves())
+			{
+				if (capture.captured() != chess::Piece::None)
+					captures.push_back({ pos, capture });
+			}
+			pos += move;
+		}
+	}
+	ASSERT_FALSE(captures.empty());
+
+	int sum = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < 100; i++)
+	{
+		for (auto& [pos, move] : captures)
+			sum += pos.see(move);
+	}
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	GTEST_LOG_(INFO) << "SEE: " << ns / (100 * captures.size()) << " ns per call, " << captures.size() << " captures, checksum " << sum;
+}
+
+static void expect_pst_tracked(const chess::ChessPosition& pos)
+{
+	auto tracked = pos.get_pst();
+	auto full = pos.get_pst_full();
+	EXPECT_EQ(full.mg, tracked.mg) << pos.fen();
+	EXPECT_EQ(full.eg, tracked.eg) << pos.fen();
+	EXPECT_EQ(full.phase, tracked.phase) << pos.fen();
+}
+
+TEST(chess, pst_incremental)
+{
+	for (int seed = 1; seed <= DebugRelease(10, 50); seed++)
+	{
+		chess::ChessPosition pos;
+		pos.turn_on_pst_tracking();
+		Xoshiro256 rng(seed);
+		std::vector<chess::Move> moves;
+		for (int ply = 0; ply < 200; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move(pos, rng, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			pos += move;
+			moves.push_back(move);
+			expect_pst_tracked(pos);
+		}
+
+		// And back to the start
+		while (!moves.empty())
+		{
+			pos -= moves.back();
+			moves.pop_back();
+			expect_pst_tracked(pos);
+		}
+		EXPECT_EQ(0, pos.pst_eval());
+	}
+}
+
+TEST(chess, pst_castle_and_promotion)
+{
+	chess::ChessPosition pos(std::string("r3k2r/P7/8/8/8/8/8/R3K2R"));
+	pos.turn_on_pst_tracking();
+	for (std::string san : { "O-O", "O-O-O", "a8=Q", "Kd7" })
+	{
+		chess::Move move = pos.pgn_to_move(san);
+		ASSERT_TRUE(move.is_valid()) << san;
+		pos += move;
+		expect_pst_tracked(pos);
+	}
+}
+
+TEST(chess, pst_tapered)
+{
+	// The initial position is symmetric and in the middlegame
+	chess::ChessPosition pos;
+	EXPECT_EQ(0, pos.pst_eval());
+	EXPECT_EQ(chess::ChessPosition::pst_max_phase, pos.get_pst().phase);
+
+	// Only the endgame tables for kings and pawns: the central king is better
+	chess::ChessPosition center(std::string("7k/8/8/8/3K4/8/P7/8"));
+	chess::ChessPosition corner(std::string("7k/8/8/8/8/8/P7/K7"));
+	EXPECT_EQ(0, center.get_pst().phase);
+	EXPECT_GT(center.pst_eval(), corner.pst_eval());
+
+	// Better development
+	chess::ChessPosition developed;
+	developed += developed.pgn_to_move("Nf3");
+	EXPECT_GT(developed.pst_eval(), 0);
+	EXPECT_GT((developed.evaluate<100, 0, 0, 0, 1>()), 0);
+}
+
+TEST(chess, pst_load)
+{
+	auto path = (std::filesystem::temp_directory_path() / "pst_weights.txt").string();
+	ASSERT_TRUE(chess::ChessPosition::save_pst(path));
+	ASSERT_TRUE(chess::ChessPosition::load_pst(path));
+
+	chess::ChessPosition developed;
+	developed += developed.pgn_to_move("Nf3");
+	int eval = developed.pst_eval();
+	{
+		// Knights prefer the edge
+		std::ofstream out(path);
+		out << "# knights on the rim\nmg knight\n";
+		for (int i = 0; i < 64; i++)
+			out << (i % 8 == 0 || i % 8 == 7 ? 400 : 200) << ' ';
+	}
+	ASSERT_TRUE(chess::ChessPosition::load_pst(path));
+	EXPECT_LT(developed.pst_eval(), eval);
+
+	{
+		std::ofstream out(path);
+		out << "mg knight 1 2 3";
+	}
+	EXPECT_FALSE(chess::ChessPosition::load_pst(path));
+
+	chess::ChessPosition::initialize_pst(true);
+	EXPECT_EQ(eval, developed.pst_eval());
+	std::filesystem::remove(path);
+}
+
+TEST(chess, pawn_key_incremental)
+{
+	for (int seed = 1; seed <= DebugRelease(10, 50); seed++)
+	{
+		chess::ChessPosition pos;
+		pos.turn_on_pawn_tracking();
+		Xoshiro256 rng(seed);
+		std::vector<chess::Move> moves;
+		for (int ply = 0; ply < 200; ply++)
+		{
+			size_t number_of_moves;
+			chess::Move move = random_move(pos, rng, number_of_moves);
+			if (number_of_moves == 0)
+				break;
+			pos += move;
+			moves.push_back(move);
+			EXPECT_EQ(pos.get_pawn_key_full(), pos.get_pawn_key()) << pos.fen();
+			EXPECT_EQ(pos.pawn_structure_full().score, pos.pawn_eval()) << pos.fen();
+		}
+
+		while (!moves.empty())
+		{
+			pos -= moves.back();
+			moves.pop_back();
+			EXPECT_EQ(pos.get_pawn_key_full(), pos.get_pawn_key()) << pos.fen();
+		}
+	}
+}
+
+TEST(chess, pawn_structure)
+{
+	// White: a2 isolated and passed, c2 and c3 isolated and doubled, c3 passed.
+	// Black: h7 isolated and passed.
+	chess::ChessPosition pos(std::string("4k3/7p/8/8/8/2P5/P1P5/4K3"));
+	auto entry = pos.pawn_structure_full();
+	EXPECT_EQ(-15 * 3 - 10 + 5 + 10 + 15 - 5, entry.score);
+	EXPECT_EQ((uint64_t(1) << 8) | (uint64_t(1) << 18), entry.passed[0]);
+	EXPECT_EQ(uint64_t(1) << 55, entry.passed[1]);
+
+	// Blocked on its file, and watched from the adjacent file
+	chess::ChessPosition blocked(std::string("4k3/8/8/1p6/P7/8/8/4K3"));
+	EXPECT_EQ(0, blocked.passed_pawns(Player::First));
+	EXPECT_EQ(0, blocked.passed_pawns(Player::Second));
+
+	// The pawn moves only change the pawn key
+	chess::ChessPosition start;
+	chess::ChessPosition knight = start;
+	knight += knight.pgn_to_move("Nf3");
+	EXPECT_EQ(start.get_pawn_key(), knight.get_pawn_key());
+	EXPECT_EQ(0, chess::ChessPosition(true).get_pawn_key());
+}
+
+TEST(chess, pawn_table_hits)
+{
+	auto eval = [](chess::ChessPosition& pos) -> EvalValue::payload_t
+	{
+		return pos.evaluate<100, 0, 0, 0, 0, 0, 1>();
+	};
+
+	chess::ChessPosition pos(std::string("1. e4 e5 2. Nf3 Nc6 3. Bb5 a6"));
+	pos.turn_on_pawn_tracking();
+	chess::ChessPosition::pawn_table.clear();
+	MinMax<chess::ChessPosition>::FindBestMove(pos, 4, eval);
+	auto& table = chess::ChessPosition::pawn_table;
+	GTEST_LOG_(INFO) << "Pawn table hits: " << table.hits << ", misses: " << table.misses;
+	EXPECT_GT(table.hits, 5 * table.misses);
+}
+
+TEST(chess, game_record)
+{
+	chess::GameRecord game;
+	for (std::string san : { "e4", "e5", "Nf3", "Nc6", "Ng1", "Nb8", "Nf3" })
+		game.play(game.position().pgn_to_move(san));
+	EXPECT_EQ("1. e4 e5 2. Nf3 Nc6 3. Ng1 Nb8 4. Nf3 ", game.pgn());
+	EXPECT_EQ(chess::ChessPosition(game.pgn()), game.position());
+
+	// The positions since e5, the last pawn move
+	auto history = game.history();
+	ASSERT_EQ(5, history.size());
+	EXPECT_EQ(history[1], game.position().get_hash<true>());
+
+	game.undo();
+	game.undo();
+	EXPECT_EQ("1. e4 e5 2. Nf3 Nc6 3. Ng1 ", game.pgn());
+	EXPECT_EQ(5, game.moves().size());
+	EXPECT_EQ(chess::ChessPosition(game.pgn()), game.position());
+}
+
+TEST(chess, copy_make)
+{
+	using MakeUnmake = MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, false, NoExtensions, false>;
+	using CopyMake = MinMax<chess::ChessPosition, KillerOptions::SingleUpdating, false, NoExtensions, true>;
+	auto eval = [](chess::ChessPosition& pos) -> EvalValue::payload_t
+	{
+		return pos.evaluate<100, 0, 0, 0, 1>();
+	};
+
+	chess::ChessPosition pos(std::string("1. e4 e5 2. Nf3 Nc6 3. Bb5 a6"));
+	pos.turn_on_material_tracking();
+	pos.turn_on_pst_tracking();
+	const int depth = DebugRelease(3, 4);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	chess::Move unmade = MakeUnmake::FindBestMove(pos, depth, eval);
+	auto middle = std::chrono::high_resolution_clock::now();
+	chess::Move copied = CopyMake::FindBestMove(pos, depth, eval);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	EXPECT_EQ(unmade.chess_notation(), copied.chess_notation());
+	GTEST_LOG_(INFO) << "sizeof(ChessPosition): " << sizeof(chess::ChessPosition)
+		<< ", make/unmake: " << std::chrono::duration<double>(middle - start).count()
+		<< "s, copy-make: " << std::chrono::duration<double>(end - middle).count() << "s";
+
+	// The moves of a leaf, taken back or played on a copy
+	std::vector<chess::Move> moves;
+	for (auto move : pos.all_legal_moves())
+		moves.push_back(move);
+	const int rounds = DebugRelease(100, 20000);
+	auto per_move = [&moves, rounds](auto leaf, int64_t& sum)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int round = 0; round < rounds; round++)
+			for (auto move : moves)
+				sum += leaf(move);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count() / (double(rounds) * moves.size());
+	};
+	int64_t unmade_sum = 0, copied_sum = 0;
+	double unmake = per_move([&pos](chess::Move move)
+	{
+		pos += move;
+		int value = pos.pst_eval();
+		pos -= move;
+		return value;
+	}, unmade_sum);
+	double copy = per_move([&pos](chess::Move move)
+	{
+		chess::ChessPosition child = pos;
+		child += move;
+		return child.pst_eval();
+	}, copied_sum);
+	EXPECT_EQ(unmade_sum, copied_sum);
+	GTEST_LOG_(INFO) << "Per move and evaluation, make/unmake: " << unmake << " ns, copy-make: " << copy << " ns";
+}
+
+TEST(chess, tracked_values)
+{
+	// Two positions at the same plies on other lines keep their own values
+	chess::ChessPosition first, second(std::string("4k3/8/8/8/8/8/8/R3K2R w - - 0 1"));
+	for (chess::ChessPosition* pos : { &first, &second })
+	{
+		pos->turn_on_material_tracking();
+		pos->turn_on_pst_tracking();
+	}
+	first += first.pgn_to_move("e4");
+	second += second.pgn_to_move("Ra8+");
+	for (chess::ChessPosition* pos : { &first, &second })
+	{
+		EXPECT_EQ(pos->get_material_full(), pos->get_material());
+		expect_pst_tracked(*pos);
+	}
+
+	// More plies than the ring keeps, and back
+	chess::ChessPosition pos(std::string("4k3/8/8/8/8/8/8/R3K2R w - - 0 1"));
+	pos.turn_on_pst_tracking();
+	Xoshiro256 rng(1);
+	std::vector<chess::Move> moves;
+	while (moves.size() < 3 * chess::ChessPosition::tracked_plies)
+	{
+		size_t number_of_moves;
+		chess::Move move = random_move(pos, rng, number_of_moves);
+		if (number_of_moves == 0)
+			break;
+		pos += move;
+		moves.push_back(move);
+	}
+	EXPECT_GT(moves.size(), chess::ChessPosition::tracked_plies);
+	while (!moves.empty())
+	{
+		pos -= moves.back();
+		moves.pop_back();
+		expect_pst_tracked(pos);
+	}
+
+	// A copy on another thread has the values of the position
+	second += second.pgn_to_move("Kd7");
+	chess::ChessPosition::PstScore score, full;
+	std::thread([&score, &full, second]() mutable
+	{
+		second += second.pgn_to_move("Rb8");
+		score = second.get_pst();
+		full = second.get_pst_full();
+	}).join();
+	EXPECT_EQ(full.mg, score.mg);
+	EXPECT_EQ(full.eg, score.eg);
+	expect_pst_tracked(second);
+
+	// Copies of one position playing other moves at the same ply, and taking them back
+	chess::ChessPosition original(std::string("4k3/8/8/3q4/4P3/8/8/4K3 w - - 0 1"));
+	original.turn_on_material_tracking();
+	original.turn_on_pst_tracking();
+	chess::ChessPosition a = original, b = original;
+	chess::Move capture = a.pgn_to_move("exd5"), push = b.pgn_to_move("e5");
+	a += capture;
+	b += push;
+	for (chess::ChessPosition* pos : { &a, &b, &a })
+	{
+		EXPECT_EQ(pos->get_material_full(), pos->get_material());
+		expect_pst_tracked(*pos);
+	}
+	a -= capture;
+	b -= push;
+	for (chess::ChessPosition* pos : { &a, &b, &original })
+	{
+		EXPECT_EQ(pos->get_material_full(), pos->get_material());
+		expect_pst_tracked(*pos);
+	}
+
+	// Turned off, the values are computed from the board
+	a.turn_off_all_trackings();
+	a += capture;
+	EXPECT_EQ(0, a.trackings);
+	EXPECT_EQ(a.get_material_full(), a.get_material());
+}
@@ -8,10 +8,14 @@ TEST(CombinationTest, CombinationTest_ ## N ## _ ## K)			\
 	for (SIZE index = 0; index < size; index++)					\
 	{															\
 		combination comb(N, K);									\
+		int ones = 0;											\
 		for (bool b : combination::get_combination(N,K,index))	\
 		{														\
-																\
+			if (b) { comb.add_one(); ones++; }					\
+			else comb.add_zero();								\
 		};														\
+		EXPECT_EQ(K, ones);										\
+		EXPECT_EQ(index, comb.get_index());						\
 	}															\
 }
 
@@ -0,0 +1,36 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include "gtest/gtest.h"
+
+/// <summary>
+/// The path of a file in the temporary directory, removed if it's left from a previous run.
+/// </summary>
+inline std::string temp_path(const char* name)
+{
+	auto path = std::filesystem::temp_directory_path() / name;
+	std::filesystem::remove(path);
+	return path.string();
+}
+
+/// <summary>
+/// Fixture of the tests writing to a directory of their own, created empty before the test and removed after it.
+/// </summary>
+class TempDirectoryTest : public testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		const testing::TestInfo* info = testing::UnitTest::GetInstance()->current_test_info();
+		directory = std::filesystem::temp_directory_path() / (std::string(info->test_case_name()) + "_" + info->name());
+		std::filesystem::remove_all(directory);
+		std::filesystem::create_directories(directory);
+	}
+
+	void TearDown() override
+	{
+		std::filesystem::remove_all(directory);
+	}
+
+	std::filesystem::path directory;
+};
@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include "..\BoardGamesEngine\Games\chess_epd.h"
+
+// Usage: EpdRunner suite.epd [--depth N] [--time SECONDS] [--threads N]
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s suite.epd [--depth N] [--time SECONDS] [--threads N]\n", argv[0]);
+		return 1;
+	}
+
+	chess::EpdOptions options;
+	std::optional<int> depth;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--depth") == 0)
+			depth = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--time") == 0)
+			options.seconds = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--threads") == 0)
+			options.threads = atoi(argv[i + 1]);
+	}
+	if (depth && *depth <= 0)
+	{
+		printf("The depth has to be positive\n");
+		return 1;
+	}
+	// The depth is rounded up to the full moves, without it the time limit ends the iterations
+	if (depth)
+		options.depth = *depth + *depth % 2;
+	else if (options.seconds > 0)
+		options.depth = 0;
+
+	size_t invalid;
+	auto suite = chess::EpdRunner::load(argv[1], invalid);
+	if (suite.empty())
+	{
+		printf("No position in %s\n", argv[1]);
+		return 1;
+	}
+	if (invalid > 0)
+		printf("%zu invalid lines skipped\n", invalid);
+
+	auto report = chess::EpdRunner::run(suite, options);
+	for (size_t i = 0; i < suite.size(); i++)
+	{
+		const auto& result = report.results[i];
+		printf("%-20s %-6s %-8s depth %2d %12zu nodes %8.3fs", suite[i].id.c_str(), result.solved ? "solved" : "failed",
+			suite[i].position.move_to_pgn(result.move).c_str(), result.depth, result.nodes, result.seconds);
+		if (result.solved)
+			printf(" solved at %.3fs", result.time_to_solution);
+		printf("\n");
+	}
+
+	printf("\nSolved %zu/%zu in %.2fs, %zu nodes, %.0f nodes per second\n", report.solved, suite.size(),
+		report.seconds, report.nodes, report.nodes_per_second);
+	if (report.solved > 0)
+	{
+		printf("Time to solution: p50 %.3fs, p90 %.3fs, max %.3fs\n",
+			report.percentile(50), report.percentile(90), report.percentile(100));
+	}
+	return 0;
+}